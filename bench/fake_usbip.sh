@@ -0,0 +1,77 @@
+#!/bin/sh
+# Scriptable stand-in for usbip, driven by bench/loop_bench.c.
+#
+# Everything lives in the directory named by $FAKE_USBIP_STATE:
+#   records/port0   present while the device is attached; the monitor's inotify
+#                   watch sees it come and go like a real vhci port record
+#   exported        present while the remote host exports the device
+#   fail_attach     present to make attach fail even though the device is exported
+#   down_<host>     present to make list and attach fail as if <host> were unreachable
+#   delay_<command> optional artificial delay in seconds (sleep syntax) for
+#                   port, list or attach; FAKE_USBIP_DELAY_PORT, _LIST and
+#                   _ATTACH set the same from the environment
+#   log             one "<command> <CLOCK_REALTIME ns>" line per invocation,
+#                   plus "attach-done <ns>" once an attach has taken effect
+
+state=${FAKE_USBIP_STATE:?FAKE_USBIP_STATE must name the state directory}
+busid=${FAKE_USBIP_BUSID:-1-1}
+command=$1
+
+echo "$command $(date +%s%N)" >> "$state/log"
+case "$command" in
+port) delay=${FAKE_USBIP_DELAY_PORT:-} ;;
+list) delay=${FAKE_USBIP_DELAY_LIST:-} ;;
+attach) delay=${FAKE_USBIP_DELAY_ATTACH:-} ;;
+esac
+if [ -f "$state/delay_$command" ]; then
+    delay=$(cat "$state/delay_$command")
+fi
+if [ -n "$delay" ]; then
+    sleep "$delay"
+fi
+
+if [ -n "$3" ] && [ -f "$state/down_$3" ]; then
+    echo "usbip: error: could not connect to $3:3240"
+    exit 1
+fi
+
+case "$command" in
+port)
+    echo "Imported USB devices"
+    echo "===================="
+    if [ -f "$state/records/port0" ]; then
+        read -r host service remote < "$state/records/port0"
+        echo "Port 00: <Port in Use> at High Speed(480Mbps)"
+        echo "       Fake Vendor : Fake Device (1234:5678)"
+        echo "       3-1 -> usbip://$host:$service/$remote"
+        echo "           -> remote bus/dev 001/002"
+    fi
+    ;;
+list)
+    host=$3
+    echo "Exportable USB devices"
+    echo "======================"
+    echo " - $host"
+    if [ -f "$state/exported" ]; then
+        echo "      $busid: Fake Vendor : Fake Device (1234:5678)"
+        echo "           : /sys/devices/platform/fake/usb1/$busid"
+        echo "           : (Defined at Interface level) (00/00/00)"
+    fi
+    ;;
+attach)
+    host=$3
+    if [ ! -f "$state/exported" ] || [ -f "$state/fail_attach" ] || [ "$5" != "$busid" ]; then
+        echo "usbip: error: import device"
+        exit 1
+    fi
+    # Write then rename so the monitor never reads a half-written record
+    echo "$host 3240 $busid" > "$state/records/.port0"
+    mv "$state/records/.port0" "$state/records/port0"
+    echo "attach-done $(date +%s%N)" >> "$state/log"
+    ;;
+*)
+    echo "usbip: error: unsupported command $command"
+    exit 1
+    ;;
+esac
+exit 0
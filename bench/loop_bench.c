@@ -0,0 +1,369 @@
+/* End-to-end benchmark of the monitor loop against bench/fake_usbip.sh */
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define DEFAULT_MONITOR "build/bench/usbip-auto-attach"
+#define FAKE_USBIP "bench/fake_usbip.sh"
+#define DEFAULT_ROUNDS 5
+#define MAX_ROUNDS 100
+#define MAX_MONITOR_ARGS 32
+#define FAKE_HOST "127.0.0.1"
+#define FAKE_BUSID "1-1"
+
+/* Phase lengths and give-up times, in milliseconds */
+#define ATTACH_TIMEOUT_MS 15000
+#define CONFIRM_TIMEOUT_MS 10000
+#define SETTLE_MS 300
+#define IDLE_MS 5000
+#define OUTAGE_MS 10000
+#define RECOVERY_TIMEOUT_MS 120000
+
+/* Latencies of one detach, in nanoseconds from the moment the record vanished */
+typedef struct {
+    long long detect;      /* First `usbip port` after the detach */
+    long long attach;      /* Fake attach took effect */
+    long long confirm;     /* First `usbip port` after the attach, i.e. the monitor saw it */
+} Round;
+
+static char state_dir[] = "/tmp/loop_bench.XXXXXX";
+static char record_path[256];
+static char exported_path[256];
+static char log_path[256];
+static pid_t monitor_pid = -1;
+
+static long long now_ns(void) {
+    struct timespec ts;
+    /* The fake timestamps its log with `date +%s%N`, so use the same clock */
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_ms(int ms) {
+    struct timespec ts = {ms / 1000, (long)(ms % 1000) * 1000000L};
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+    }
+}
+
+static int touch(const char* path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+static int remove_entry(const char* path, const struct stat* st, int flag, struct FTW* ftw) {
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+static int monitor_alive(void) {
+    int status;
+    return monitor_pid > 0 && waitpid(monitor_pid, &status, WNOHANG) == 0;
+}
+
+/* Scans the fake's log for the first `command` entry at or after since_ns.
+ * With count set, counts the entries instead; returns 0 if none. */
+static long long scan_log(const char* command, long long since_ns, int count) {
+    char line[128];
+    char name[32];
+    long long ts;
+    long long found = 0;
+    FILE* f = fopen(log_path, "r");
+
+    if (!f) {
+        return 0;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%31s %lld", name, &ts) != 2 || ts < since_ns) {
+            continue;
+        }
+        if (command && strcmp(name, command) != 0) {
+            continue;
+        }
+        if (!count) {
+            found = ts;
+            break;
+        }
+        found++;
+    }
+    fclose(f);
+    return found;
+}
+
+/* Waits for a `command` entry at or after since_ns; returns its time or 0 */
+static long long wait_for_log(const char* command, long long since_ns, int timeout_ms) {
+    long long deadline = now_ns() + (long long)timeout_ms * 1000000LL;
+    long long ts;
+
+    while ((ts = scan_log(command, since_ns, 0)) == 0) {
+        if (now_ns() >= deadline || !monitor_alive()) {
+            return 0;
+        }
+        sleep_ms(1);
+    }
+    return ts;
+}
+
+/* Counts process spawns (every fake invocation) per minute over ms of idling */
+static double spawns_per_minute(int ms) {
+    long long start = now_ns();
+    long long spawns;
+
+    sleep_ms(ms);
+    spawns = scan_log(NULL, start, 1) - scan_log("attach-done", start, 1);
+    return (double)spawns * 60000.0 / ms;
+}
+
+/* Reads "<key>: <n> kB" from /proc/<pid>/status */
+static long read_status_kb(pid_t pid, const char* key) {
+    char path[64];
+    char line[128];
+    size_t key_len = strlen(key);
+    long kb = -1;
+    FILE* f;
+
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, key, key_len) == 0 && line[key_len] == ':') {
+            kb = strtol(line + key_len + 1, NULL, 10);
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+/* Reads CPU time in ms of the process itself and of its reaped children */
+static int read_cpu_ms(pid_t pid, double* self_ms, double* children_ms) {
+    char path[64];
+    char buf[1024];
+    unsigned long utime, stime;
+    long cutime, cstime;
+    double tick_ms = 1000.0 / (double)sysconf(_SC_CLK_TCK);
+    char* fields;
+    FILE* f;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+    if (!fgets(buf, sizeof(buf), f)) {
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+
+    /* Skip "pid (comm)", comm may contain spaces; then fields 3..17 */
+    fields = strrchr(buf, ')');
+    if (!fields || sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %ld %ld",
+                          &utime, &stime, &cutime, &cstime) != 4) {
+        return -1;
+    }
+    *self_ms = (double)(utime + stime) * tick_ms;
+    *children_ms = (double)(cutime + cstime) * tick_ms;
+    return 0;
+}
+
+static pid_t start_monitor(const char* monitor, const char* fake, char** extra, int extra_count) {
+    const char* argv[MAX_MONITOR_ARGS + 8];
+    char monitor_log[256];
+    int argc = 0;
+    int i;
+    pid_t pid;
+
+    argv[argc++] = monitor;
+    argv[argc++] = "-t";
+    argv[argc++] = FAKE_HOST ":" FAKE_BUSID;
+    argv[argc++] = "--usbip-path";
+    argv[argc++] = fake;
+    argv[argc++] = "--no-native";
+    for (i = 0; i < extra_count && i < MAX_MONITOR_ARGS; i++) {
+        argv[argc++] = extra[i];
+    }
+    argv[argc] = NULL;
+
+    snprintf(monitor_log, sizeof(monitor_log), "%s/monitor.log", state_dir);
+    pid = fork();
+    if (pid == 0) {
+        int fd = open(monitor_log, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        execv(monitor, (char* const*)argv);
+        _exit(127);
+    }
+    return pid;
+}
+
+static int compare_ll(const void* a, const void* b) {
+    long long x = *(const long long*)a;
+    long long y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+/* Prints min/median/max in ms of one latency across rounds */
+static void print_latency(const char* label, const Round* rounds, int count, size_t offset) {
+    long long values[MAX_ROUNDS];
+    int i;
+
+    for (i = 0; i < count; i++) {
+        values[i] = *(const long long*)((const char*)&rounds[i] + offset);
+    }
+    qsort(values, (size_t)count, sizeof(values[0]), compare_ll);
+    printf("%-28s %10.1f %10.1f %10.1f ms\n", label, values[0] / 1e6, values[count / 2] / 1e6,
+           values[count - 1] / 1e6);
+}
+
+static int run(const char* monitor, int round_count, char** extra, int extra_count) {
+    Round rounds[MAX_ROUNDS];
+    char fake[PATH_MAX];
+    double idle_rate, outage_rate;
+    double self_ms, children_ms;
+    long long start, t0, attached, recovered;
+    long rss_kb, hwm_kb;
+    int r;
+
+    if (!realpath(FAKE_USBIP, fake)) {
+        fprintf(stderr, "Cannot find %s (run from the repository root)\n", FAKE_USBIP);
+        return 1;
+    }
+
+    start = now_ns();
+    monitor_pid = start_monitor(monitor, fake, extra, extra_count);
+    if (monitor_pid < 0) {
+        perror("fork");
+        return 1;
+    }
+
+    attached = wait_for_log("attach-done", start, ATTACH_TIMEOUT_MS);
+    if (!attached || !wait_for_log("port", attached, CONFIRM_TIMEOUT_MS)) {
+        fprintf(stderr, "FAIL: monitor never attached the fake device, see %s/monitor.log\n", state_dir);
+        return 1;
+    }
+    printf("%-28s %10.1f ms\n", "startup to attached", (attached - start) / 1e6);
+
+    /* Steady state: attached and nothing happening */
+    sleep_ms(SETTLE_MS);
+    idle_rate = spawns_per_minute(IDLE_MS);
+
+    /* Detach and time the way back */
+    for (r = 0; r < round_count; r++) {
+        sleep_ms(SETTLE_MS);
+        t0 = now_ns();
+        unlink(record_path);
+        rounds[r].attach = wait_for_log("attach-done", t0, ATTACH_TIMEOUT_MS);
+        rounds[r].detect = wait_for_log("port", t0, 0);
+        rounds[r].confirm = rounds[r].attach ? wait_for_log("port", rounds[r].attach, CONFIRM_TIMEOUT_MS) : 0;
+        if (!rounds[r].attach || !rounds[r].detect || !rounds[r].confirm) {
+            fprintf(stderr, "FAIL: round %d did not reattach, see %s/monitor.log\n", r + 1, state_dir);
+            return 1;
+        }
+        rounds[r].detect -= t0;
+        rounds[r].attach -= t0;
+        rounds[r].confirm -= t0;
+    }
+    printf("%-28s %10s %10s %10s\n", "detach rounds", "min", "median", "max");
+    print_latency("detection latency", rounds, round_count, offsetof(Round, detect));
+    print_latency("reattach latency", rounds, round_count, offsetof(Round, attach));
+    print_latency("reattach confirmed", rounds, round_count, offsetof(Round, confirm));
+
+    /* Host stops exporting: how hard does the monitor retry, how soon does it recover */
+    sleep_ms(SETTLE_MS);
+    unlink(exported_path);
+    unlink(record_path);
+    outage_rate = spawns_per_minute(OUTAGE_MS);
+    t0 = now_ns();
+    touch(exported_path);
+    recovered = wait_for_log("attach-done", t0, RECOVERY_TIMEOUT_MS);
+    if (!recovered) {
+        fprintf(stderr, "FAIL: monitor did not recover after the outage, see %s/monitor.log\n", state_dir);
+        return 1;
+    }
+    printf("%-28s %10.1f ms\n", "recovery after outage", (recovered - t0) / 1e6);
+
+    printf("%-28s %10.1f\n", "spawns/min attached", idle_rate);
+    printf("%-28s %10.1f\n", "spawns/min host down", outage_rate);
+
+    rss_kb = read_status_kb(monitor_pid, "VmRSS");
+    hwm_kb = read_status_kb(monitor_pid, "VmHWM");
+    printf("%-28s %10ld kB (peak %ld kB)\n", "monitor RSS", rss_kb, hwm_kb);
+    if (read_cpu_ms(monitor_pid, &self_ms, &children_ms) == 0) {
+        long long cycles = scan_log("port", start, 1);
+        printf("%-28s %10.1f ms (%lld port checks, %.3f ms each)\n", "monitor CPU", self_ms, cycles,
+               cycles ? self_ms / (double)cycles : 0.0);
+        printf("%-28s %10.1f ms\n", "fake usbip CPU", children_ms);
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    const char* monitor = argc > 1 ? argv[1] : DEFAULT_MONITOR;
+    int rounds = argc > 2 ? atoi(argv[2]) : DEFAULT_ROUNDS;
+    char records_dir[sizeof(state_dir) + sizeof("/records")];
+    char no_vhci_dir[sizeof(state_dir) + sizeof("/platform")];
+    int ret;
+
+    if (rounds < 1 || rounds > MAX_ROUNDS || argc - 3 > MAX_MONITOR_ARGS) {
+        fprintf(stderr, "Usage: %s [<monitor binary> [<rounds 1-%d> [<monitor options>...]]]\n", argv[0], MAX_ROUNDS);
+        return 1;
+    }
+    if (access(monitor, X_OK) != 0) {
+        fprintf(stderr, "Cannot run %s (build it with `make bench-loop`)\n", monitor);
+        return 1;
+    }
+    if (!mkdtemp(state_dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    /* Fake usbip state, plus an empty sysfs tree so the monitor goes through `usbip port` */
+    snprintf(records_dir, sizeof(records_dir), "%s/records", state_dir);
+    snprintf(no_vhci_dir, sizeof(no_vhci_dir), "%s/platform", state_dir);
+    snprintf(record_path, sizeof(record_path), "%s/records/port0", state_dir);
+    snprintf(exported_path, sizeof(exported_path), "%s/exported", state_dir);
+    snprintf(log_path, sizeof(log_path), "%s/log", state_dir);
+    mkdir(records_dir, 0755);
+    mkdir(no_vhci_dir, 0755);
+    touch(exported_path);
+    setenv("FAKE_USBIP_STATE", state_dir, 1);
+    setenv("FAKE_USBIP_BUSID", FAKE_BUSID, 1);
+    setenv("USBIP_AUTO_ATTACH_VHCI_DIR", no_vhci_dir, 1);
+    setenv("USBIP_AUTO_ATTACH_RECORD_DIR", records_dir, 1);
+
+    ret = run(monitor, rounds, argv + 3, argc > 3 ? argc - 3 : 0);
+
+    if (monitor_pid > 0) {
+        kill(monitor_pid, SIGTERM);
+        waitpid(monitor_pid, NULL, 0);
+    }
+    /* Keep the state around for a look at monitor.log when something failed */
+    if (ret == 0) {
+        nftw(state_dir, remove_entry, 8, FTW_DEPTH | FTW_PHYS);
+    }
+    return ret;
+}
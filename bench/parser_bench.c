@@ -0,0 +1,186 @@
+/* Parser micro-benchmark over the recorded outputs in bench/corpus */
+#define _DEFAULT_SOURCE
+#include "../src/parser.h"
+#include "../src/scan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Minimum measuring time per case */
+#define BENCH_MIN_NS 200000000LL
+#define CORPUS_DIR "bench/corpus"
+#define MISSING_BUSID "99-99"
+
+/* One corpus entry from MANIFEST */
+typedef struct {
+    char name[64];
+    char kind[8];
+    int devices;
+    char last_busid[32];
+    char* data;
+    size_t size;
+} CorpusFile;
+
+typedef int (*bench_fn)(const CorpusFile* file, const char* busid);
+
+static PortTable table;
+static DeviceMatcher matcher;
+static volatile int sink;
+static int failures;
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Reads a whole corpus file, NUL-terminated */
+static char* load_file(const char* name, size_t* size) {
+    char path[256];
+    char* data;
+    long len;
+    FILE* f;
+
+    snprintf(path, sizeof(path), "%s/%s.txt", CORPUS_DIR, name);
+    f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = malloc((size_t)len + 1);
+    if (!data || fread(data, 1, (size_t)len, f) != (size_t)len) {
+        free(data);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    data[len] = '\0';
+    *size = (size_t)len;
+    return data;
+}
+
+static int bench_port_hit(const CorpusFile* file, const char* busid) {
+    return parse_usbip_port(file->data, busid, 1);
+}
+
+static int bench_port_table(const CorpusFile* file, const char* busid) {
+    port_table_parse(&table, file->data);
+    // The last busid of a corpus file is on its last port, exported by that port's host
+    return table.count > 0 && port_table_find(&table, table.records[table.count - 1].host, busid, 1) != NULL;
+}
+
+static int bench_list(const CorpusFile* file, const char* busid) {
+    return parse_usbip_list(file->data, busid);
+}
+
+/* Matcher built once per case, as the monitor would at startup */
+static int bench_port_matcher(const CorpusFile* file, const char* busid) {
+    (void)busid;
+    return device_matcher_port(&matcher, file->data, file->size);
+}
+
+static int bench_list_matcher(const CorpusFile* file, const char* busid) {
+    (void)busid;
+    return device_matcher_list(&matcher, file->data, file->size);
+}
+
+/* Times fn on one file and prints ns/call and throughput */
+static void run_case(const CorpusFile* file, const char* name, const char* suffix, bench_fn fn, const char* busid,
+                     int expected) {
+    char label[32];
+    long long iterations = 1;
+    long long start, elapsed;
+    long long i;
+    double ns_per_call;
+
+    snprintf(label, sizeof(label), "%s%s", name, suffix);
+    device_matcher_init(&matcher, busid, 1);
+    if (fn(file, busid) != expected) {
+        fprintf(stderr, "FAIL: %s %s returned %d, expected %d\n", file->name, label, !expected, expected);
+        failures++;
+        return;
+    }
+
+    /* Grow the batch until it runs long enough to time reliably */
+    for (;;) {
+        start = now_ns();
+        for (i = 0; i < iterations; i++) {
+            sink += fn(file, busid);
+        }
+        elapsed = now_ns() - start;
+        if (elapsed >= BENCH_MIN_NS) {
+            break;
+        }
+        iterations *= elapsed > 0 && elapsed < BENCH_MIN_NS / 16 ? 16 : 2;
+    }
+
+    ns_per_call = (double)elapsed / (double)iterations;
+    printf("%-22s %-18s %12.1f ns/call %10.1f MB/s\n", file->name, label, ns_per_call,
+           (double)file->size / ns_per_call * 1000.0);
+}
+
+/* Runs every case for the kind of a file */
+static void run_file(const CorpusFile* file, const char* suffix) {
+    if (strcmp(file->kind, "port") == 0) {
+        run_case(file, "port/last", suffix, bench_port_hit, file->last_busid, 1);
+        run_case(file, "port/miss", suffix, bench_port_hit, MISSING_BUSID, 0);
+        run_case(file, "match/last", suffix, bench_port_matcher, file->last_busid, 1);
+        run_case(file, "table/last", suffix, bench_port_table, file->last_busid, 1);
+    } else {
+        run_case(file, "list/last", suffix, bench_list, file->last_busid, 1);
+        run_case(file, "list/miss", suffix, bench_list, MISSING_BUSID, 0);
+        run_case(file, "match/last", suffix, bench_list_matcher, file->last_busid, 1);
+    }
+}
+
+int main() {
+    char manifest_path[256];
+    char line[256];
+    FILE* manifest;
+
+    snprintf(manifest_path, sizeof(manifest_path), "%s/MANIFEST", CORPUS_DIR);
+    manifest = fopen(manifest_path, "r");
+    if (!manifest) {
+        fprintf(stderr, "Cannot open %s (run from the repository root)\n", manifest_path);
+        return 1;
+    }
+
+    printf("Scanning with %s\n", scan_implementation());
+    printf("%-22s %-18s %20s %15s\n", "corpus", "case", "time", "throughput");
+    while (fgets(line, sizeof(line), manifest)) {
+        CorpusFile file;
+
+        if (line[0] == '#' || sscanf(line, "%63s %7s %d %31s", file.name, file.kind, &file.devices, file.last_busid) != 4) {
+            continue;
+        }
+        file.data = load_file(file.name, &file.size);
+        if (!file.data) {
+            fprintf(stderr, "FAIL: cannot load %s\n", file.name);
+            failures++;
+            continue;
+        }
+
+        if (strcmp(file.kind, "port") == 0 &&
+            (port_table_parse(&table, file.data) != file.devices || table.truncated)) {
+            fprintf(stderr, "FAIL: %s parsed %d records, expected %d\n", file.name, table.count, file.devices);
+            failures++;
+        }
+        run_file(&file, "");
+        if (strcmp(scan_implementation(), "scalar") != 0) {
+            scan_set_simd(0);
+            run_file(&file, "/scalar");
+            scan_set_simd(1);
+        }
+        free(file.data);
+    }
+    fclose(manifest);
+
+    if (failures) {
+        fprintf(stderr, "%d benchmark check(s) FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,218 @@
+#define _DEFAULT_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+// Largest config file read; the biggest valid file is far smaller
+#define CONFIG_FILE_MAX (CONFIG_MAX_TARGETS * CONFIG_LINE_MAX)
+
+// Settings accepted after a spec, with their unit and lowest value
+static const struct {
+    const char* name;
+    size_t offset;
+    int scale;     // Multiplier to milliseconds, 1 for plain numbers
+    int min;
+    int max;
+} settings[] = {
+    {"interval", offsetof(ConfigTarget, interval_ms), 1000, 1, 86400},
+    {"attached-interval", offsetof(ConfigTarget, attached_ms), 1000, 1, 86400},
+    {"max-backoff", offsetof(ConfigTarget, max_backoff_ms), 1000, 1, 86400},
+    {"fast-retry-delay", offsetof(ConfigTarget, fast_retry_ms), 1, 1, 86400000},
+    {"fast-retries", offsetof(ConfigTarget, fast_retries), 1, 0, 1000},
+    {"jitter", offsetof(ConfigTarget, jitter_percent), 1, 0, 100},
+    {"command-timeout", offsetof(ConfigTarget, command_timeout_ms), 1000, 1, 86400},
+};
+
+// Helper to reset every per-device setting
+static void clear_settings(ConfigTarget* target) {
+    size_t i;
+    for (i = 0; i < sizeof(settings) / sizeof(settings[0]); i++) {
+        *(int*)((char*)target + settings[i].offset) = CONFIG_UNSET;
+    }
+}
+
+int config_parse_spec(const char* spec, ConfigTarget* target) {
+    const char* sep = strrchr(spec, ':');
+    size_t host_len;
+    size_t id_len;
+
+    if (!sep || sep == spec || sep[1] == '\0') {
+        return 0;
+    }
+
+    memset(target, 0, sizeof(*target));
+    clear_settings(target);
+
+    // Allow bracketed IPv6 literals: [fe80::1]:1-2. Lists keep theirs, for config_split_hosts()
+    host_len = (size_t)(sep - spec);
+    if (spec[0] == '[' && sep[-1] == ']' && memchr(spec, ',', host_len) == NULL) {
+        spec++;
+        host_len -= 2;
+    }
+    if (host_len == 0 || host_len >= sizeof(target->host)) {
+        return 0;
+    }
+    memcpy(target->host, spec, host_len);
+    target->host[host_len] = '\0';
+    if (config_split_hosts(target->host, NULL) < 0) {
+        return 0;
+    }
+
+    sep++;
+    target->is_busid = strncmp(sep, "devid=", 6) != 0;
+    if (!target->is_busid) {
+        sep += 6;
+    }
+    id_len = strlen(sep);
+    if (id_len == 0 || id_len >= sizeof(target->identifier)) {
+        return 0;
+    }
+    memcpy(target->identifier, sep, id_len + 1);
+    return 1;
+}
+
+int config_split_hosts(const char* list, char hosts[][CONFIG_HOST_MAX]) {
+    int count = 0;
+
+    for (;;) {
+        size_t len = strcspn(list, ",");
+        const char* host = list;
+
+        if (len >= 2 && host[0] == '[' && host[len - 1] == ']') {
+            host++;
+            len -= 2;
+        }
+        if (len == 0 || count == CONFIG_MAX_HOSTS) {
+            return -1;
+        }
+        if (hosts) {
+            memcpy(hosts[count], host, len);
+            hosts[count][len] = '\0';
+        }
+        count++;
+        list += strcspn(list, ",");
+        if (*list == '\0') {
+            return count;
+        }
+        list++;
+    }
+}
+
+// Helper to apply one "name=value" setting; returns 0 if it isn't valid
+static int apply_setting(ConfigTarget* target, const char* word) {
+    const char* eq = strchr(word, '=');
+    size_t i;
+
+    if (!eq) {
+        return 0;
+    }
+    for (i = 0; i < sizeof(settings) / sizeof(settings[0]); i++) {
+        char* end;
+        long value;
+
+        if (strlen(settings[i].name) != (size_t)(eq - word) || strncmp(word, settings[i].name, (size_t)(eq - word)) != 0) {
+            continue;
+        }
+        errno = 0;
+        value = strtol(eq + 1, &end, 10);
+        if (errno || end == eq + 1 || *end || value < settings[i].min || value > settings[i].max) {
+            return 0;
+        }
+        *(int*)((char*)target + settings[i].offset) = (int)value * settings[i].scale;
+        return 1;
+    }
+    return 0;
+}
+
+// Helper to parse one line, modified in place; returns 0 with error set on failure
+static int parse_line(char* line, int line_no, Config* config, char* error, size_t error_size) {
+    ConfigTarget* target;
+    char* word;
+    char* save;
+
+    word = strtok_r(line, " \t\r", &save);
+    if (!word || word[0] == '#') {
+        return 1;
+    }
+    if (config->count == CONFIG_MAX_TARGETS) {
+        snprintf(error, error_size, "line %d: more than %d devices", line_no, CONFIG_MAX_TARGETS);
+        return 0;
+    }
+    target = &config->targets[config->count];
+    if (!config_parse_spec(word, target)) {
+        snprintf(error, error_size, "line %d: expected <host>:<busid> or <host>:devid=<devid>, got \"%s\"", line_no, word);
+        return 0;
+    }
+    if (config_find(config, target) >= 0) {
+        snprintf(error, error_size, "line %d: %s is listed twice", line_no, word);
+        return 0;
+    }
+    while ((word = strtok_r(NULL, " \t\r", &save)) != NULL && word[0] != '#') {
+        if (!apply_setting(target, word)) {
+            snprintf(error, error_size, "line %d: invalid setting \"%s\"", line_no, word);
+            return 0;
+        }
+    }
+    config->count++;
+    return 1;
+}
+
+int config_parse(const char* text, Config* config, char* error, size_t error_size) {
+    char line[CONFIG_LINE_MAX];
+    int line_no = 0;
+
+    config->count = 0;
+    while (*text) {
+        const char* end = strchr(text, '\n');
+        size_t len = end ? (size_t)(end - text) : strlen(text);
+
+        line_no++;
+        if (len >= sizeof(line)) {
+            snprintf(error, error_size, "line %d: longer than %d bytes", line_no, CONFIG_LINE_MAX - 1);
+            return -1;
+        }
+        memcpy(line, text, len);
+        line[len] = '\0';
+        if (!parse_line(line, line_no, config, error, error_size)) {
+            return -1;
+        }
+        text += end ? len + 1 : len;
+    }
+    return 0;
+}
+
+int config_load(const char* path, Config* config, char* error, size_t error_size) {
+    static char text[CONFIG_FILE_MAX + 1];
+    FILE* f = fopen(path, "r");
+    size_t len;
+
+    if (!f) {
+        snprintf(error, error_size, "cannot open %s: %s", path, strerror(errno));
+        return -1;
+    }
+    len = fread(text, 1, CONFIG_FILE_MAX + 1, f);
+    if (ferror(f) || len > CONFIG_FILE_MAX) {
+        snprintf(error, error_size, "cannot read %s: %s", path, ferror(f) ? strerror(errno) : "file too large");
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    text[len] = '\0';
+    return config_parse(text, config, error, error_size);
+}
+
+int config_find(const Config* config, const ConfigTarget* target) {
+    int i;
+
+    for (i = 0; i < config->count; i++) {
+        const ConfigTarget* other = &config->targets[i];
+        if (other->is_busid == target->is_busid && strcmp(other->identifier, target->identifier) == 0 &&
+            strcmp(other->host, target->host) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
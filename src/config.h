@@ -0,0 +1,113 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Devices a config file may list */
+#define CONFIG_MAX_TARGETS 256
+/* Longest host name or address, terminator included; also the longest list of hosts */
+#define CONFIG_HOST_MAX 256
+/* Hosts that may export one device, e.g. "10.0.0.1,10.0.0.2:1-2" */
+#define CONFIG_MAX_HOSTS 8
+/* Longest busid or devid, terminator included */
+#define CONFIG_ID_MAX 64
+/* Longest line of a config file */
+#define CONFIG_LINE_MAX 1024
+
+/* Per-device setting left out of the file; the command line value applies */
+#define CONFIG_UNSET -1
+
+/* One device from a config file or a <host>:<busid> spec */
+typedef struct {
+    char host[CONFIG_HOST_MAX];     /* One host, or several separated by commas */
+    char identifier[CONFIG_ID_MAX]; /* Bus ID or device ID */
+    int is_busid;                   /* 1 if identifier is a bus ID */
+    /* Schedule and deadline, CONFIG_UNSET if not given */
+    int interval_ms;
+    int attached_ms;
+    int max_backoff_ms;
+    int fast_retry_ms;
+    int fast_retries;
+    int jitter_percent;
+    int command_timeout_ms;
+} ConfigTarget;
+
+/* Every device of a config file, in file order */
+typedef struct {
+    ConfigTarget targets[CONFIG_MAX_TARGETS];
+    int count;
+} Config;
+
+/**
+ * @brief Parses a "<host>:<busid>" or "<host>:devid=<devid>" spec.
+ *
+ * IPv6 literals may be bracketed, e.g. "[fe80::1]:1-2". The host may be a
+ * comma-separated list of up to CONFIG_MAX_HOSTS hosts exporting the same
+ * device, e.g. "10.0.0.1,10.0.0.2:1-2", kept as written; see
+ * config_split_hosts(). Every per-device setting is left at CONFIG_UNSET.
+ *
+ * @param spec Spec to parse.
+ * @param target Device receiving the host and identifier.
+ * @return 1 on success, 0 if the spec is malformed or a part is too long.
+ */
+int config_parse_spec(const char* spec, ConfigTarget* target);
+
+/**
+ * @brief Splits the host of a device into its hosts.
+ *
+ * Brackets around IPv6 literals are dropped, e.g. "[fe80::1],10.0.0.2"
+ * gives "fe80::1" and "10.0.0.2".
+ *
+ * @param list Host of a ConfigTarget: one host, or several separated by commas.
+ * @param hosts Receives the hosts in list order; may be NULL to only count them.
+ * @return Number of hosts, or -1 if one is empty or there are more than CONFIG_MAX_HOSTS.
+ */
+int config_split_hosts(const char* list, char hosts[][CONFIG_HOST_MAX]);
+
+/**
+ * @brief Parses the text of a config file.
+ *
+ * One device per line: a spec followed by optional settings, e.g.
+ * "10.0.0.1:1-2 interval=10 max-backoff=600 command-timeout=20". Settings
+ * take the units of the command line options of the same name: interval,
+ * attached-interval, max-backoff and command-timeout in seconds,
+ * fast-retry-delay in milliseconds, fast-retries as a count and jitter as a
+ * percentage. Blank lines and lines starting with '#' are ignored.
+ *
+ * @param text Contents of the file.
+ * @param config Receives the devices; left partly filled on error.
+ * @param error Receives a message naming the offending line on error.
+ * @param error_size Size of error.
+ * @return 0 on success, -1 on error.
+ */
+int config_parse(const char* text, Config* config, char* error, size_t error_size);
+
+/**
+ * @brief Reads and parses a config file.
+ *
+ * @param path Path of the file.
+ * @param config Receives the devices; left partly filled on error.
+ * @param error Receives a message on error.
+ * @param error_size Size of error.
+ * @return 0 on success, -1 on error.
+ */
+int config_load(const char* path, Config* config, char* error, size_t error_size);
+
+/**
+ * @brief Finds a device with the same host and identifier.
+ *
+ * @param config Devices to search.
+ * @param target Device to look for; only its host, identifier and is_busid are compared.
+ * @return Index in config->targets, or -1 if absent.
+ */
+int config_find(const Config* config, const ConfigTarget* target);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CONFIG_H
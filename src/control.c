@@ -0,0 +1,204 @@
+#define _GNU_SOURCE
+#include "control.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+// How long a client may take to send its request line
+#define CONTROL_REQUEST_WAIT_MS 1000
+// Send timeout for a client that doesn't read its reply
+#define CONTROL_SEND_TIMEOUT_MS 1000
+
+// Reply text; the monitor serves one client at a time
+static char reply_text[CONTROL_REPLY_MAX];
+
+void control_init(ControlSocket* control) {
+    control->listen_fd = -1;
+    control->socket_path[0] = '\0';
+}
+
+int control_listen(ControlSocket* control, const char* path) {
+    struct sockaddr_un addr;
+    mode_t old_mask;
+    int bound;
+    int fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    unlink(path); // Left behind by a previous run
+    // Mask the group and other bits while binding so the socket never exists with wider access
+    old_mask = umask(S_IXUSR | S_IRWXG | S_IRWXO);
+    bound = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(old_mask);
+    if (bound < 0 || listen(fd, 8) < 0) {
+        int saved = errno;
+        close(fd);
+        unlink(path);
+        errno = saved;
+        return -1;
+    }
+    control->listen_fd = fd;
+    snprintf(control->socket_path, sizeof(control->socket_path), "%s", path);
+    return 0;
+}
+
+void control_printf(ControlReply* reply, const char* fmt, ...) {
+    va_list ap;
+    size_t room = reply->size - reply->len;
+    int n;
+
+    if (room <= 1) {
+        return;
+    }
+    va_start(ap, fmt);
+    n = vsnprintf(reply->buf + reply->len, room, fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        reply->len += (size_t)n < room ? (size_t)n : room - 1;
+    }
+}
+
+// Helper to read one request line; returns its length, -1 if none came in
+// time, or -2 if it doesn't fit
+static int read_request(int fd, char* line, size_t size) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    size_t len = 0;
+
+    while (len < size - 1) {
+        ssize_t n;
+
+        if (poll(&pfd, 1, CONTROL_REQUEST_WAIT_MS) <= 0) {
+            break;
+        }
+        n = recv(fd, line + len, size - 1 - len, MSG_DONTWAIT);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+            continue;
+        }
+        if (n <= 0) {
+            break; // Client done sending; a last line without newline still counts
+        }
+        len += (size_t)n;
+        line[len] = '\0';
+        if (memchr(line + len - (size_t)n, '\n', (size_t)n)) {
+            break;
+        }
+    }
+    line[len] = '\0';
+    if (len == size - 1 && !strchr(line, '\n')) {
+        return -2;
+    }
+    return len > 0 ? (int)len : -1;
+}
+
+// Helper to send the whole reply; the client gets what fits before the timeout
+static void send_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+}
+
+// Helper to answer one client
+static void answer(int fd, control_handler_fn handler, void* ctx) {
+    struct timeval send_timeout = {0, CONTROL_SEND_TIMEOUT_MS * 1000};
+    char line[CONTROL_REQUEST_MAX];
+    ControlReply reply = {reply_text, sizeof(reply_text), 0};
+    char* command;
+    char* argument;
+    char* end;
+
+    int len = read_request(fd, line, sizeof(line));
+
+    reply_text[0] = '\0';
+    if (len == -1) {
+        return;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+    if (len == -2) {
+        send_all(fd, "error: request too long\n", 24);
+        return;
+    }
+
+    // Only the first line is a request
+    end = strchr(line, '\n');
+    if (end) {
+        *end = '\0';
+    }
+    command = line;
+    while (isspace((unsigned char)*command)) {
+        command++;
+    }
+    argument = command;
+    while (*argument && !isspace((unsigned char)*argument)) {
+        argument++;
+    }
+    if (*argument) {
+        *argument++ = '\0';
+    }
+    while (isspace((unsigned char)*argument)) {
+        argument++;
+    }
+    end = argument + strlen(argument);
+    while (end > argument && isspace((unsigned char)end[-1])) {
+        *--end = '\0';
+    }
+
+    handler(command, argument, &reply, ctx);
+    send_all(fd, reply.buf, reply.len);
+}
+
+int control_serve(ControlSocket* control, control_handler_fn handler, void* ctx) {
+    int answered = 0;
+
+    if (control->listen_fd < 0) {
+        return 0;
+    }
+    // Clients are answered one by one, so a stream of them mustn't hold up the
+    // caller's loop; the rest stay queued and keep the socket readable
+    while (answered < CONTROL_MAX_CLIENTS_PER_SERVE) {
+        int fd = accept4(control->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break; // EAGAIN: nobody else waiting
+        }
+        answer(fd, handler, ctx);
+        close(fd);
+        answered++;
+    }
+    return answered;
+}
+
+void control_close(ControlSocket* control) {
+    if (control->listen_fd >= 0) {
+        close(control->listen_fd);
+        unlink(control->socket_path);
+        control->listen_fd = -1;
+    }
+}
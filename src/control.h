@@ -0,0 +1,95 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Longest request line; longer requests are refused */
+#define CONTROL_REQUEST_MAX 512
+/* Room for one reply, enough for a status line per device */
+#define CONTROL_REPLY_MAX 65536
+/* Clients answered per control_serve() call */
+#define CONTROL_MAX_CLIENTS_PER_SERVE 4
+
+/* Reply being built by a command handler */
+typedef struct {
+    char* buf;
+    size_t size;
+    size_t len;        /* Bytes written, capped at size - 1 */
+} ControlReply;
+
+/*
+ * Handles one request, e.g. "add 10.0.0.1:1-2". command is the first word of
+ * the line and argument the rest with surrounding blanks removed, "" if none.
+ */
+typedef void (*control_handler_fn)(const char* command, const char* argument, ControlReply* reply, void* ctx);
+
+/* Listening control socket */
+typedef struct {
+    int listen_fd;     /* -1 if not listening */
+    char socket_path[108];
+} ControlSocket;
+
+/**
+ * @brief Initializes a control socket that isn't listening yet.
+ *
+ * @param control Control socket to initialize.
+ */
+void control_init(ControlSocket* control);
+
+/**
+ * @brief Listens for operator requests on a Unix stream socket.
+ *
+ * A stale socket file at path is replaced. The socket file is made
+ * accessible to its owner only, since requests change what is attached. The
+ * socket is non-blocking; wait for connections with events_watch_listener()
+ * and answer them with control_serve().
+ *
+ * @param control Control socket to set up.
+ * @param path Filesystem path of the socket.
+ * @return 0 on success, -1 on failure (errno set).
+ */
+int control_listen(ControlSocket* control, const char* path);
+
+/**
+ * @brief Answers pending clients on the listening socket.
+ *
+ * Each client sends one request line, e.g. with
+ * `echo status | socat - UNIX-CONNECT:<path>`, gets the reply built by the
+ * handler and is disconnected. A client gets a short grace period to send
+ * its line; one that sends nothing is dropped. At most
+ * CONTROL_MAX_CLIENTS_PER_SERVE clients are answered per call; any others
+ * stay queued for the next one.
+ *
+ * @param control Listening control socket.
+ * @param handler Function building the reply to each request.
+ * @param ctx Passed through to handler.
+ * @return Number of clients answered.
+ */
+int control_serve(ControlSocket* control, control_handler_fn handler, void* ctx);
+
+/**
+ * @brief Appends formatted text to a reply.
+ *
+ * Text beyond the reply's room is dropped.
+ *
+ * @param reply Reply to append to.
+ * @param fmt printf-style format.
+ */
+void control_printf(ControlReply* reply, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Closes the listening socket and removes its file.
+ *
+ * @param control Control socket to close.
+ */
+void control_close(ControlSocket* control);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CONTROL_H
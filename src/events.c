@@ -0,0 +1,311 @@
+#define _GNU_SOURCE
+#include "events.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/inotify.h>
+#include <linux/netlink.h>
+
+// Large enough for a single uevent message or a batch of inotify events
+#define EVENTS_BUF_SIZE 4096
+
+// Helper returning CLOCK_MONOTONIC in milliseconds
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Helper to open a kernel uevent socket, returns fd or -1
+static int open_uevent_socket(void) {
+    struct sockaddr_nl addr;
+    int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+
+    if (fd < 0) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = 1; // Kernel events, not the udev rebroadcast
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Helper to (re)establish the watch on the record directory once it exists
+static void watch_record_dir(EventWatcher* watcher) {
+    if (watcher->inotify_fd < 0 || watcher->record_wd >= 0 || watcher->record_dir[0] == '\0') {
+        return;
+    }
+    watcher->record_wd = inotify_add_watch(watcher->inotify_fd, watcher->record_dir,
+                                           IN_CREATE | IN_DELETE | IN_CLOSE_WRITE |
+                                           IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF);
+}
+
+int events_parse_uevent(const char* msg, size_t len, UeventInfo* info) {
+    const char* end = msg + len;
+    const char* action = NULL;
+    const char* devpath = NULL;
+    const char* subsystem = NULL;
+    const char* devtype = NULL;
+    const char* busid;
+    const char* p;
+
+    // The header is "<action>@<devpath>"; udev's rebroadcasts start with "libudev" instead
+    if (!memchr(msg, '@', strnlen(msg, len))) {
+        return 0;
+    }
+    for (p = msg + strlen(msg) + 1; p < end; p += strlen(p) + 1) {
+        if (strncmp(p, "ACTION=", 7) == 0) {
+            action = p + 7;
+        } else if (strncmp(p, "DEVPATH=", 8) == 0) {
+            devpath = p + 8;
+        } else if (strncmp(p, "SUBSYSTEM=", 10) == 0) {
+            subsystem = p + 10;
+        } else if (strncmp(p, "DEVTYPE=", 8) == 0) {
+            devtype = p + 8;
+        }
+    }
+    if (!action || !devpath || !subsystem || !devtype ||
+        strcmp(subsystem, "usb") != 0 || strcmp(devtype, "usb_device") != 0 || !strstr(devpath, "/vhci_hcd.")) {
+        return 0;
+    }
+    if (strcmp(action, "add") == 0) {
+        info->action = EVENTS_UEVENT_ADD;
+    } else if (strcmp(action, "remove") == 0) {
+        info->action = EVENTS_UEVENT_REMOVE;
+    } else {
+        return 0;
+    }
+
+    // e.g. /devices/platform/vhci_hcd.0/usb3/3-1 is local busid 3-1
+    busid = strrchr(devpath, '/') + 1;
+    if (strlen(busid) >= sizeof(info->busid)) {
+        return 0;
+    }
+    strcpy(info->busid, busid);
+    return 1;
+}
+
+// Helper to drain pending uevents, returns 1 if any vhci_hcd USB device came or went
+static int drain_uevents(EventWatcher* watcher) {
+    char buf[EVENTS_BUF_SIZE];
+    UeventInfo info;
+    int relevant = 0;
+    ssize_t n;
+
+    for (;;) {
+        n = recv(watcher->uevent_fd, buf, sizeof(buf) - 1, MSG_DONTWAIT);
+        if (n < 0 && errno == ENOBUFS) {
+            // The socket buffer overflowed and uevents were lost; any device may be gone
+            relevant = 1;
+            watcher->removed_overflow = 1;
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        buf[n] = '\0';
+        if (!events_parse_uevent(buf, (size_t)n, &info)) {
+            continue;
+        }
+        relevant = 1;
+        if (info.action != EVENTS_UEVENT_REMOVE) {
+            continue;
+        }
+        if (watcher->removed_count < EVENTS_MAX_REMOVED) {
+            strcpy(watcher->removed[watcher->removed_count++], info.busid);
+        } else {
+            watcher->removed_overflow = 1;
+        }
+    }
+    return relevant;
+}
+
+// Helper to drain inotify events, returns 1 if the record directory changed
+static int drain_inotify(EventWatcher* watcher) {
+    char buf[EVENTS_BUF_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int changed = 0;
+    ssize_t n;
+
+    while ((n = read(watcher->inotify_fd, buf, sizeof(buf))) > 0) {
+        char* p = buf;
+        while (p < buf + n) {
+            struct inotify_event* ev = (struct inotify_event*)p;
+            if (ev->mask & IN_IGNORED) {
+                // Directory removed, re-add the watch once it's back
+                watcher->record_wd = -1;
+            }
+            changed = 1;
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    return changed;
+}
+
+void events_init_disabled(EventWatcher* watcher) {
+    int i;
+    watcher->uevent_fd = -1;
+    watcher->inotify_fd = -1;
+    watcher->record_wd = -1;
+    for (i = 0; i < EVENTS_MAX_SOCKETS; i++) {
+        watcher->socket_fds[i] = -1;
+    }
+    for (i = 0; i < EVENTS_MAX_LISTENERS; i++) {
+        watcher->listener_fds[i] = -1;
+    }
+    watcher->record_dir[0] = '\0';
+    watcher->removed_count = 0;
+    watcher->removed_overflow = 0;
+}
+
+void events_open(EventWatcher* watcher, const char* record_dir) {
+    events_init_disabled(watcher);
+    watcher->uevent_fd = open_uevent_socket();
+    if (record_dir) {
+        snprintf(watcher->record_dir, sizeof(watcher->record_dir), "%s", record_dir);
+        watcher->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        watch_record_dir(watcher);
+    }
+}
+
+void events_use_uevent_fd(EventWatcher* watcher, int fd) {
+    if (watcher->uevent_fd >= 0 && watcher->uevent_fd != fd) {
+        close(watcher->uevent_fd);
+    }
+    watcher->uevent_fd = fd;
+}
+
+void events_watch_socket(EventWatcher* watcher, int slot, int fd) {
+    if (slot < 0 || slot >= EVENTS_MAX_SOCKETS) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+    if (watcher->socket_fds[slot] >= 0 && watcher->socket_fds[slot] != fd) {
+        close(watcher->socket_fds[slot]);
+    }
+    watcher->socket_fds[slot] = fd;
+}
+
+void events_watch_listener(EventWatcher* watcher, int slot, int fd) {
+    if (slot >= 0 && slot < EVENTS_MAX_LISTENERS) {
+        watcher->listener_fds[slot] = fd;
+    }
+}
+
+int events_can_detect(const EventWatcher* watcher) {
+    int i;
+    if (watcher->uevent_fd >= 0 || (watcher->inotify_fd >= 0 && watcher->record_dir[0] != '\0')) {
+        return 1;
+    }
+    for (i = 0; i < EVENTS_MAX_SOCKETS; i++) {
+        if (watcher->socket_fds[i] >= 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int events_wait(EventWatcher* watcher, int timeout_ms) {
+    long long deadline = timeout_ms >= 0 ? now_ms() + timeout_ms : -1;
+
+    watcher->removed_count = 0;
+    watcher->removed_overflow = 0;
+    for (;;) {
+        struct pollfd fds[2 + EVENTS_MAX_SOCKETS + EVENTS_MAX_LISTENERS];
+        int slots[2 + EVENTS_MAX_SOCKETS + EVENTS_MAX_LISTENERS];
+        int nfds = 0;
+        int uevent_idx = -1, inotify_idx = -1, socket_start, listener_start;
+        int remaining = -1;
+        int reasons = 0;
+        int ret, i;
+
+        watch_record_dir(watcher);
+
+        if (watcher->uevent_fd >= 0) {
+            uevent_idx = nfds;
+            fds[nfds].fd = watcher->uevent_fd;
+            fds[nfds++].events = POLLIN;
+        }
+        if (watcher->inotify_fd >= 0) {
+            inotify_idx = nfds;
+            fds[nfds].fd = watcher->inotify_fd;
+            fds[nfds++].events = POLLIN;
+        }
+        // The kernel owns the data streams; only look for shutdown
+        socket_start = nfds;
+        for (i = 0; i < EVENTS_MAX_SOCKETS; i++) {
+            if (watcher->socket_fds[i] >= 0) {
+                slots[nfds] = i;
+                fds[nfds].fd = watcher->socket_fds[i];
+                fds[nfds++].events = POLLRDHUP;
+            }
+        }
+        listener_start = nfds;
+        for (i = 0; i < EVENTS_MAX_LISTENERS; i++) {
+            if (watcher->listener_fds[i] >= 0) {
+                fds[nfds].fd = watcher->listener_fds[i];
+                fds[nfds++].events = POLLIN;
+            }
+        }
+
+        if (deadline >= 0) {
+            long long left = deadline - now_ms();
+            remaining = left > 0 ? (int)left : 0;
+        }
+
+        ret = poll(fds, (nfds_t)nfds, remaining);
+        if (ret < 0) {
+            // EINTR: let the caller look at its signal flags
+            return 0;
+        }
+        if (ret == 0) {
+            return 0;
+        }
+
+        if (uevent_idx >= 0 && (fds[uevent_idx].revents & POLLIN) && drain_uevents(watcher)) {
+            reasons |= EVENT_UEVENT;
+        }
+        if (inotify_idx >= 0 && (fds[inotify_idx].revents & POLLIN) && drain_inotify(watcher)) {
+            reasons |= EVENT_RECORD_CHANGED;
+        }
+        for (i = socket_start; i < listener_start; i++) {
+            if (fds[i].revents) {
+                events_watch_socket(watcher, slots[i], -1);
+                reasons |= EVENT_SOCKET_CLOSED;
+            }
+        }
+        for (i = listener_start; i < nfds; i++) {
+            if (fds[i].revents) {
+                reasons |= EVENT_LISTENER;
+            }
+        }
+
+        if (reasons) {
+            return reasons;
+        }
+        // Only unrelated uevents arrived, keep waiting for the rest of the timeout
+    }
+}
+
+void events_close(EventWatcher* watcher) {
+    int i;
+    if (watcher->uevent_fd >= 0) {
+        close(watcher->uevent_fd);
+    }
+    if (watcher->inotify_fd >= 0) {
+        close(watcher->inotify_fd);
+    }
+    for (i = 0; i < EVENTS_MAX_SOCKETS; i++) {
+        events_watch_socket(watcher, i, -1);
+    }
+    events_init_disabled(watcher);
+}
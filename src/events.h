@@ -0,0 +1,152 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Reasons returned by events_wait(), combined as a bitmask */
+#define EVENT_UEVENT         0x01  /* Kernel uevent for a vhci_hcd device */
+#define EVENT_RECORD_CHANGED 0x02  /* Port record created or removed */
+#define EVENT_SOCKET_CLOSED  0x04  /* Imported connection was shut down */
+#define EVENT_LISTENER       0x08  /* A local client is connecting to a listening socket */
+
+/* Number of imported connections that can be watched at once */
+#define EVENTS_MAX_SOCKETS 256
+/* Number of local listening sockets (metrics, control) that can be watched */
+#define EVENTS_MAX_LISTENERS 4
+/* Device removals remembered from one events_wait(); more set removed_overflow */
+#define EVENTS_MAX_REMOVED 16
+/* Longest local busid kept from a uevent, terminator included */
+#define EVENTS_BUSID_MAX 32
+
+/* Actions of a vhci_hcd USB device uevent */
+#define EVENTS_UEVENT_ADD    1
+#define EVENTS_UEVENT_REMOVE 2
+
+/* What a uevent says about a virtual USB device */
+typedef struct {
+    int action;                    /* EVENTS_UEVENT_ADD or EVENTS_UEVENT_REMOVE */
+    char busid[EVENTS_BUSID_MAX];  /* Local busid, e.g. "3-1" for .../vhci_hcd.0/usb3/3-1 */
+} UeventInfo;
+
+/* Kernel notification sources waited on instead of sleeping */
+typedef struct {
+    int uevent_fd;     /* NETLINK_KOBJECT_UEVENT socket, -1 if unavailable */
+    int inotify_fd;    /* inotify instance, -1 if unavailable */
+    int record_wd;     /* Watch on the port record directory, -1 until it exists */
+    int socket_fds[EVENTS_MAX_SOCKETS]; /* Imported device connections, -1 if none */
+    int listener_fds[EVENTS_MAX_LISTENERS]; /* Listening sockets, owned by the caller, -1 if none */
+    char record_dir[256];
+    /* Local busids of the vhci_hcd devices removed during the last events_wait() */
+    char removed[EVENTS_MAX_REMOVED][EVENTS_BUSID_MAX];
+    int removed_count;
+    int removed_overflow;  /* 1 if more were removed than fit; any device may be gone */
+} EventWatcher;
+
+/**
+ * @brief Opens the kernel notification sources.
+ *
+ * Sources that can't be opened are left disabled; events_wait() then relies
+ * on the remaining ones and its timeout.
+ *
+ * @param watcher Watcher to initialize.
+ * @param record_dir Directory holding the vhci_hcd port records, or NULL to skip inotify.
+ */
+void events_open(EventWatcher* watcher, const char* record_dir);
+
+/**
+ * @brief Replaces the kernel uevent socket with another source.
+ *
+ * Lets tests feed recorded uevents through one end of a datagram socketpair.
+ * Takes ownership of fd, closing the socket it replaces.
+ *
+ * @param watcher Watcher to update.
+ * @param fd Socket delivering one uevent per datagram, or -1 to stop watching uevents.
+ */
+void events_use_uevent_fd(EventWatcher* watcher, int fd);
+
+/**
+ * @brief Parses a kernel uevent, keeping only USB devices on vhci_hcd.
+ *
+ * A kernel message is "<action>@<devpath>" followed by NUL-separated
+ * KEY=value pairs. Only add and remove events of SUBSYSTEM=usb,
+ * DEVTYPE=usb_device under a vhci_hcd platform device are kept; interfaces,
+ * other controllers and udev rebroadcasts are not.
+ *
+ * @param msg Message as received; msg[len] must be a NUL.
+ * @param len Length of the message.
+ * @param info Receives the action and local busid.
+ * @return 1 if the event is a vhci_hcd USB device coming or going, 0 otherwise.
+ */
+int events_parse_uevent(const char* msg, size_t len, UeventInfo* info);
+
+/**
+ * @brief Initializes a watcher with every source disabled (plain timed waits).
+ *
+ * @param watcher Watcher to initialize.
+ */
+void events_init_disabled(EventWatcher* watcher);
+
+/**
+ * @brief Watches the socket of an in-process attach for shutdown.
+ *
+ * Takes ownership of fd, replacing (and closing) any socket previously watched
+ * in the same slot. Only hang-up conditions are polled, the kernel owns the
+ * data stream.
+ *
+ * @param watcher Watcher to update.
+ * @param slot Slot to use, one per monitored device (0 to EVENTS_MAX_SOCKETS - 1).
+ * @param fd Socket handed to vhci_hcd, or -1 to stop watching.
+ */
+void events_watch_socket(EventWatcher* watcher, int slot, int fd);
+
+/**
+ * @brief Wakes events_wait() when a client connects to a listening socket.
+ *
+ * The caller keeps ownership of fd and accepts the connection itself after
+ * events_wait() reports EVENT_LISTENER.
+ *
+ * @param watcher Watcher to update.
+ * @param slot Slot to use (0 to EVENTS_MAX_LISTENERS - 1).
+ * @param fd Listening socket, or -1 to stop watching.
+ */
+void events_watch_listener(EventWatcher* watcher, int slot, int fd);
+
+/**
+ * @brief Checks whether a detach can be noticed without polling.
+ *
+ * @param watcher Watcher to query.
+ * @return 1 if at least one notification source is active, 0 otherwise.
+ */
+int events_can_detect(const EventWatcher* watcher);
+
+/**
+ * @brief Waits until the attachment state may have changed, a client connects
+ * to a watched listener, or the timeout expires.
+ *
+ * Unrelated uevents are drained and ignored without returning. The local
+ * busids of vhci_hcd devices removed meanwhile are left in removed, so the
+ * caller can tell which of its devices went away. A signal interrupts the
+ * wait, so callers can check their shutdown flag promptly.
+ *
+ * @param watcher Watcher to wait on.
+ * @param timeout_ms Maximum time to wait in milliseconds, or -1 to wait indefinitely.
+ * @return Bitmask of EVENT_* reasons, 0 on timeout or signal.
+ */
+int events_wait(EventWatcher* watcher, int timeout_ms);
+
+/**
+ * @brief Closes every notification source, including the watched socket.
+ *
+ * @param watcher Watcher to close.
+ */
+void events_close(EventWatcher* watcher);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // EVENTS_H
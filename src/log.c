@@ -0,0 +1,195 @@
+#define _DEFAULT_SOURCE
+#include "log.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+// Worst case growth of a message once escaped for JSON (\u00XX per byte)
+#define JSON_ESCAPE_FACTOR 6
+// Room for the timestamp, level and JSON punctuation around a message
+#define LINE_OVERHEAD 96
+
+static int current_level = LOG_LEVEL_INFO;
+static int current_format = LOG_FORMAT_TEXT;
+static int out_fd = STDERR_FILENO;
+
+// Serializes writers; attach workers log from their own threads
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Lines waiting for the next flush
+static char buffer[LOG_BUFFER_SIZE];
+static size_t used;
+// Scratch space for formatting one message
+static char message[LOG_MESSAGE_MAX];
+
+// Formatted date and time of cached_second, reused until the second changes
+static time_t cached_second = (time_t)-1;
+static char cached_stamp[40];
+static char cached_offset[8];
+
+static const char* const level_names[] = {"error", "warn", "info", "debug"};
+
+void log_init(int level, int format, int fd) {
+    static int registered = 0;
+
+    pthread_mutex_lock(&log_lock);
+    current_level = level;
+    current_format = format;
+    out_fd = fd;
+    cached_second = (time_t)-1; // The stamp layout depends on the format
+    pthread_mutex_unlock(&log_lock);
+    if (!registered) {
+        atexit(log_flush);
+        registered = 1;
+    }
+}
+
+int log_level_from_name(const char* name) {
+    int i;
+    for (i = 0; i <= LOG_LEVEL_DEBUG; i++) {
+        if (strcmp(name, level_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int log_enabled(int level) {
+    return level <= current_level;
+}
+
+// Helper behind log_flush(), called with log_lock held
+static void flush_locked(void) {
+    size_t done = 0;
+
+    while (done < used) {
+        ssize_t n = write(out_fd, buffer + done, used - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break; // Nowhere to log to; drop the batch rather than stall the loop
+        }
+        done += (size_t)n;
+    }
+    used = 0;
+}
+
+void log_flush(void) {
+    pthread_mutex_lock(&log_lock);
+    flush_locked();
+    pthread_mutex_unlock(&log_lock);
+}
+
+// Helper to refresh the cached date and time when the second changes
+static void update_stamp(time_t second) {
+    struct tm tm_info;
+    char offset[8];
+
+    if (second == cached_second) {
+        return;
+    }
+    localtime_r(&second, &tm_info);
+    if (current_format == LOG_FORMAT_JSON) {
+        strftime(cached_stamp, sizeof(cached_stamp), "%Y-%m-%dT%H:%M:%S", &tm_info);
+        // RFC 3339 wants +hh:mm where strftime gives +hhmm
+        strftime(offset, sizeof(offset), "%z", &tm_info);
+        snprintf(cached_offset, sizeof(cached_offset), "%.3s:%.2s", offset, offset + 3);
+    } else {
+        strftime(cached_stamp, sizeof(cached_stamp), "%Y-%m-%d %H:%M:%S", &tm_info);
+    }
+    cached_second = second;
+}
+
+// Helper to append bytes that are known to fit
+static void append(const char* data, size_t len) {
+    memcpy(buffer + used, data, len);
+    used += len;
+}
+
+// Helper to append a message as the body of a JSON string
+static void append_json_string(const char* text, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)text[i];
+
+        if (c == '"' || c == '\\') {
+            buffer[used++] = '\\';
+            buffer[used++] = (char)c;
+        } else if (c == '\n') {
+            append("\\n", 2);
+        } else if (c == '\t') {
+            append("\\t", 2);
+        } else if (c < 0x20) {
+            append("\\u00", 4);
+            buffer[used++] = hex[c >> 4];
+            buffer[used++] = hex[c & 0x0f];
+        } else {
+            buffer[used++] = (char)c;
+        }
+    }
+}
+
+void log_write(int level, const char* fmt, ...) {
+    struct timespec now;
+    va_list ap;
+    size_t worst;
+    size_t len;
+    int n;
+
+    if (level > current_level) {
+        return;
+    }
+
+    pthread_mutex_lock(&log_lock);
+    va_start(ap, fmt);
+    n = vsnprintf(message, sizeof(message), fmt, ap);
+    va_end(ap);
+    if (n < 0) {
+        pthread_mutex_unlock(&log_lock);
+        return;
+    }
+    len = (size_t)n;
+    if (len >= sizeof(message)) {
+        len = sizeof(message) - 1;
+        memcpy(message + len - 3, "...", 3);
+    }
+    while (len > 0 && message[len - 1] == '\n') {
+        len--;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    update_stamp(now.tv_sec);
+
+    worst = (current_format == LOG_FORMAT_JSON ? len * JSON_ESCAPE_FACTOR : len) + LINE_OVERHEAD;
+    if (LOG_BUFFER_SIZE - used < worst) {
+        flush_locked();
+    }
+
+    if (current_format == LOG_FORMAT_JSON) {
+        char head[LINE_OVERHEAD];
+        int head_len = snprintf(head, sizeof(head), "{\"time\":\"%s.%03ld%s\",\"level\":\"%s\",\"msg\":\"",
+                                cached_stamp, now.tv_nsec / 1000000, cached_offset, level_names[level]);
+        append(head, (size_t)head_len);
+        append_json_string(message, len);
+        append("\"}\n", 3);
+    } else {
+        append(cached_stamp, strlen(cached_stamp));
+        append(" ", 1);
+        append(message, len);
+        append("\n", 1);
+    }
+
+    // Problems shouldn't wait for the end of the cycle
+    if (level <= LOG_LEVEL_WARN) {
+        flush_locked();
+    }
+    pthread_mutex_unlock(&log_lock);
+}
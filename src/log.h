@@ -0,0 +1,82 @@
+#ifndef LOG_H
+#define LOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Message levels; a message is emitted if its level is at or below the configured one */
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_WARN  1
+#define LOG_LEVEL_INFO  2
+#define LOG_LEVEL_DEBUG 3  /* What --verbose used to print */
+
+/* Output formats */
+#define LOG_FORMAT_TEXT 0  /* "YYYY-MM-DD HH:MM:SS message" */
+#define LOG_FORMAT_JSON 1  /* One {"time","level","msg"} object per line */
+
+/* Bytes of formatted lines held before they are written out in one batch */
+#define LOG_BUFFER_SIZE 65536
+/* Longest message kept; longer ones (e.g. command output) are cut with "..." */
+#define LOG_MESSAGE_MAX 4096
+
+/**
+ * @brief Sets the level, format and destination of the log.
+ *
+ * Until this is called, messages up to LOG_LEVEL_INFO go to stderr as text.
+ *
+ * @param level Most verbose level to emit.
+ * @param format LOG_FORMAT_TEXT or LOG_FORMAT_JSON.
+ * @param fd File descriptor to write to, usually STDERR_FILENO.
+ */
+void log_init(int level, int format, int fd);
+
+/**
+ * @brief Parses a level name: error, warn, info or debug.
+ *
+ * @param name Level name.
+ * @return LOG_LEVEL_* value, or -1 if the name is unknown.
+ */
+int log_level_from_name(const char* name);
+
+/**
+ * @brief Checks whether messages of a level are emitted.
+ *
+ * Lets callers skip building expensive messages that would be dropped.
+ *
+ * @param level LOG_LEVEL_* value.
+ * @return 1 if messages of this level are emitted, 0 otherwise.
+ */
+int log_enabled(int level);
+
+/**
+ * @brief Formats a message and queues it for output.
+ *
+ * Nothing is formatted, not even the timestamp, unless the level is enabled.
+ * The line is appended to the batch buffer; errors and warnings, and a full
+ * buffer, write the batch out at once. A trailing newline in fmt is ignored.
+ * Safe to call from several threads.
+ *
+ * @param level LOG_LEVEL_* value.
+ * @param fmt printf-style format of the message.
+ */
+void log_write(int level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Writes out every queued line.
+ *
+ * Called before the monitor goes to sleep and at exit, so lines are written
+ * in one batch per cycle rather than one write per message.
+ */
+void log_flush(void);
+
+#define log_error(...) log_write(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define log_warn(...)  log_write(LOG_LEVEL_WARN, __VA_ARGS__)
+#define log_info(...)  log_write(LOG_LEVEL_INFO, __VA_ARGS__)
+#define log_debug(...) log_write(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LOG_H
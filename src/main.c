@@ -1,3 +1,4 @@
+#define _DEFAULT_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,47 +11,132 @@
 #include <time.h>
 #include <ctype.h>
 
-/* Manual declaration of functions that might be missing from headers */
-extern FILE *popen(const char *command, const char *type);
-extern int pclose(FILE *stream);
-extern char *strdup(const char *s);
-
-/* Let's use a simpler approach and change the code to use signal() instead of sigaction() */
-
 #include "version.h"
 #include "parser.h" 
+#include "vhci.h"
+#include "usbip_net.h"
+#include "events.h"
+#include "runner.h"
+#include "scheduler.h"
+#include "metrics.h"
+#include "log.h"
+#include "session.h"
+#include "pool.h"
+#include "control.h"
+#include "config.h"
+#include "port_cache.h"
+#include "resolver.h"
+#include "settle.h"
 
-/* Max command length */
-#define MAX_CMD_LEN 4096
-/* Max command output buffer */
-#define MAX_OUTPUT_LEN 16384  
 /* Max path length */
 #define MAX_PATH_LEN 256
-/* Buffer size for reading command output */
-#define READ_BUFFER_SIZE 128
+/* Default deadline for one usbip command, so a hung `usbip list` can't stall the loop */
+#define DEFAULT_COMMAND_TIMEOUT 30
+/* Default deadline for one native connect or request/reply exchange */
+#define DEFAULT_NETWORK_TIMEOUT 10
+/* Default seconds before the first retry of an unavailable device */
+#define DEFAULT_INTERVAL (SCHEDULER_DEFAULT_INTERVAL_MS / 1000)
+/* Max devices supervised by one process, each host getting a session */
+#define MAX_TARGETS EVENTS_MAX_SOCKETS
+#if MAX_TARGETS > SESSION_MAX_HOSTS || MAX_TARGETS > POOL_MAX_JOBS || MAX_TARGETS > METRICS_MAX_TARGETS
+#error "Every target needs room for a host session, an attach job and its metrics"
+#endif
+#if CONFIG_MAX_TARGETS > MAX_TARGETS
+#error "Every device of a config file needs a target"
+#endif
 
 /* Struct to hold command result */
 typedef struct {
-    char* output;        /* Command output (stdout+stderr) */
+    const char* output;  /* Command output (stdout+stderr), valid until the next command */
     int exit_code;       /* Command exit code */
-    int success;         /* 1 if popen/pclose succeeded and exit code was 0 */
+    int success;         /* 1 if the command ran and exit code was 0 */
+    int timed_out;       /* 1 if the command was killed at its deadline */
 } CommandResult;
 
+/* Device status constants */
+#define STATUS_UNKNOWN       0
+#define STATUS_ATTACHED      1
+#define STATUS_NOT_ATTACHED  2
+#define STATUS_NOT_AVAILABLE 3
+#define STATUS_AVAILABLE     4
+#define STATUS_ATTACH_FAIL   5
+#define STATUS_ATTACH_SUCCESS 6
+#define STATUS_TIMEOUT       7  /* Host didn't answer the availability check in time */
+#define STATUS_COUNT         8
+
+/* Label values for the STATUS_* constants in the metrics */
+static const char* const status_names[STATUS_COUNT] = {
+    "unknown", "attached", "not_attached", "not_available",
+    "available", "attach_failed", "attach_succeeded", "timeout"
+};
+
+/* Listener slots in the event watcher */
+#define LISTENER_METRICS 0
+#define LISTENER_CONTROL 1
+
+/* A monitored device on a remote host, or on any of several */
+typedef struct {
+    char host_ip[CONFIG_HOST_MAX];  /* Host, or comma-separated hosts exporting the same device */
+    char identifier[CONFIG_ID_MAX]; /* Bus ID or device ID */
+    int is_busid;                 /* 1 if identifier is a bus ID */
+    int last_status;              /* STATUS_* from the previous cycle */
+    Scheduler policy;             /* Check intervals and backoff of this device */
+    TargetSchedule schedule;      /* Backoff state */
+    int command_timeout_ms;       /* Deadline for its usbip commands, 0 for --command-timeout */
+    int from_command_line;        /* 1 if given with -t or as an argument */
+    int from_config;              /* 1 if listed in the config file */
+    int from_control;             /* 1 if added through the control socket */
+    long long next_check_ms;      /* Monotonic time of the next check, 0 for now */
+    HostSession* session;         /* Host it is attached from, or will be attached from next */
+    HostSession* hosts[CONFIG_MAX_HOSTS]; /* Sessions of every host in host_ip, shared per host */
+    int host_count;
+    int failed_host;              /* Index in hosts of the host of a failed attach, -1 if none */
+    time_t status_since;          /* Wall-clock time last_status was entered, 0 before the first check */
+    int removed;                  /* 1 once dropped through the control socket; the slot can be reused */
+    char local_busid[EVENTS_BUSID_MAX]; /* Local busid of its virtual device when last seen attached, "" if unknown */
+} Target;
+
 /* Args struct to store command line arguments */
 typedef struct {
+    Target targets[MAX_TARGETS];  /* Every device to monitor */
+    int target_count;
     char host_ip[MAX_PATH_LEN];
     char busid[MAX_PATH_LEN];     /* Bus ID if specified */
     char device[MAX_PATH_LEN];    /* Device ID if specified */
     char usbip_path[MAX_PATH_LEN];
     int has_busid;               /* 1 if busid is specified */
     int has_device;              /* 1 if device is specified */
-    int verbose;                 /* 1 if verbose mode enabled */
+    int log_level;               /* LOG_LEVEL_*, debug with --verbose */
+    int log_format;              /* LOG_FORMAT_TEXT or LOG_FORMAT_JSON */
+    int no_native;               /* 1 to use the usbip executable instead of the built-in client */
+    int poll_only;               /* 1 to poll at a fixed interval instead of waiting for kernel events */
+    int interval;                /* Seconds before the first retry of an unavailable device */
+    int attached_interval;       /* Seconds between checks while attached, 0 for automatic */
+    int max_backoff;             /* Cap in seconds for the retry backoff */
+    int fast_retry_delay;        /* Milliseconds between retries right after a detach */
+    int fast_retries;            /* Number of fast retries after a detach */
+    int jitter;                  /* Percent of random spread on retry delays */
+    int command_timeout;         /* Seconds before a usbip command is killed */
+    int network_timeout;         /* Seconds allowed for a native connect or exchange */
+    int attach_timeout;          /* Seconds allowed for an attached device to show up on a port */
+    int devlist_ttl;             /* Seconds a host's listing is reused while it answers probes */
+    int keepalive;               /* Idle seconds before keepalive probes on attached devices */
+    int attach_workers;          /* Attaches run at once */
+    int host_attach_limit;       /* Attaches run at once against one host, 0 for no limit */
+    int host_order_rtt;          /* 1 to prefer the fastest of several hosts, 0 for the order given */
+    char metrics_socket[MAX_PATH_LEN]; /* Unix socket for Prometheus scrapes, empty for none */
+    char control_socket[MAX_PATH_LEN]; /* Unix socket for operator requests, empty for none */
+    char config_path[MAX_PATH_LEN]; /* File listing devices, reloaded on SIGHUP, empty for none */
     int show_help;               /* 1 if help should be shown */
     int show_version;            /* 1 if version should be shown */
 } Args;
 
 /* Signal handler for graceful shutdown */
 volatile sig_atomic_t keep_running = 1;
+/* Set by SIGUSR1 to print the metrics at the next wakeup */
+volatile sig_atomic_t dump_metrics = 0;
+/* Set by SIGHUP to reread the config file at the next wakeup */
+volatile sig_atomic_t reload_requested = 0;
 
 /* Function to trim leading/trailing whitespace */
 char* trim(char* str) {
@@ -72,150 +158,569 @@ char* trim(char* str) {
     return str;
 }
 
-/* Quote a shell argument, handling single quotes */
-char* quote_arg(const char* arg, char* buffer, size_t buffer_size) {
-    size_t pos = 0;
-    size_t i;
+/* Output of the last command, reused so steady-state checks don't allocate.
+ * One per thread, as attach workers run commands too. */
+static __thread RunnerBuffer command_output;
+/* Liveness and cached listing of each remote host */
+static SessionTable sessions;
+/* Age after which a cached listing is fetched again, from --devlist-ttl */
+static int devlist_ttl_ms = SESSION_DEFAULT_TTL_MS;
+/* Deadline for each command, from --command-timeout */
+static int command_timeout_ms = DEFAULT_COMMAND_TIMEOUT * 1000;
+/* 1 to attach from the host with the lowest RTT, 0 for the first in the order given, from --host-order */
+static int hosts_by_rtt = 1;
+/* Time allowed for an attached device to show up on a local port, from --attach-timeout */
+static int attach_timeout_ms = SETTLE_DEFAULT_TIMEOUT_MS;
+/* Deadline set by the config file for the device this thread is working on, 0 for none */
+static __thread int target_timeout_ms;
+/* Schedule from the command line, the base of every device's policy */
+static Scheduler scheduler;
+/* Set when, without detach notifications, attached devices are polled at the check interval */
+static int attached_follows_interval = 0;
+/* Latencies, spawn and attach counts, time in each status */
+static Metrics metrics;
+/* Operator requests, from --control-socket */
+static ControlSocket control;
+/* Local port state, read once however many devices and attach workers look at it */
+static PortCache ports;
+/* Where usbip was found; looked up again if it stops running */
+static Resolver usbip_binary;
+
+/* Map a usbip subcommand to the histogram that times it */
+static int command_metric(const char* command) {
+    if (strcmp(command, "port") == 0) {
+        return METRICS_OP_PORT;
+    }
+    if (strcmp(command, "list") == 0) {
+        return METRICS_OP_LIST;
+    }
+    if (strcmp(command, "attach") == 0) {
+        return METRICS_OP_ATTACH;
+    }
+    return -1;
+}
+
+/* After a run failed as if usbip were missing, check whether it moved, e.g.
+ * with a package upgrade. Returns 1 with the new path in buf if the command
+ * is worth running again. */
+static int usbip_moved(char* buf, size_t size) {
+    static int missing_logged = 0;
+    int ret = resolver_revalidate(&usbip_binary);
     
-    /* Start with a single quote */
-    if (pos < buffer_size - 1) buffer[pos++] = '\'';
+    if (ret == RESOLVER_MISSING) {
+        if (!missing_logged) {
+            log_warn("usbip executable is gone and can't be found in PATH");
+            missing_logged = 1;
+        }
+        return 0;
+    }
+    missing_logged = 0;
+    if (ret == RESOLVER_UNCHANGED) {
+        return 0;
+    }
+    resolver_copy(&usbip_binary, buf, size);
+    log_info("usbip executable changed, now using %s", buf);
+    return 1;
+}
+
+/* Function to run a command and capture its output and exit code.
+ * With on_output set, output is streamed to it instead of being collected,
+ * and the command is stopped as soon as it returns nonzero; it is then
+ * reported as successful since what the caller needed was seen. */
+CommandResult run_command_stream(const char** args, int arg_count,
+                                 runner_output_fn on_output, void* ctx) {
+    CommandResult cmd_result;
+    RunnerResult run;
+    const char* argv[8];
+    char program[RESOLVER_PATH_MAX];
+    int op = arg_count > 1 ? command_metric(args[1]) : -1;
+    int timeout_ms = target_timeout_ms > 0 ? target_timeout_ms : command_timeout_ms;
+    long long start_us;
+    int started;
+    int i;
     
-    /* Process each character in the argument */
-    for (i = 0; arg[i] != '\0' && pos < buffer_size - 4; i++) {
-        if (arg[i] == '\'') {
-            /* Close the quote, insert escaped quote, reopen quote */
-            buffer[pos++] = '\'';
-            buffer[pos++] = '\\';
-            buffer[pos++] = '\'';
-            buffer[pos++] = '\'';
+    cmd_result.output = "";
+    cmd_result.exit_code = -1;
+    cmd_result.success = 0;
+    cmd_result.timed_out = 0;
+    
+    /* Log the command; only built when debug messages are on */
+    if (log_enabled(LOG_LEVEL_DEBUG)) {
+        char line[512];
+        size_t len = 0;
+        
+        for (i = 0; i < arg_count && len < sizeof(line); i++) {
+            len += (size_t)snprintf(line + len, sizeof(line) - len, " %s", args[i]);
+        }
+        log_debug("Running command:%s", line);
+    }
+    
+    /* Arguments go straight to execve, no shell quoting needed */
+    for (i = 0; i < arg_count && i < 7; i++) {
+        argv[i] = args[i];
+    }
+    argv[i] = NULL;
+    
+    start_us = metrics_now_us();
+    started = runner_run(argv, timeout_ms, &command_output, on_output, ctx, &run) == 0;
+    
+    /* A binary that vanished or was replaced is looked up again and run once more.
+     * Streamed output may already have been consumed, so only spawn errors retry then. */
+    if ((!started && (errno == ENOENT || errno == EACCES || errno == ENOEXEC)) ||
+        (started && run.exit_code == 127 && !on_output)) {
+        int err = errno;
+        
+        if (usbip_moved(program, sizeof(program))) {
+            argv[0] = program;
+            start_us = metrics_now_us();
+            started = runner_run(argv, timeout_ms, &command_output, on_output, ctx, &run) == 0;
         } else {
-            buffer[pos++] = arg[i];
+            errno = err;
         }
     }
+    if (!started) {
+        metrics_count_spawn(&metrics, op, 0);
+        log_debug("Failed to run %s: %s", args[0], strerror(errno));
+        return cmd_result;
+    }
+    metrics_count_spawn(&metrics, op, 1);
+    metrics_observe(&metrics, op, metrics_now_us() - start_us);
+    cmd_result.output = command_output.data;
+    cmd_result.exit_code = run.exit_code;
+    cmd_result.success = run.success;
+    cmd_result.timed_out = run.timed_out;
+    
+    if (run.cancelled) {
+        log_debug("Command stopped for shutdown");
+        return cmd_result;
+    }
     
-    /* End with a single quote */
-    if (pos < buffer_size - 1) buffer[pos++] = '\'';
+    if (run.stopped) {
+        log_debug("Stopped reading command output early");
+        return cmd_result;
+    }
+    
+    /* Process exit status; long output is cut by the log */
+    if (run.timed_out) {
+        log_debug("Command timed out after %d ms and was killed. Output:\n%s", timeout_ms, cmd_result.output);
+    } else if (run.exit_code > 128) {
+        log_debug("Command killed by signal %d. Output:\n%s", run.exit_code - 128, cmd_result.output);
+    } else if (run.exit_code != 0) {
+        log_debug("Command exited with status %d. Output:\n%s", run.exit_code, cmd_result.output);
+    }
     
-    /* Null terminate */
-    buffer[pos] = '\0';
+    /* Log snippet on success */
+    if (cmd_result.success && !on_output && log_enabled(LOG_LEVEL_DEBUG)) {
+        size_t len = strlen(cmd_result.output);
+        log_debug("Command output snippet:\n%.*s%s",
+                  len > 200 ? 200 : (int)len,
+                  cmd_result.output,
+                  len > 200 ? "..." : "");
+    }
     
-    return buffer;
+    return cmd_result;
 }
 
-/* Function to run a command and capture its output and exit code */
-CommandResult run_command(const char** args, int arg_count, int verbose) {
-    CommandResult cmd_result;
-    char command_str[MAX_CMD_LEN] = {0};
-    char quoted_arg[MAX_PATH_LEN * 2];
-    char buffer[READ_BUFFER_SIZE];
-    size_t current_len = 0;
-    FILE* pipe;
-    int i, status;
-    
-    /* Initialize result */
-    cmd_result.output = malloc(MAX_OUTPUT_LEN);
-    if (!cmd_result.output) {
-        fprintf(stderr, "Error: Failed to allocate memory for command output\n");
-        exit(1);
-    }
-    cmd_result.output[0] = '\0';
-    cmd_result.exit_code = -1;
-    cmd_result.success = 0;
+/* Run a command and collect all of its output */
+CommandResult run_command(const char** args, int arg_count) {
+    return run_command_stream(args, arg_count, NULL, NULL);
+}
+
+/* Fill function of the port cache: read the local port state from vhci sysfs,
+ * or by running `usbip port` (the path in ctx). Returns 1 on success, 0 if
+ * `usbip port` itself failed. */
+static int read_ports(PortTable* table, void* ctx) {
+    static int fallback_logged = 0;
+    const char* usbip_path = ctx;
+    CommandResult text;
+    long long start_us = metrics_now_us();
+    
+    if (vhci_read_ports(table) >= 0) {
+        metrics_observe(&metrics, METRICS_OP_SYSFS_PORTS, metrics_now_us() - start_us);
+        return 1;
+    }
     
-    /* Log the command if verbose */
-    if (verbose) {
-        fprintf(stderr, "Running command:");
-        for (i = 0; i < arg_count; i++) {
-            fprintf(stderr, " %s", args[i]);
+    if (!fallback_logged) {
+        log_debug("vhci_hcd sysfs status not found, falling back to usbip port");
+        fallback_logged = 1;
+    }
+    
+    const char* port_args[2] = {usbip_path, "port"};
+    text = run_command(port_args, 2);
+    if (text.success) {
+        port_table_parse(table, text.output);
+    }
+    return text.success;
+}
+
+/* Scanners for every target waiting on one `usbip list -r` listing */
+typedef struct {
+    ListScanner* scanners;        /* This host's share of the cycle's scanners */
+    int* target_index;
+    int count;
+} ListScan;
+
+/* Feed a chunk of listing to every scanner; stop once all have matched */
+static int feed_list_scan(const char* chunk, size_t len, void* ctx) {
+    ListScan* scan = ctx;
+    int k, pending = 0;
+    
+    for (k = 0; k < scan->count; k++) {
+        if (!list_scanner_feed(&scan->scanners[k], chunk, len)) {
+            pending = 1;
         }
-        fprintf(stderr, "\n");
     }
+    return !pending;
+}
+
+/* One remote host's part of a cycle's availability check */
+typedef struct {
+    HostSession* session;
+    const char* usbip_path;
+    int native;
+    int timeout_ms;               /* Longest deadline of the devices waiting on its listing */
+    int ranked;                   /* 1 if a device picks between this host and others by RTT */
+    ListScan scan;                /* Busids looked for in `usbip list -r` output */
+    int listed;                   /* 1 if the host answered */
+    int timed_out;                /* 1 if it didn't answer in time */
+} HostCheck;
+
+/* Time a probe of a host whose RTT ranks it, unless the listing is fresh enough that
+ * refreshing it is a probe anyway. Only probes are timed, so listings and usbip runs
+ * don't skew the ranking. Returns 0 if the host answered or wasn't probed. */
+static int probe_ranked_host(HostCheck* check, long long now_ms) {
+    long long start_us;
+    
+    if (!check->ranked || (check->native && session_cache_valid(check->session, now_ms, devlist_ttl_ms))) {
+        return 0;
+    }
+    start_us = metrics_now_us();
+    if (session_probe(check->session, USBIP_DEFAULT_PORT) < 0) {
+        check->timed_out = errno == ETIMEDOUT;
+        log_debug("Failed to reach host %s: %s", check->session->host, strerror(errno));
+        return -1;
+    }
+    metrics_observe(&metrics, METRICS_OP_NATIVE_PROBE, metrics_now_us() - start_us);
+    return 0;
+}
+
+/* Pool job: list one host, natively or via `usbip list -r` */
+static void run_host_check(void* arg) {
+    HostCheck* check = arg;
+    HostSession* session = check->session;
+    long long now_ms = scheduler_now_ms();
     
-    /* Build command string with proper quoting */
-    for (i = 0; i < arg_count; i++) {
-        quote_arg(args[i], quoted_arg, sizeof(quoted_arg));
+    if (!keep_running || probe_ranked_host(check, now_ms) < 0) {
+        return;
+    }
+    if (check->native) {
+        int op = session_cache_valid(session, now_ms, devlist_ttl_ms) ? METRICS_OP_NATIVE_PROBE : METRICS_OP_NATIVE_LIST;
+        long long start_us = metrics_now_us();
+        int result = session_refresh(session, USBIP_DEFAULT_PORT, now_ms, devlist_ttl_ms);
         
-        if (i > 0) {
-            strcat(command_str, " ");
+        metrics_observe(&metrics, op, metrics_now_us() - start_us);
+        if (result == SESSION_FAILED) {
+            check->timed_out = errno == ETIMEDOUT;
+            log_debug("Failed to reach host %s: %s", session->host, strerror(errno));
+        } else if (result == SESSION_PROBED) {
+            log_debug("Host %s is up, reusing its list of %d device(s)", session->host, session->device_count);
+        } else {
+            log_debug("Host %s exports %d device(s)", session->host, session->device_count);
+        }
+        check->listed = result != SESSION_FAILED;
+    } else {
+        const char* list_args[4] = {check->usbip_path, "list", "-r", session->host};
+        CommandResult result;
+        int j;
+        
+        /* Match while the listing streams in, and stop once every busid is seen */
+        target_timeout_ms = check->timeout_ms;
+        result = run_command_stream(list_args, 4, feed_list_scan, &check->scan);
+        target_timeout_ms = 0;
+        check->timed_out = result.timed_out;
+        check->listed = result.success;
+        for (j = 0; j < check->scan.count; j++) {
+            check->listed |= check->scan.scanners[j].found;
+        }
+    }
+}
+
+/* Make the best of a target's usable hosts the one it attaches from, steering
+ * clear of a host whose attach just failed while another offers the device.
+ * Returns 1 if some host is usable. */
+static int pick_host(Target* target, int* usable, int offered) {
+    int best;
+    
+    if (offered > 1 && target->failed_host >= 0) {
+        usable[target->failed_host] = 0;
+    }
+    best = session_pick(target->hosts, usable, target->host_count, hosts_by_rtt);
+    if (best < 0) {
+        return 0;
+    }
+    if (target->hosts[best] != target->session) {
+        log_debug("Using host %s for %s (rtt %.1f ms)", target->hosts[best]->host, target->identifier,
+                  target->hosts[best]->rtt_us / 1000.0);
+    }
+    target->session = target->hosts[best];
+    return 1;
+}
+
+/* Check availability of every target flagged in needs_check, listing each
+ * remote host only once, natively or via `usbip list -r`. Natively, a host
+ * listed less than --devlist-ttl ago is only probed for liveness. Hosts are
+ * listed side by side on the worker pool, so one that doesn't answer holds up
+ * the cycle by one deadline rather than one per host. A target offered by
+ * several hosts gets the best of those that have it as its session; hosts
+ * ranked by RTT get a timed probe before they are listed. */
+void check_availability(Target* targets, int count, const int* needs_check, int* available,
+                        const char* usbip_path, int native, WorkPool* pool) {
+    static HostCheck checks[SESSION_MAX_HOSTS];
+    static ListScanner scanners[MAX_TARGETS * CONFIG_MAX_HOSTS];
+    static int scan_targets[MAX_TARGETS * CONFIG_MAX_HOSTS];
+    int check_of[MAX_TARGETS][CONFIG_MAX_HOSTS];
+    int check_count = 0;
+    int scanner_count = 0;
+    int i, h, k;
+    
+    /* One check per distinct host */
+    for (i = 0; i < count; i++) {
+        for (h = 0; needs_check[i] && h < targets[i].host_count; h++) {
+            for (k = 0; k < check_count && checks[k].session != targets[i].hosts[h]; k++) {
+            }
+            if (k == check_count) {
+                memset(&checks[k], 0, sizeof(checks[k]));
+                checks[k].session = targets[i].hosts[h];
+                checks[k].usbip_path = usbip_path;
+                checks[k].native = native;
+                check_count++;
+            }
+            check_of[i][h] = k;
+            checks[k].ranked |= targets[i].host_count > 1 && hosts_by_rtt;
+            if (targets[i].command_timeout_ms > checks[k].timeout_ms) {
+                checks[k].timeout_ms = targets[i].command_timeout_ms;
+            }
         }
-        strcat(command_str, quoted_arg);
     }
     
-    /* Redirect stderr to stdout */
-    strcat(command_str, " 2>&1");
+    /* Give each listing the busids waiting on it; the scanners of one host sit side by side */
+    for (k = 0; k < check_count && !native; k++) {
+        checks[k].scan.scanners = &scanners[scanner_count];
+        checks[k].scan.target_index = &scan_targets[scanner_count];
+        for (i = 0; i < count; i++) {
+            for (h = 0; needs_check[i] && h < targets[i].host_count; h++) {
+                if (check_of[i][h] == k) {
+                    list_scanner_init(&scanners[scanner_count], targets[i].identifier);
+                    scan_targets[scanner_count++] = i;
+                    checks[k].scan.count++;
+                }
+            }
+        }
+    }
     
-    /* Run the command */
-    pipe = popen(command_str, "r");
-    if (!pipe) {
-        sprintf(cmd_result.output, "popen() failed!");
-        return cmd_result;
+    for (k = 0; k < check_count; k++) {
+        if (pool_submit(pool, checks[k].session->host, run_host_check, &checks[k]) < 0) {
+            run_host_check(&checks[k]);
+        }
     }
+    pool_wait(pool);
     
-    /* Read command output */
-    while (fgets(buffer, sizeof(buffer), pipe) != NULL) {
-        size_t len = strlen(buffer);
+    /* Answer every target from the listings of its hosts */
+    for (i = 0; i < count; i++) {
+        Target* target = &targets[i];
+        int usable[CONFIG_MAX_HOSTS];
+        int timed_out = 0;
+        int offered = 0;
         
-        /* Ensure we don't overflow the output buffer */
-        if (current_len + len >= MAX_OUTPUT_LEN - 1) {
-            len = MAX_OUTPUT_LEN - current_len - 1;
-            if (len <= 0) break;
+        if (!needs_check[i]) {
+            continue;
+        }
+        for (h = 0; h < target->host_count; h++) {
+            const HostCheck* check = &checks[check_of[i][h]];
+            
+            usable[h] = 0;
+            if (native) {
+                usable[h] = check->listed && session_has_device(check->session, target->identifier);
+            } else {
+                /* A busid seen before the deadline still counts */
+                for (k = 0; k < check->scan.count; k++) {
+                    if (check->scan.target_index[k] == i && check->scan.scanners[k].found) {
+                        usable[h] = 1;
+                    }
+                }
+            }
+            timed_out |= check->timed_out && !usable[h];
+            offered += usable[h];
         }
         
-        memcpy(cmd_result.output + current_len, buffer, len);
-        current_len += len;
-        cmd_result.output[current_len] = '\0';
+        if (pick_host(target, usable, offered)) {
+            available[i] = 1;
+        } else {
+            available[i] = timed_out ? -1 : 0;
+        }
     }
+}
+
+/* Whether a target's device is imported from one of its hosts, in the current view of the ports.
+ * The host in use is looked at first; another one it is found on becomes the one in use, e.g.
+ * after a restart or a manual attach. Of several hosts, one known to be down doesn't count:
+ * its import lingers until TCP keepalive gives up on it, while the device moves elsewhere. */
+static int find_attached(Target* target, long long now_ms) {
+    HostSession* session = target->session;
+    int h;
     
-    /* Close the pipe and get exit status */
-    status = pclose(pipe);
-    if (status == -1) {
-        sprintf(cmd_result.output, "pclose() failed!");
-        return cmd_result;
+    for (h = -1; h < target->host_count; h++) {
+        if (h >= 0) {
+            session = target->hosts[h];
+            if (session == target->session) {
+                continue;
+            }
+        }
+        if (target->host_count > 1 && session->alive == 0) {
+            continue;
+        }
+        if (port_cache_find_local(&ports, session->host, target->identifier, target->is_busid, now_ms,
+                                  target->local_busid, sizeof(target->local_busid)) == 1) {
+            target->session = session;
+            return 1;
+        }
     }
+    return 0;
+}
+
+/* Pool job: check that a host devices are attached from still answers */
+static void run_host_probe(void* arg) {
+    HostSession* session = arg;
+    long long start_us = metrics_now_us();
     
-    /* Process exit status */
-    if (WIFEXITED(status)) {
-        cmd_result.exit_code = WEXITSTATUS(status);
-        if (cmd_result.exit_code == 0) {
-            cmd_result.success = 1;
+    if (!keep_running) {
+        return;
+    }
+    if (session_probe(session, USBIP_DEFAULT_PORT) < 0) {
+        log_debug("Failed to reach host %s: %s", session->host, strerror(errno));
+        return;
+    }
+    metrics_observe(&metrics, METRICS_OP_NATIVE_PROBE, metrics_now_us() - start_us);
+}
+
+/* Probe the host in use of every attached target flagged in needs_probe, each host once and
+ * side by side on the worker pool. The kernel only notices a dead host once TCP keepalive gives
+ * up, and not at all for some `usbip attach` setups, so a device that other hosts could serve
+ * would otherwise stay stuck on it. Clears attached[i] of targets whose host didn't answer. */
+static void probe_hosts_in_use(Target* targets, int count, const int* needs_probe, int* attached, WorkPool* pool) {
+    HostSession* probed[MAX_TARGETS];
+    int probe_count = 0;
+    int i, k;
+    
+    for (i = 0; i < count; i++) {
+        if (!needs_probe[i]) {
+            continue;
         }
-        if (cmd_result.exit_code != 0 && verbose) {
-            fprintf(stderr, "Command exited with status %d\n", cmd_result.exit_code);
-            fprintf(stderr, "Command output:\n%s\n", cmd_result.output);
+        for (k = 0; k < probe_count && probed[k] != targets[i].session; k++) {
         }
-    } else if (WIFSIGNALED(status)) {
-        cmd_result.exit_code = 128 + WTERMSIG(status); /* Mimic shell signal exit codes */
-        if (verbose) {
-            fprintf(stderr, "Command killed by signal %d\n", WTERMSIG(status));
-            fprintf(stderr, "Command output:\n%s\n", cmd_result.output);
+        if (k == probe_count) {
+            probed[probe_count++] = targets[i].session;
+            if (pool_submit(pool, targets[i].session->host, run_host_probe, targets[i].session) < 0) {
+                run_host_probe(targets[i].session);
+            }
         }
-    } else {
-        if (verbose) {
-            fprintf(stderr, "Command exited abnormally.\n");
-            fprintf(stderr, "Command output:\n%s\n", cmd_result.output);
+    }
+    pool_wait(pool);
+    
+    for (i = 0; i < count && keep_running; i++) {
+        if (needs_probe[i] && targets[i].session->alive == 0) {
+            log_info("Host %s of device %s stopped answering, attaching from another host",
+                     targets[i].session->host, targets[i].identifier);
+            attached[i] = 0;
         }
     }
+}
+
+/* Attach in-process: OP_REQ_IMPORT, then hand the socket to vhci_hcd.
+ * On success our copy of the socket is returned through sockfd_out so the
+ * caller can watch it for shutdown.
+ * Returns 1 if attached, 0 on failure, -1 if vhci_hcd can't be driven from sysfs. */
+int attach_device_native(const char* host_ip, const char* busid, int* sockfd_out) {
+    UsbipDevice device;
+    int sockfd;
+    int port;
+    
+    if (!vhci_can_attach()) {
+        return -1;
+    }
     
-    /* Log snippet on success if verbose */
-    if (verbose && cmd_result.exit_code == 0) {
-        size_t len = strlen(cmd_result.output);
-        fprintf(stderr, "Command output snippet:\n%.*s%s\n", 
-                len > 200 ? 200 : (int)len, 
-                cmd_result.output, 
-                len > 200 ? "..." : "");
+    sockfd = usbip_import(host_ip, USBIP_DEFAULT_PORT, busid, &device);
+    if (sockfd < 0) {
+        log_debug("Import of %s from host %s failed", busid, host_ip);
+        return 0;
     }
     
-    return cmd_result;
+    port = vhci_attach(sockfd, device.busnum, device.devnum, device.speed,
+                       host_ip, USBIP_DEFAULT_PORT, busid);
+    if (port < 0) {
+        log_debug("Writing to vhci_hcd attach failed: %s", strerror(errno));
+        close(sockfd);
+        return 0;
+    }
+    
+    /* The kernel holds its own reference; ours only serves to notice shutdown */
+    *sockfd_out = sockfd;
+    
+    log_debug("Imported %s (%04x:%04x) on vhci port %d", busid,
+              device.id_vendor, device.id_product, port);
+    
+    /* The port state is updated synchronously by the attach write */
+    return vhci_port_attached(host_ip, busid, 1) == 1;
+}
+
+/* The device an attach is waiting for */
+typedef struct {
+    const char* host;
+    const char* busid;
+} SettleTarget;
+
+/* Readiness check of settle_wait(): whether the device in ctx shows on a local port yet.
+ * The first check can use any read made since the attach command returned; later ones
+ * read the port state again, sharing the read with other workers checking at the same time. */
+static int attach_settled(void* ctx) {
+    const SettleTarget* device = ctx;
+    
+    if (!keep_running) {
+        return SETTLE_GAVE_UP;
+    }
+    if (port_cache_find(&ports, device->host, device->busid, 1, scheduler_now_ms()) == 1) {
+        return SETTLE_READY;
+    }
+    port_cache_invalidate(&ports);
+    return SETTLE_PENDING;
 }
 
-/* Function to attach the device using either busid or device ID */
-int attach_device(const char* host_ip, const char* busid, const char* device, const char* usbip_path, int verbose) {
+/* Function to attach the device using either busid or device ID.
+ * For in-process attaches the imported socket is returned through sockfd_out (-1 otherwise).
+ * Returns 1 if attached, 0 on failure, -1 if usbip can't open vhci_driver, so no attach can work. */
+int attach_device(const char* host_ip, const char* busid, const char* device, const char* usbip_path,
+                  int native, int* sockfd_out) {
     const char* args[7]; /* Max command args */
     int arg_count = 0;
     CommandResult result;
     int is_busid = busid && *busid; /* 1 if busid is specified, 0 if device */
     const char* identifier = is_busid ? busid : device;
     
+    *sockfd_out = -1;
+    
+    /* Prefer the in-process path; device IDs are tool specific so leave those to usbip */
+    if (native && is_busid) {
+        long long start_us = metrics_now_us();
+        int attached = attach_device_native(host_ip, busid, sockfd_out);
+        if (attached >= 0) {
+            port_cache_invalidate(&ports);
+            metrics_observe(&metrics, METRICS_OP_NATIVE_ATTACH, metrics_now_us() - start_us);
+            metrics_count_attach(&metrics, METRICS_OP_NATIVE_ATTACH, attached, -1);
+            return attached;
+        }
+        log_debug("vhci_hcd attach file not found, falling back to usbip attach");
+    }
+    
     /* Prepare command args */
     args[arg_count++] = usbip_path;
     args[arg_count++] = "attach";
@@ -233,101 +738,118 @@ int attach_device(const char* host_ip, const char* busid, const char* device, co
     args[arg_count] = NULL; /* Terminate the array */
     
     /* Run the command */
-    result = run_command(args, arg_count, verbose);
+    result = run_command(args, arg_count);
+    port_cache_invalidate(&ports);
     
     /* Check for specific vhci driver error */
     if (result.exit_code == 1 && strstr(result.output, "open vhci_driver") != NULL) {
-        fprintf(stderr, "Error: Failed to open vhci_driver. VHCI kernel module may not be loaded.\n");
-        fprintf(stderr, "Try running: sudo modprobe vhci-hcd\n");
-        free(result.output);
-        exit(2); /* Exit with specific code for this error */
+        log_error("Error: Failed to open vhci_driver. VHCI kernel module may not be loaded.");
+        log_error("Try running: sudo modprobe vhci-hcd");
+        return -1; /* The main thread exits with a specific code for this error */
     }
     
-    if (!result.success && verbose) {
-        fprintf(stderr, "Attach command failed with exit code %d. Output:\n%s\n", 
-                result.exit_code, result.output);
+    if (!result.success) {
+        log_debug("Attach command failed with exit code %d. Output:\n%s", result.exit_code, result.output);
     }
     
     /* Re-check attachment status only if we used busid (more reliable) */
     if (is_busid) {
-        /* Wait 2 seconds for attach to complete */
-        sleep(2);
+        SettleTarget awaited;
+        SettleResult settle;
+        int attached;
+        
+        awaited.host = host_ip;
+        awaited.busid = identifier;
         
-        /* Check port status */
-        const char* port_args[2] = {usbip_path, "port"};
-        CommandResult port_result = run_command(port_args, 2, verbose);
-        int attached = parse_usbip_port(port_result.output, identifier, 1);
-        free(port_result.output);
-        free(result.output);
+        /* Wait for the port to show the device, returning as soon as it does. A failed
+         * command gets a single look: any read since it returned will do. */
+        attached = settle_wait(attach_settled, &awaited,
+                               result.success ? attach_timeout_ms : 0, SETTLE_FIRST_STEP_MS, &settle) == SETTLE_READY;
+        if (attached) {
+            metrics_observe(&metrics, METRICS_OP_ATTACH_SETTLE, settle.waited_ms * 1000);
+            log_debug("%s showed up on a local port after %lld ms (%d checks)", identifier, settle.waited_ms, settle.checks);
+        } else if (result.success) {
+            log_debug("%s did not show up on a local port within %d ms", identifier, attach_timeout_ms);
+        }
+        metrics_count_attach(&metrics, METRICS_OP_ATTACH, attached, result.exit_code);
         return attached;
     } else {
         /* For device ID attach, rely on command success */
-        if (verbose) {
-            fprintf(stderr, "Attach command with device ID completed. Cannot reliably verify port status.\n");
-        }
-        int success = result.success;
-        free(result.output);
-        return success;
+        log_debug("Attach command with device ID completed. Cannot reliably verify port status.");
+        metrics_count_attach(&metrics, METRICS_OP_ATTACH, result.success, result.exit_code);
+        return result.success;
+    }
+}
+
+/* One attach handed to the worker pool */
+typedef struct {
+    const Target* target;
+    const char* usbip_path;
+    int native;
+    int attached;                 /* Result of attach_device(), -1 if vhci_driver can't be opened */
+    int error;                    /* errno left by attach_device() */
+    int imported_fd;              /* Socket of an in-process attach, -1 otherwise */
+} AttachJob;
+
+/* Pool job: attach one device */
+static void run_attach_job(void* arg) {
+    AttachJob* job = arg;
+    const Target* target = job->target;
+    
+    /* Jobs still queued at shutdown are dropped */
+    if (!keep_running) {
+        job->attached = 0;
+        job->error = ECANCELED;
+        return;
     }
+    target_timeout_ms = target->command_timeout_ms;
+    job->attached = attach_device(target->session->host, target->is_busid ? target->identifier : NULL,
+                                  target->is_busid ? NULL : target->identifier,
+                                  job->usbip_path, job->native, &job->imported_fd);
+    job->error = errno;
+    target_timeout_ms = 0;
 }
 
 /* Signal handler function */
-void signal_handler(int signal) {
-    if (signal == SIGINT || signal == SIGTERM) {
+void signal_handler(int signo) {
+    if (signo == SIGINT || signo == SIGTERM) {
         keep_running = 0;
+    } else if (signo == SIGUSR1) {
+        dump_metrics = 1;
+    } else if (signo == SIGHUP) {
+        reload_requested = 1;
     }
 }
 
-/* Find usbip executable in PATH */
-int find_usbip(const char* user_path, char* found_path, size_t path_size) {
-    char path_buffer[MAX_PATH_LEN];
-    const char* path_env;
-    char* path_copy;
-    char* token;
-    
-    /* Initialize output path */
-    if (path_size > 0) {
-        found_path[0] = '\0';
-    }
-    
-    /* Check user-provided path first */
-    if (user_path && *user_path) {
-        if (access(user_path, X_OK) == 0) {
-            strncpy(found_path, user_path, path_size - 1);
-            found_path[path_size - 1] = '\0';
-            return 1;
-        }
-    }
+/* Fill in a target with the device of a config file line or spec */
+void target_from_config(const ConfigTarget* device, Target* target) {
+    memset(target, 0, sizeof(*target));
+    memcpy(target->host_ip, device->host, sizeof(target->host_ip));
+    memcpy(target->identifier, device->identifier, sizeof(target->identifier));
+    target->is_busid = device->is_busid;
+    target->last_status = STATUS_UNKNOWN;
+}
+
+/* Fill in a target from a "<host>:<busid>" or "<host>:devid=<devid>" spec.
+ * Returns 1 on success, 0 if the spec is malformed. */
+int parse_target_spec(const char* spec, Target* target) {
+    ConfigTarget device;
     
-    /* Get PATH environment variable */
-    path_env = getenv("PATH");
-    if (!path_env) {
+    if (!config_parse_spec(spec, &device)) {
         return 0;
     }
-    
-    /* Make a copy of PATH to tokenize */
-    path_copy = strdup(path_env);
-    if (!path_copy) {
+    target_from_config(&device, target);
+    return 1;
+}
+
+/* Add a target from a spec given on the command line.
+ * Returns 1 on success, 0 if the spec is malformed or there are too many targets. */
+int add_target_spec(Args* args, const char* spec) {
+    if (args->target_count >= MAX_TARGETS || !parse_target_spec(spec, &args->targets[args->target_count])) {
         return 0;
     }
-    
-    /* Search each directory in PATH */
-    token = strtok(path_copy, ":");
-    while (token) {
-        if (*token) { /* Skip empty path components */
-            snprintf(path_buffer, sizeof(path_buffer), "%s/usbip", token);
-            if (access(path_buffer, X_OK) == 0) {
-                strncpy(found_path, path_buffer, path_size - 1);
-                found_path[path_size - 1] = '\0';
-                free(path_copy);
-                return 1;
-            }
-        }
-        token = strtok(NULL, ":");
-    }
-    
-    free(path_copy);
-    return 0;
+    args->target_count++;
+    return 1;
 }
 
 /* Parse command line arguments */
@@ -337,11 +859,42 @@ void parse_args(int argc, char* argv[], Args* args) {
     
     /* Initialize args with defaults */
     memset(args, 0, sizeof(Args));
+    args->interval = DEFAULT_INTERVAL;
+    args->max_backoff = SCHEDULER_DEFAULT_MAX_BACKOFF_MS / 1000;
+    args->fast_retry_delay = SCHEDULER_DEFAULT_FAST_RETRY_MS;
+    args->fast_retries = SCHEDULER_DEFAULT_FAST_RETRIES;
+    args->jitter = SCHEDULER_DEFAULT_JITTER_PERCENT;
+    args->command_timeout = DEFAULT_COMMAND_TIMEOUT;
+    args->network_timeout = DEFAULT_NETWORK_TIMEOUT;
+    args->attach_timeout = SETTLE_DEFAULT_TIMEOUT_MS / 1000;
+    args->devlist_ttl = SESSION_DEFAULT_TTL_MS / 1000;
+    args->keepalive = USBIP_NET_DEFAULT_KEEPALIVE_S;
+    args->attach_workers = POOL_DEFAULT_THREADS;
+    args->host_attach_limit = POOL_DEFAULT_KEY_LIMIT;
+    args->host_order_rtt = 1;
+    args->log_level = LOG_LEVEL_INFO;
+    args->log_format = LOG_FORMAT_TEXT;
     
     /* Parse args */
     for (i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0) {
-            args->verbose = 1;
+            args->log_level = LOG_LEVEL_DEBUG;
+        } else if (strcmp(argv[i], "--log-level") == 0) {
+            if (i + 1 < argc && log_level_from_name(argv[i + 1]) >= 0) {
+                args->log_level = log_level_from_name(argv[++i]);
+            } else {
+                fprintf(stderr, "Error: --log-level requires error, warn, info or debug.\n");
+                args->show_help = 1;
+                return;
+            }
+        } else if (strcmp(argv[i], "--log-format") == 0) {
+            if (i + 1 < argc && (strcmp(argv[i + 1], "text") == 0 || strcmp(argv[i + 1], "json") == 0)) {
+                args->log_format = strcmp(argv[++i], "json") == 0 ? LOG_FORMAT_JSON : LOG_FORMAT_TEXT;
+            } else {
+                fprintf(stderr, "Error: --log-format requires text or json.\n");
+                args->show_help = 1;
+                return;
+            }
         } else if (strcmp(argv[i], "--usbip-path") == 0) {
             if (i + 1 < argc) {
                 strncpy(args->usbip_path, argv[++i], sizeof(args->usbip_path) - 1);
@@ -350,6 +903,146 @@ void parse_args(int argc, char* argv[], Args* args) {
                 args->show_help = 1;
                 return;
             }
+        } else if (strcmp(argv[i], "--no-native") == 0) {
+            args->no_native = 1;
+        } else if (strcmp(argv[i], "--poll") == 0) {
+            args->poll_only = 1;
+        } else if (strcmp(argv[i], "--interval") == 0) {
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0) {
+                args->interval = atoi(argv[++i]);
+            } else {
+                fprintf(stderr, "Error: --interval requires a positive number of seconds.\n");
+                args->show_help = 1;
+                return;
+            }
+        } else if (strcmp(argv[i], "--attached-interval") == 0) {
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0) {
+                args->attached_interval = atoi(argv[++i]);
+            } else {
+                fprintf(stderr, "Error: --attached-interval requires a positive number of seconds.\n");
+                args->show_help = 1;
+                return;
+            }
+        } else if (strcmp(argv[i], "--max-backoff") == 0) {
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0) {
+                args->max_backoff = atoi(argv[++i]);
+            } else {
+                fprintf(stderr, "Error: --max-backoff requires a positive number of seconds.\n");
+                args->show_help = 1;
+                return;
+            }
+        } else if (strcmp(argv[i], "--fast-retries") == 0) {
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) {
+                args->fast_retries = atoi(argv[++i]);
+            } else {
+                fprintf(stderr, "Error: --fast-retries requires a number.\n");
+                args->show_help = 1;
+                return;
+            }
+        } else if (strcmp(argv[i], "--fast-retry-delay") == 0) {
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0) {
+                args->fast_retry_delay = atoi(argv[++i]);
+            } else {
+                fprintf(stderr, "Error: --fast-retry-delay requires a positive number of milliseconds.\n");
+                args->show_help = 1;
+                return;
+            }
+        } else if (strcmp(argv[i], "--jitter") == 0) {
+            if (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0]) && atoi(argv[i + 1]) <= 100) {
+                args->jitter = atoi(argv[++i]);
+            } else {
+                fprintf(stderr, "Error: --jitter requires a percentage from 0 to 100.\n");
+                args->show_help = 1;
+                return;
+            }
+        } else if (strcmp(argv[i], "--command-timeout") == 0) {
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0) {
+                args->command_timeout = atoi(argv[++i]);
+            } else {
+                fprintf(stderr, "Error: --command-timeout requires a positive number of seconds.\n");
+                args->show_help = 1;
+                return;
+            }
+        } else if (strcmp(argv[i], "--network-timeout") == 0) {
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0) {
+                args->network_timeout = atoi(argv[++i]);
+            } else {
+                fprintf(stderr, "Error: --network-timeout requires a positive number of seconds.\n");
+                args->show_help = 1;
+                return;
+            }
+        } else if (strcmp(argv[i], "--attach-timeout") == 0) {
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0) {
+                args->attach_timeout = atoi(argv[++i]);
+            } else {
+                fprintf(stderr, "Error: --attach-timeout requires a positive number of seconds.\n");
+                args->show_help = 1;
+                return;
+            }
+        } else if (strcmp(argv[i], "--devlist-ttl") == 0) {
+            if (i + 1 < argc && atoi(argv[i + 1]) >= 0) {
+                args->devlist_ttl = atoi(argv[++i]);
+            } else {
+                fprintf(stderr, "Error: --devlist-ttl requires a number of seconds.\n");
+                args->show_help = 1;
+                return;
+            }
+        } else if (strcmp(argv[i], "--keepalive") == 0) {
+            if (i + 1 < argc && atoi(argv[i + 1]) >= 0) {
+                args->keepalive = atoi(argv[++i]);
+            } else {
+                fprintf(stderr, "Error: --keepalive requires a number of seconds.\n");
+                args->show_help = 1;
+                return;
+            }
+        } else if (strcmp(argv[i], "--attach-workers") == 0) {
+            if (i + 1 < argc && atoi(argv[i + 1]) > 0 && atoi(argv[i + 1]) <= POOL_MAX_THREADS) {
+                args->attach_workers = atoi(argv[++i]);
+            } else {
+                fprintf(stderr, "Error: --attach-workers requires a number from 1 to %d.\n", POOL_MAX_THREADS);
+                args->show_help = 1;
+                return;
+            }
+        } else if (strcmp(argv[i], "--host-attach-limit") == 0) {
+            if (i + 1 < argc && atoi(argv[i + 1]) >= 0) {
+                args->host_attach_limit = atoi(argv[++i]);
+            } else {
+                fprintf(stderr, "Error: --host-attach-limit requires a number.\n");
+                args->show_help = 1;
+                return;
+            }
+        } else if (strcmp(argv[i], "--host-order") == 0) {
+            if (i + 1 < argc && (strcmp(argv[i + 1], "rtt") == 0 || strcmp(argv[i + 1], "listed") == 0)) {
+                args->host_order_rtt = strcmp(argv[++i], "rtt") == 0;
+            } else {
+                fprintf(stderr, "Error: --host-order requires rtt or listed.\n");
+                args->show_help = 1;
+                return;
+            }
+        } else if (strcmp(argv[i], "--metrics-socket") == 0) {
+            if (i + 1 < argc) {
+                strncpy(args->metrics_socket, argv[++i], sizeof(args->metrics_socket) - 1);
+            } else {
+                fprintf(stderr, "Error: --metrics-socket requires a path.\n");
+                args->show_help = 1;
+                return;
+            }
+        } else if (strcmp(argv[i], "--config") == 0) {
+            if (i + 1 < argc) {
+                strncpy(args->config_path, argv[++i], sizeof(args->config_path) - 1);
+            } else {
+                fprintf(stderr, "Error: --config requires a path.\n");
+                args->show_help = 1;
+                return;
+            }
+        } else if (strcmp(argv[i], "--control-socket") == 0) {
+            if (i + 1 < argc) {
+                strncpy(args->control_socket, argv[++i], sizeof(args->control_socket) - 1);
+            } else {
+                fprintf(stderr, "Error: --control-socket requires a path.\n");
+                args->show_help = 1;
+                return;
+            }
         } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
             args->show_help = 1;
             return;
@@ -365,6 +1058,14 @@ void parse_args(int argc, char* argv[], Args* args) {
                 args->show_help = 1;
                 return;
             }
+        } else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--target") == 0) {
+            if (i + 1 < argc && add_target_spec(args, argv[i + 1])) {
+                i++;
+            } else {
+                fprintf(stderr, "Error: --target requires <host>:<busid> or <host>:devid=<devid> (at most %d targets).\n", MAX_TARGETS);
+                args->show_help = 1;
+                return;
+            }
         } else if (strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--device") == 0) {
             if (i + 1 < argc) {
                 strncpy(args->device, argv[++i], sizeof(args->device) - 1);
@@ -393,6 +1094,12 @@ void parse_args(int argc, char* argv[], Args* args) {
     
     /* Validate arguments */
     if (!args->show_help && !args->show_version) {
+        if (positional_count == 0 && (args->target_count > 0 || args->config_path[0]) &&
+            !args->has_busid && !args->has_device) {
+            /* Only --target specs or a config file were given */
+            return;
+        }
+        
         if (positional_count != 1) {
             fprintf(stderr, "Error: Requires exactly one positional argument: <host_ip>\n");
             args->show_help = 1;
@@ -410,40 +1117,515 @@ void parse_args(int argc, char* argv[], Args* args) {
             args->show_help = 1;
             return;
         }
+        
+        if (args->target_count >= MAX_TARGETS) {
+            fprintf(stderr, "Error: At most %d devices can be monitored.\n", MAX_TARGETS);
+            args->show_help = 1;
+            return;
+        }
+        
+        /* The positional form is just one more target */
+        const char* identifier = args->has_busid ? args->busid : args->device;
+        if (strlen(args->host_ip) >= CONFIG_HOST_MAX || strlen(identifier) >= CONFIG_ID_MAX) {
+            fprintf(stderr, "Error: Host or device ID too long.\n");
+            args->show_help = 1;
+            return;
+        }
+        Target* target = &args->targets[args->target_count++];
+        memset(target, 0, sizeof(*target));
+        strcpy(target->host_ip, args->host_ip);
+        strcpy(target->identifier, identifier);
+        target->is_busid = args->has_busid;
+        target->last_status = STATUS_UNKNOWN;
     }
 }
 
 /* Print usage information */
 void print_usage(const char* prog_name) {
-    fprintf(stderr, "Usage: %s <host_ip> {-b <busid> | -d <devid>} [--usbip-path <path>] [-v|--verbose] [--version] [-h|--help]\n", prog_name);
+    fprintf(stderr, "Usage: %s {<host_ip> {-b <busid> | -d <devid>} | -t <host>:<busid> ... | --config <path>} [--usbip-path <path>] [--no-native] [--poll] [--interval <sec>] [--attached-interval <sec>] [--max-backoff <sec>] [--fast-retries <n>] [--fast-retry-delay <ms>] [--jitter <percent>] [--command-timeout <sec>] [--network-timeout <sec>] [--attach-timeout <sec>] [--devlist-ttl <sec>] [--keepalive <sec>] [--attach-workers <n>] [--host-attach-limit <n>] [--host-order <rtt|listed>] [--metrics-socket <path>] [--control-socket <path>] [--log-level <level>] [--log-format <text|json>] [-v|--verbose] [--version] [-h|--help]\n", prog_name);
     fprintf(stderr, "  <host_ip>           IP address of the remote USBIP host.\n");
     fprintf(stderr, "  -b, --busid <busid> Bus ID of the USB device to monitor and attach (e.g., 1-2). Mutually exclusive with -d.\n");
     fprintf(stderr, "  -d, --device <devid> Device ID (UDC ID) on the remote host to attach. Mutually exclusive with -b.\n");
     fprintf(stderr, "                      Note: Availability/attachment status checks are less reliable with -d.\n");
+    fprintf(stderr, "  -t, --target <host>:<busid>\n");
+    fprintf(stderr, "                      Monitor a device (use <host>:devid=<devid> for a device ID). Repeat to\n");
+    fprintf(stderr, "                      supervise several devices from one process; may be combined with the form above.\n");
+    fprintf(stderr, "                      Separate hosts exporting the same device with commas: <host>,<host>:<busid>.\n");
     fprintf(stderr, "  --usbip-path <path> (Optional) Full path to the local usbip executable.\n");
     fprintf(stderr, "                      Searches PATH if not provided.\n");
-    fprintf(stderr, "  -v, --verbose       Enable detailed logging to stderr.\n");
+    fprintf(stderr, "  --no-native         Run the usbip executable for remote device listing and attach\n");
+    fprintf(stderr, "                      instead of the built-in USB/IP protocol client.\n");
+    fprintf(stderr, "  --poll              Check every --interval seconds even while attached, instead of\n");
+    fprintf(stderr, "                      waiting for kernel detach notifications.\n");
+    fprintf(stderr, "  --interval <sec>    Seconds before retrying a device that is not available (default: %d).\n", DEFAULT_INTERVAL);
+    fprintf(stderr, "                      Doubles with each further failure, up to --max-backoff.\n");
+    fprintf(stderr, "  --attached-interval <sec>\n");
+    fprintf(stderr, "                      Seconds between checks while attached (default: %d with detach\n", SCHEDULER_DEFAULT_ATTACHED_MS / 1000);
+    fprintf(stderr, "                      notifications, --interval with --poll).\n");
+    fprintf(stderr, "  --max-backoff <sec> Longest delay between retries of an unavailable device (default: %d).\n", SCHEDULER_DEFAULT_MAX_BACKOFF_MS / 1000);
+    fprintf(stderr, "  --fast-retries <n>  Quick retries right after a device is detached (default: %d).\n", SCHEDULER_DEFAULT_FAST_RETRIES);
+    fprintf(stderr, "  --fast-retry-delay <ms>\n");
+    fprintf(stderr, "                      Milliseconds between those quick retries (default: %d).\n", SCHEDULER_DEFAULT_FAST_RETRY_MS);
+    fprintf(stderr, "  --jitter <percent>  Random spread applied to retry delays (default: %d).\n", SCHEDULER_DEFAULT_JITTER_PERCENT);
+    fprintf(stderr, "  --command-timeout <sec>\n");
+    fprintf(stderr, "                      Seconds before a usbip command is killed (default: %d).\n", DEFAULT_COMMAND_TIMEOUT);
+    fprintf(stderr, "  --network-timeout <sec>\n");
+    fprintf(stderr, "                      Seconds allowed to connect to a host and get its reply (default: %d).\n", DEFAULT_NETWORK_TIMEOUT);
+    fprintf(stderr, "  --attach-timeout <sec>\n");
+    fprintf(stderr, "                      Seconds allowed for a device attached with usbip to show up on a\n");
+    fprintf(stderr, "                      local port (default: %d).\n", SETTLE_DEFAULT_TIMEOUT_MS / 1000);
+    fprintf(stderr, "  --devlist-ttl <sec> Seconds a host's device list is reused while the host accepts connections,\n");
+    fprintf(stderr, "                      0 to list it on every check (default: %d).\n", SESSION_DEFAULT_TTL_MS / 1000);
+    fprintf(stderr, "  --keepalive <sec>   Idle seconds before TCP keepalive probes on attached devices,\n");
+    fprintf(stderr, "                      0 for the system default (default: %d).\n", USBIP_NET_DEFAULT_KEEPALIVE_S);
+    fprintf(stderr, "  --attach-workers <n>\n");
+    fprintf(stderr, "                      Devices attached, or hosts checked, at the same time (default: %d).\n", POOL_DEFAULT_THREADS);
+    fprintf(stderr, "  --host-attach-limit <n>\n");
+    fprintf(stderr, "                      Devices attached from one host at the same time, 0 for no limit (default: %d).\n", POOL_DEFAULT_KEY_LIMIT);
+    fprintf(stderr, "  --host-order <rtt|listed>\n");
+    fprintf(stderr, "                      Which of several hosts exporting a device to attach from: the one answering\n");
+    fprintf(stderr, "                      fastest, or the first in the order listed (default: rtt).\n");
+    fprintf(stderr, "  --metrics-socket <path>\n");
+    fprintf(stderr, "                      Serve Prometheus metrics on this Unix socket. SIGUSR1 prints them to stderr.\n");
+    fprintf(stderr, "  --control-socket <path>\n");
+    fprintf(stderr, "                      Accept status, add, remove and check requests on this Unix socket,\n");
+    fprintf(stderr, "                      one line per connection (send \"help\" for the list).\n");
+    fprintf(stderr, "  --config <path>     Also monitor the devices listed in this file, one \"<host>:<busid> [setting=value ...]\"\n");
+    fprintf(stderr, "                      per line, with settings named after the options above. SIGHUP rereads it.\n");
+    fprintf(stderr, "  --log-level <level> Least severe messages to log: error, warn, info or debug (default: info).\n");
+    fprintf(stderr, "  --log-format <text|json>\n");
+    fprintf(stderr, "                      Log plain timestamped lines or one JSON object per line (default: text).\n");
+    fprintf(stderr, "  -v, --verbose       Enable detailed logging to stderr, same as --log-level debug.\n");
     fprintf(stderr, "  --version           Print version information and exit.\n");
     fprintf(stderr, "  -h, --help          Show this help message and exit.\n");
 }
 
-/* Device status constants */
-#define STATUS_UNKNOWN       0
-#define STATUS_ATTACHED      1
-#define STATUS_NOT_ATTACHED  2
-#define STATUS_NOT_AVAILABLE 3
-#define STATUS_AVAILABLE     4
-#define STATUS_ATTACH_FAIL   5
-#define STATUS_ATTACH_SUCCESS 6
+/* Log level for a status message: shown when the status is new, repeated only when debugging */
+static int status_log_level(const Target* target, int status) {
+    return target->last_status != status ? LOG_LEVEL_INFO : LOG_LEVEL_DEBUG;
+}
+
+/* Record the outcome of a check of a target and schedule its next one */
+static void finish_check(Target* target, int index, int current_status, int status_changed) {
+    int delay_ms;
+    
+    metrics_set_status(&metrics, index, current_status, scheduler_now_ms());
+    
+    /* Remember the last status */
+    if (current_status != target->last_status) {
+        if (!status_changed && current_status == STATUS_ATTACHED) {
+            /* Print attachment status change if not already printed */
+            log_info("Device %s is now attached.", target->identifier);
+        }
+        
+        /* Update last status */
+        target->last_status = current_status;
+        target->status_since = time(NULL);
+    }
+    
+    /* Schedule the next check of this device */
+    if (current_status == STATUS_ATTACHED || current_status == STATUS_ATTACH_SUCCESS) {
+        delay_ms = scheduler_next_delay(&target->policy, &target->schedule, SCHED_ATTACHED);
+    } else {
+        delay_ms = scheduler_next_delay(&target->policy, &target->schedule, SCHED_FAILED);
+    }
+    target->next_check_ms = scheduler_now_ms() + delay_ms;
+    log_debug("Next check of %s in %d ms", target->identifier, delay_ms);
+}
+
+/* Give a target the global tunables, overridden by its config file settings
+ * if any. The target keeps its own random stream, so jitter stays independent. */
+static void apply_settings(Target* target, const ConfigTarget* settings) {
+    uint32_t rng = target->policy.rng;
+    
+    target->policy = scheduler;
+    target->policy.rng = rng;
+    target->command_timeout_ms = 0;
+    if (settings) {
+        if (settings->interval_ms != CONFIG_UNSET) {
+            target->policy.interval_ms = settings->interval_ms;
+            if (attached_follows_interval) {
+                target->policy.attached_ms = settings->interval_ms;
+            }
+        }
+        if (settings->attached_ms != CONFIG_UNSET) {
+            target->policy.attached_ms = settings->attached_ms;
+        }
+        if (settings->max_backoff_ms != CONFIG_UNSET) {
+            target->policy.max_backoff_ms = settings->max_backoff_ms;
+        }
+        if (settings->fast_retry_ms != CONFIG_UNSET) {
+            target->policy.fast_retry_ms = settings->fast_retry_ms;
+        }
+        if (settings->fast_retries != CONFIG_UNSET) {
+            target->policy.fast_retries = settings->fast_retries;
+        }
+        if (settings->jitter_percent != CONFIG_UNSET) {
+            target->policy.jitter_percent = settings->jitter_percent;
+        }
+        if (settings->command_timeout_ms != CONFIG_UNSET) {
+            target->command_timeout_ms = settings->command_timeout_ms;
+        }
+    }
+    
+    /* The host in use of a device several hosts export is probed at each check while
+     * attached, so failing over from one that went silent takes at most an interval */
+    if (target->host_count > 1 && target->policy.attached_ms > target->policy.interval_ms) {
+        target->policy.attached_ms = target->policy.interval_ms;
+    }
+}
+
+/* Give back a target's hold on the sessions of its hosts */
+static void release_sessions(Target* target) {
+    int h;
+    
+    for (h = 0; h < target->host_count; h++) {
+        session_put(target->hosts[h]);
+    }
+    target->host_count = 0;
+    target->session = NULL;
+}
+
+/* Get a target in slot t ready for its first check, due at once.
+ * Returns 0 on success, or -1 with a reason if its host can't get a session. */
+static int setup_target(Target* target, int t, const ConfigTarget* settings, const char** error) {
+    char hosts[CONFIG_MAX_HOSTS][CONFIG_HOST_MAX];
+    int count;
+    int h;
+    
+    target->host_count = 0;
+    target->session = NULL;
+    count = config_split_hosts(target->host_ip, hosts);
+    if (count < 0) {
+        *error = "malformed list of hosts";
+        return -1;
+    }
+    for (h = 0; h < count; h++) {
+        target->hosts[h] = session_get(&sessions, hosts[h]);
+        if (!target->hosts[h]) {
+            release_sessions(target);
+            *error = "too many hosts";
+            return -1;
+        }
+        target->host_count++;
+    }
+    target->session = target->hosts[0];
+    target->failed_host = -1;
+    scheduler_derive(&scheduler, &target->policy);
+    apply_settings(target, settings);
+    target->next_check_ms = 0;
+    metrics_set_target(&metrics, t, target->host_ip, target->identifier);
+    log_info("Monitoring host %s for %s: %s", target->host_ip,
+             target->is_busid ? "BUSID" : "Device ID", target->identifier);
+    return 0;
+}
+
+/* Start monitoring a target in the first free slot.
+ * Returns its index, or -1 with a reason if there is no room. */
+static int add_target(Args* args, const Target* wanted, const ConfigTarget* settings, const char** error) {
+    int t = 0;
+    
+    while (t < args->target_count && !args->targets[t].removed) {
+        t++;
+    }
+    if (t == MAX_TARGETS) {
+        *error = "too many devices";
+        return -1;
+    }
+    args->targets[t] = *wanted;
+    if (setup_target(&args->targets[t], t, settings, error) < 0) {
+        args->targets[t].removed = 1;
+        return -1;
+    }
+    if (t == args->target_count) {
+        args->target_count++;
+    }
+    return t;
+}
+
+/* Stop monitoring a target; an attached device stays attached */
+static void remove_target(Args* args, EventWatcher* watcher, int t) {
+    Target* target = &args->targets[t];
+    
+    events_watch_socket(watcher, t, -1);
+    metrics_remove_target(&metrics, t);
+    release_sessions(target);
+    target->removed = 1;
+    log_info("Stopped monitoring host %s for %s", target->host_ip, target->identifier);
+}
+
+/* Everything a control request may look at or change */
+typedef struct {
+    Args* args;
+    EventWatcher* watcher;
+} ControlContext;
+
+/* Find a monitored target with the same host and identifier, -1 if none */
+static int find_target(const Args* args, const Target* wanted) {
+    int t;
+    
+    for (t = 0; t < args->target_count; t++) {
+        const Target* target = &args->targets[t];
+        if (!target->removed && target->is_busid == wanted->is_busid &&
+            strcmp(target->host_ip, wanted->host_ip) == 0 && strcmp(target->identifier, wanted->identifier) == 0) {
+            return t;
+        }
+    }
+    return -1;
+}
+
+/* Append one target's state, from memory only, as a line of key=value pairs */
+static void reply_target_status(const Target* target, ControlReply* reply, long long now_ms) {
+    char since[32] = "-";
+    long long next_ms = target->next_check_ms > now_ms ? target->next_check_ms - now_ms : 0;
+    /* A single IPv6 host is bracketed; lists keep the brackets they were given */
+    int bracket = strchr(target->host_ip, ':') && !strchr(target->host_ip, ',');
+    
+    if (target->status_since) {
+        strftime(since, sizeof(since), "%Y-%m-%dT%H:%M:%S%z", localtime(&target->status_since));
+    }
+    control_printf(reply, "target=%s%s%s:%s%s status=%s since=%s next_check_ms=%lld",
+                   bracket ? "[" : "", target->host_ip, bracket ? "]" : "",
+                   target->is_busid ? "" : "devid=", target->identifier,
+                   status_names[target->last_status], since, next_ms);
+    if (target->host_count > 1) {
+        control_printf(reply, " host=%s rtt_ms=%.1f", target->session->host, target->session->rtt_us / 1000.0);
+    }
+    control_printf(reply, "\n");
+}
+
+/* Start monitoring a target; it is checked at once, as the loop wakes up for
+ * the next due target */
+static void control_add(ControlContext* ctx, const Target* wanted, ControlReply* reply) {
+    const char* error;
+    int t;
+    
+    if (find_target(ctx->args, wanted) >= 0) {
+        control_printf(reply, "error: already monitored\n");
+        return;
+    }
+    t = add_target(ctx->args, wanted, NULL, &error);
+    if (t < 0) {
+        control_printf(reply, "error: %s\n", error);
+        return;
+    }
+    ctx->args->targets[t].from_control = 1;
+    control_printf(reply, "ok\n");
+}
+
+/* Stop monitoring a target; an attached device stays attached */
+static void control_remove(ControlContext* ctx, int t, ControlReply* reply) {
+    remove_target(ctx->args, ctx->watcher, t);
+    control_printf(reply, "ok\n");
+}
+
+/* Answer one control socket request. Nothing here runs usbip or touches the
+ * network; changes take effect at the next cycle. */
+static void handle_control(const char* command, const char* argument, ControlReply* reply, void* ctx_ptr) {
+    ControlContext* ctx = ctx_ptr;
+    Args* args = ctx->args;
+    long long now_ms = scheduler_now_ms();
+    Target wanted;
+    int t = -1;
+    
+    if (strcmp(command, "help") == 0 || command[0] == '\0') {
+        control_printf(reply,
+                       "status [<host>:<busid>]   state of every device, or of one\n"
+                       "add <host>:<busid>        start monitoring a device\n"
+                       "remove <host>:<busid>     stop monitoring a device, leaving it attached\n"
+                       "check [<host>:<busid>]    check every device, or one, right away\n"
+                       "Use <host>:devid=<devid> for a device ID.\n");
+        return;
+    }
+    if (strcmp(command, "status") != 0 && strcmp(command, "add") != 0 &&
+        strcmp(command, "remove") != 0 && strcmp(command, "check") != 0) {
+        control_printf(reply, "error: unknown command %s\n", command);
+        return;
+    }
+    
+    /* Every command takes a target; status and check may leave it out */
+    if (argument[0] || strcmp(command, "add") == 0 || strcmp(command, "remove") == 0) {
+        if (!parse_target_spec(argument, &wanted)) {
+            control_printf(reply, "error: expected <host>:<busid> or <host>:devid=<devid>\n");
+            return;
+        }
+        if (strcmp(command, "add") == 0) {
+            control_add(ctx, &wanted, reply);
+            return;
+        }
+        t = find_target(args, &wanted);
+        if (t < 0) {
+            control_printf(reply, "error: not monitored\n");
+            return;
+        }
+    }
+    
+    if (strcmp(command, "remove") == 0) {
+        control_remove(ctx, t, reply);
+    } else if (strcmp(command, "status") == 0) {
+        int i;
+        for (i = 0; i < args->target_count; i++) {
+            if (!args->targets[i].removed && (t < 0 || i == t)) {
+                reply_target_status(&args->targets[i], reply, now_ms);
+            }
+        }
+    } else {
+        int i;
+        for (i = 0; i < args->target_count; i++) {
+            if (!args->targets[i].removed && (t < 0 || i == t)) {
+                args->targets[i].next_check_ms = 0;
+            }
+        }
+        port_cache_invalidate(&ports);
+        log_debug("Immediate check requested over the control socket");
+        control_printf(reply, "ok\n");
+    }
+}
+
+/* Bring the devices from the config file in line with what it lists now.
+ * Devices still listed keep their state and schedule and only pick up new
+ * settings, so an edit to one line leaves the rest undisturbed. A device the
+ * file no longer lists is only dropped if neither the command line nor the
+ * control socket asked for it too. Returns 0 on success, or -1 with the
+ * devices left as they were if the file is broken. */
+static int load_config(Args* args, EventWatcher* watcher) {
+    static Config config;
+    char error[256];
+    int added = 0;
+    int removed = 0;
+    int updated = 0;
+    int t;
+    int i;
+    
+    if (config_load(args->config_path, &config, error, sizeof(error)) < 0) {
+        log_error("Error: Cannot load config file %s: %s", args->config_path, error);
+        return -1;
+    }
+    
+    /* Drop the devices the file no longer lists */
+    for (t = 0; t < args->target_count; t++) {
+        Target* target = &args->targets[t];
+        ConfigTarget device;
+        
+        if (target->removed || !target->from_config) {
+            continue;
+        }
+        memcpy(device.host, target->host_ip, sizeof(device.host));
+        memcpy(device.identifier, target->identifier, sizeof(device.identifier));
+        device.is_busid = target->is_busid;
+        if (config_find(&config, &device) >= 0) {
+            continue;
+        }
+        target->from_config = 0;
+        if (!target->from_command_line && !target->from_control) {
+            remove_target(args, watcher, t);
+            removed++;
+        }
+    }
+    
+    /* Update the rest in place and add the new ones */
+    for (i = 0; i < config.count; i++) {
+        const char* reason;
+        Target wanted;
+        
+        target_from_config(&config.targets[i], &wanted);
+        t = find_target(args, &wanted);
+        if (t >= 0) {
+            apply_settings(&args->targets[t], &config.targets[i]);
+            args->targets[t].from_config = 1;
+            updated++;
+            continue;
+        }
+        t = add_target(args, &wanted, &config.targets[i], &reason);
+        if (t < 0) {
+            log_error("Error: Cannot monitor %s on host %s: %s", wanted.identifier, wanted.host_ip, reason);
+            continue;
+        }
+        args->targets[t].from_config = 1;
+        added++;
+    }
+    log_info("Loaded %s: %d devices added, %d removed, %d kept", args->config_path, added, removed, updated);
+    return 0;
+}
+
+/* Check whether the last wait saw the removal of a target's virtual device.
+ * Without a known local busid, as right after an attach, any removal counts. */
+static int uevent_removed(const EventWatcher* watcher, const Target* target) {
+    int i;
+    
+    if (watcher->removed_overflow || (target->local_busid[0] == '\0' && watcher->removed_count > 0)) {
+        return 1;
+    }
+    for (i = 0; i < watcher->removed_count; i++) {
+        if (strcmp(watcher->removed[i], target->local_busid) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Sleep until the earliest device is due. Attached devices are checked rarely
+ * since the kernel reports anything that could be a detach, which makes them
+ * due at once. Signals interrupt the wait. */
+void wait_for_next_check(Args* args, EventWatcher* watcher) {
+    ControlContext control_ctx = {args, watcher};
+    long long next_ms = -1;
+    long long now_ms;
+    int timeout_ms = -1;
+    int reasons;
+    int t;
+    
+    if (!keep_running) {
+        return;
+    }
+    
+    for (t = 0; t < args->target_count; t++) {
+        if (!args->targets[t].removed && (next_ms < 0 || args->targets[t].next_check_ms < next_ms)) {
+            next_ms = args->targets[t].next_check_ms;
+        }
+    }
+    now_ms = scheduler_now_ms();
+    if (next_ms >= 0) {
+        timeout_ms = next_ms > now_ms ? (int)(next_ms - now_ms) : 0;
+    }
+    
+    /* Write out this cycle's messages in one go before sleeping; with every
+     * device removed, only a signal or a control request ends the wait */
+    log_flush();
+    reasons = events_wait(watcher, timeout_ms);
+    if (reasons & EVENT_LISTENER) {
+        metrics_serve(&metrics, scheduler_now_ms());
+        control_serve(&control, handle_control, &control_ctx);
+        reasons &= ~EVENT_LISTENER;
+    }
+    if (!reasons) {
+        return;
+    }
+    log_debug("Woken by%s%s%s",
+              (reasons & EVENT_UEVENT) ? " uevent" : "",
+              (reasons & EVENT_RECORD_CHANGED) ? " port record change" : "",
+              (reasons & EVENT_SOCKET_CLOSED) ? " connection shutdown" : "");
+    port_cache_invalidate(&ports);
+    for (t = 0; t < args->target_count; t++) {
+        Target* target = &args->targets[t];
+        
+        /* A uevent alone names the device that went away; leave the others be */
+        if (!target->removed &&
+            (target->last_status == STATUS_ATTACHED || target->last_status == STATUS_ATTACH_SUCCESS) &&
+            (reasons != EVENT_UEVENT || uevent_removed(watcher, target))) {
+            target->next_check_ms = 0;
+        }
+    }
+}
 
-/* Main function */
 int main(int argc, char* argv[]) {
     Args args;
     char usbip_exec_path[MAX_PATH_LEN] = {0};
-    int last_status = STATUS_UNKNOWN;
-    char timestamp[32] = {0};
-    time_t now;
-    struct tm *tm_info;
+    EventWatcher watcher;
+    static WorkPool attach_pool;
+    struct sigaction sa;
+    int exit_code = 0;
+    int t;
     
     /* Parse command-line arguments */
     parse_args(argc, argv, &args);
@@ -460,155 +1642,327 @@ int main(int argc, char* argv[]) {
     }
     
     /* Validate arguments */
-    if (args.host_ip[0] == '\0' || (!args.has_busid && !args.has_device)) {
-        fprintf(stderr, "Internal error: Missing host_ip or busid/device after parsing.\n");
+    if (args.target_count == 0 && !args.config_path[0]) {
+        fprintf(stderr, "Internal error: No device to monitor after parsing.\n");
         print_usage(argv[0]);
         return 1;
     }
     
+    /* Everything from here on goes through the log */
+    log_init(args.log_level, args.log_format, STDERR_FILENO);
+    
     /* Find usbip executable */
-    if (!find_usbip(args.usbip_path, usbip_exec_path, sizeof(usbip_exec_path))) {
-        fprintf(stderr, "Error: Could not find usbip executable. Please specify with --usbip-path or ensure it's in PATH.\n");
+    if (resolver_init(&usbip_binary, "usbip", args.usbip_path) < 0 ||
+        !resolver_copy(&usbip_binary, usbip_exec_path, sizeof(usbip_exec_path))) {
+        log_error("Error: Could not find usbip executable. Please specify with --usbip-path or ensure it's in PATH.");
         return 1;
     }
     
-    /* Print initial status information */
-    if (args.has_busid) {
-        fprintf(stderr, "Monitoring host %s for BUSID: %s\n", args.host_ip, args.busid);
+    log_debug("Using usbip executable: %s", usbip_exec_path);
+    log_debug("Logging at debug level");
+    
+    /* Setup signal handling. The handler stays installed after it fires, and without
+     * SA_RESTART a signal cuts the wait for the next check short. */
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGUSR1, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+    
+    /* Bound every command and network exchange; a signal abandons them early */
+    command_timeout_ms = args.command_timeout * 1000;
+    attach_timeout_ms = args.attach_timeout * 1000;
+    hosts_by_rtt = args.host_order_rtt;
+    runner_set_keep_running(&keep_running);
+    usbip_net_set_timeout(args.network_timeout * 1000);
+    usbip_net_set_keep_running(&keep_running);
+    usbip_net_set_keepalive(args.keepalive);
+    
+    /* One session per host, so devices sharing a host share its listing */
+    devlist_ttl_ms = args.devlist_ttl * 1000;
+    session_table_init(&sessions);
+    
+    /* Reads of the local ports within a second of each other share one result */
+    port_cache_init(&ports, PORT_CACHE_DEFAULT_MAX_AGE_MS, read_ports, usbip_exec_path);
+    
+    /* Let the loop benchmark stand in a fake vhci tree for the real one */
+    if (getenv("USBIP_AUTO_ATTACH_VHCI_DIR") || getenv("USBIP_AUTO_ATTACH_RECORD_DIR")) {
+        vhci_set_paths(getenv("USBIP_AUTO_ATTACH_VHCI_DIR"), getenv("USBIP_AUTO_ATTACH_RECORD_DIR"));
+    }
+    
+    /* Kernel notification sources for noticing a detach without polling */
+    if (args.poll_only) {
+        events_init_disabled(&watcher);
     } else {
-        fprintf(stderr, "Monitoring host %s for Device ID: %s\n", args.host_ip, args.device);
+        events_open(&watcher, vhci_record_dir());
+        log_debug("Event-driven detach detection: uevent %s, inotify %s",
+                  watcher.uevent_fd >= 0 ? "on" : "off", watcher.inotify_fd >= 0 ? "on" : "off");
+    }
+    
+    /* Per-device check times: slow while attached, backing off while unavailable */
+    scheduler_init(&scheduler, (uint32_t)getpid() ^ (uint32_t)time(NULL));
+    scheduler.interval_ms = args.interval * 1000;
+    scheduler.max_backoff_ms = args.max_backoff * 1000;
+    scheduler.fast_retry_ms = args.fast_retry_delay;
+    scheduler.fast_retries = args.fast_retries;
+    scheduler.jitter_percent = args.jitter;
+    if (args.attached_interval > 0) {
+        scheduler.attached_ms = args.attached_interval * 1000;
+    } else if (!events_can_detect(&watcher)) {
+        /* Without notifications, polling is the only way to notice a detach */
+        scheduler.attached_ms = args.interval * 1000;
+        attached_follows_interval = 1;
     }
     
-    if (args.verbose) {
-        fprintf(stderr, "Using usbip executable: %s\n", usbip_exec_path);
-        fprintf(stderr, "Running in verbose mode\n");
+    /* Counters for the metrics socket and SIGUSR1 dumps */
+    metrics_init(&metrics, status_names, STATUS_COUNT, scheduler_now_ms());
+    
+    /* Devices from the command line, then those from the config file */
+    for (t = 0; t < args.target_count; t++) {
+        const char* error;
+        
+        if (setup_target(&args.targets[t], t, NULL, &error) < 0) {
+            log_error("Error: Cannot monitor %s on host %s: %s", args.targets[t].identifier, args.targets[t].host_ip, error);
+            return 1;
+        }
+        args.targets[t].from_command_line = 1;
+    }
+    if (args.config_path[0] && load_config(&args, &watcher) < 0) {
+        return 1;
     }
     
-    /* Setup signal handling using standard signal() */
-    signal(SIGINT, signal_handler);
-    signal(SIGTERM, signal_handler);
+    /* Attaches and host checks run side by side, so a host-wide outage recovers in about one
+     * attach time and a host that doesn't answer delays the others by one deadline at most */
+    if (pool_start(&attach_pool, args.attach_workers, args.host_attach_limit) < 0) {
+        log_error("Error: Cannot start the attach workers.");
+        return 1;
+    }
+    pool_set_keep_running(&attach_pool, &keep_running, SIGUSR2);
+    
+    if (args.metrics_socket[0]) {
+        if (metrics_listen(&metrics, args.metrics_socket) < 0) {
+            log_error("Error: Cannot listen on metrics socket %s: %s", args.metrics_socket, strerror(errno));
+            return 1;
+        }
+        events_watch_listener(&watcher, LISTENER_METRICS, metrics.listen_fd);
+    }
+    control_init(&control);
+    if (args.control_socket[0]) {
+        if (control_listen(&control, args.control_socket) < 0) {
+            log_error("Error: Cannot listen on control socket %s: %s", args.control_socket, strerror(errno));
+            return 1;
+        }
+        events_watch_listener(&watcher, LISTENER_CONTROL, control.listen_fd);
+    }
     
     /* Main loop */
     while (keep_running) {
-        int current_status;
-        int currently_attached = 0;
-        int available = 0;
-        const char* identifier = args.has_busid ? args.busid : args.device; /* Should always have one */
-        int check_by_busid = args.has_busid;
-        int status_changed = 0;
+        int attached[MAX_TARGETS] = {0};
+        int needs_list[MAX_TARGETS] = {0};
+        int needs_probe[MAX_TARGETS];
+        int available[MAX_TARGETS] = {0};
+        int due[MAX_TARGETS] = {0};
+        int attaching[MAX_TARGETS] = {0};
+        AttachJob jobs[MAX_TARGETS];
+        int any_due = 0;
+        int any_probe = 0;
+        long long now_ms;
         
-        /* Generate timestamp for logs */
-        now = time(NULL);
-        tm_info = localtime(&now);
-        strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", tm_info);
+        /* Between cycles, so no check or attach is cut short by the reload */
+        if (reload_requested) {
+            reload_requested = 0;
+            if (args.config_path[0] && load_config(&args, &watcher) < 0) {
+                log_warn("Keeping the devices from before the reload");
+            }
+        }
         
-        /* Check device status by running `usbip port` */
-        {
-            const char* port_args[2] = {usbip_exec_path, "port"};
-            CommandResult result = run_command(port_args, 2, args.verbose);
-            
-            if (result.success) {
-                currently_attached = parse_usbip_port(result.output, identifier, check_by_busid);
-            } else if (args.verbose) {
-                fprintf(stderr, "%s Error checking device attachment (running usbip port): Command failed\n", timestamp);
+        now_ms = scheduler_now_ms();
+        for (t = 0; t < args.target_count; t++) {
+            if (!args.targets[t].removed && args.targets[t].next_check_ms <= now_ms) {
+                due[t] = 1;
+                any_due = 1;
             }
-            
-            free(result.output);
+        }
+        if (dump_metrics) {
+            dump_metrics = 0;
+            log_flush();
+            metrics_dump(&metrics, now_ms, stderr);
+        }
+        if (!any_due) {
+            wait_for_next_check(&args, &watcher);
+            continue;
         }
         
-        if (currently_attached) {
-            current_status = STATUS_ATTACHED;
-            
-            if (args.verbose) {
-                fprintf(stderr, "%s Device %s is attached.\n", timestamp, identifier);
+        /* Pick up a new usbip path found after a failed run */
+        resolver_copy(&usbip_binary, usbip_exec_path, sizeof(usbip_exec_path));
+        
+        /* One look at the local ports answers for every target; the slot of a removed
+         * one may hold a target that never got its sessions */
+        if (port_cache_refresh(&ports, now_ms)) {
+            for (t = 0; t < args.target_count; t++) {
+                attached[t] = !args.targets[t].removed && find_attached(&args.targets[t], now_ms);
             }
         } else {
-            /* First check - Not attached */
-            current_status = STATUS_NOT_ATTACHED;
-            
-            /* Log when a device transitions from attached to detached */
-            if (last_status == STATUS_ATTACHED) {
-                fprintf(stderr, "%s Device %s is now detached.\n", timestamp, identifier);
-                status_changed = 1;
-            } else if (args.verbose) {
-                fprintf(stderr, "%s Device %s not attached.\n", timestamp, identifier);
+            log_debug("Error checking device attachment (running usbip port): Command failed");
+        }
+        
+        /* A device that several hosts export is only as attached as its host is alive */
+        for (t = 0; t < args.target_count; t++) {
+            needs_probe[t] = !args.targets[t].removed && due[t] && attached[t] && args.targets[t].host_count > 1;
+            any_probe |= needs_probe[t];
+        }
+        if (any_probe) {
+            probe_hosts_in_use(args.targets, args.target_count, needs_probe, attached, &attach_pool);
+        }
+        
+        /* Only check availability if using BUSID, as 'usbip list' uses BUSID */
+        for (t = 0; t < args.target_count; t++) {
+            needs_list[t] = 0;
+            if (!args.targets[t].removed && due[t] && !attached[t] && args.targets[t].is_busid) {
+                needs_list[t] = 1;
+                log_debug("Checking availability for BUSID %s...", args.targets[t].identifier);
             }
+        }
+        check_availability(args.targets, args.target_count, needs_list, available,
+                           usbip_exec_path, !args.no_native, &attach_pool);
+        
+        for (t = 0; t < args.target_count && keep_running; t++) {
+            Target* target = &args.targets[t];
+            const char* identifier = target->identifier;
+            int current_status;
+            int status_changed = 0;
             
-            /* Only check availability if using BUSID, as 'usbip list' uses BUSID */
-            if (check_by_busid) {
-                if (args.verbose) {
-                    fprintf(stderr, "%s Checking availability for BUSID %s...\n", timestamp, args.busid);
-                }
-                
-                const char* list_args[4] = {usbip_exec_path, "list", "-r", args.host_ip};
-                CommandResult list_result = run_command(list_args, 4, args.verbose);
-                
-                available = parse_usbip_list(list_result.output, args.busid);
-                free(list_result.output);
-            } else {
-                /* We assume device is potentially available if specified by ID */
-                available = 1;
-                if (args.verbose) {
-                    fprintf(stderr, "%s Availability check skipped when using Device ID.\n", timestamp);
-                }
+            if (!due[t]) {
+                continue;
             }
             
-            if (available) {
-                current_status = STATUS_AVAILABLE;
+            if (attached[t]) {
+                current_status = STATUS_ATTACHED;
+                log_debug("Device %s is attached.", identifier);
+            } else {
+                /* First check - Not attached */
+                current_status = STATUS_NOT_ATTACHED;
                 
-                /* Always show when a device becomes available */
-                if (last_status != STATUS_AVAILABLE) {
-                    fprintf(stderr, "%s Device %s is available. Attempting to attach...\n", timestamp, identifier);
+                /* Log when a device transitions from attached to detached */
+                if (target->last_status == STATUS_ATTACHED) {
+                    log_info("Device %s is now detached.", identifier);
+                    /* The host's listing may have changed along with it */
+                    session_invalidate(target->session);
                     status_changed = 1;
-                } else if (args.verbose) {
-                    fprintf(stderr, "%s Device %s is available. Attempting to attach...\n", timestamp, identifier);
+                } else {
+                    log_debug("Device %s not attached.", identifier);
                 }
                 
-                if (attach_device(args.host_ip, args.has_busid ? args.busid : NULL, 
-                                 args.has_device ? args.device : NULL, 
-                                 usbip_exec_path, args.verbose)) {
-                    current_status = STATUS_ATTACH_SUCCESS;
-                    fprintf(stderr, "%s Attach command for device %s succeeded.\n", timestamp, identifier);
-                } else {
-                    /* Don't print generic failure message if attach_device exited due to vhci error */
-                    if (errno != ECANCELED) {
-                        current_status = STATUS_ATTACH_FAIL;
-                        fprintf(stderr, "%s Failed to attach device %s\n", timestamp, identifier);
+                /* Retry quickly at first, the host is likely just re-exporting it */
+                if (target->last_status == STATUS_ATTACHED || target->last_status == STATUS_ATTACH_SUCCESS) {
+                    scheduler_note_detach(&target->policy, &target->schedule);
+                }
+                
+                if (!target->is_busid) {
+                    int usable[CONFIG_MAX_HOSTS];
+                    int h;
+                    
+                    /* We assume device is potentially available if specified by ID, on any of its hosts not known to be down */
+                    for (h = 0; h < target->host_count; h++) {
+                        usable[h] = target->host_count == 1 || target->hosts[h]->alive != 0;
                     }
+                    available[t] = pick_host(target, usable, target->host_count);
+                    log_debug("Availability check skipped when using Device ID.");
                 }
-            } else {
-                /* This block only reached if check_by_busid was true and device wasn't available */
-                current_status = STATUS_NOT_AVAILABLE;
                 
-                /* Always show when a device is not available (status change) */
-                if (last_status != STATUS_NOT_AVAILABLE) {
-                    fprintf(stderr, "%s Device BUSID %s is not available on host %s\n", 
-                            timestamp, identifier, args.host_ip);
-                    status_changed = 1;
-                } else if (args.verbose) {
-                    fprintf(stderr, "%s Device BUSID %s is not available on host %s\n", 
-                            timestamp, identifier, args.host_ip);
+                if (available[t] < 0) {
+                    current_status = STATUS_TIMEOUT;
+                    status_changed = target->last_status != current_status;
+                    log_write(status_log_level(target, current_status),
+                              "Timed out checking availability of %s on host %s", identifier, target->host_ip);
+                } else if (available[t]) {
+                    /* Always show when a device becomes available */
+                    log_write(status_log_level(target, STATUS_AVAILABLE),
+                              "Device %s is available. Attempting to attach...", identifier);
+                    
+                    /* Finished below, once every attach of this cycle is done */
+                    jobs[t].target = target;
+                    jobs[t].usbip_path = usbip_exec_path;
+                    jobs[t].native = !args.no_native;
+                    jobs[t].imported_fd = -1;
+                    attaching[t] = 1;
+                    if (pool_submit(&attach_pool, target->session->host, run_attach_job, &jobs[t]) < 0) {
+                        run_attach_job(&jobs[t]);
+                    }
+                    continue;
+                } else {
+                    /* This block only reached if the target uses a BUSID and the device wasn't available */
+                    current_status = STATUS_NOT_AVAILABLE;
+                    
+                    /* Always show when a device is not available (status change) */
+                    status_changed = target->last_status != current_status;
+                    log_write(status_log_level(target, current_status),
+                              "Device BUSID %s is not available on host %s", identifier, target->host_ip);
                 }
             }
+            
+            finish_check(target, t, current_status, status_changed);
         }
         
-        /* Remember the last status */
-        if (current_status != last_status) {
-            if (!status_changed && current_status == STATUS_ATTACHED) {
-                /* Print attachment status change if not already printed */
-                fprintf(stderr, "%s Device %s is now attached.\n", timestamp, identifier);
+        /* Attaches run in parallel; take their results in target order */
+        pool_wait(&attach_pool);
+        for (t = 0; t < args.target_count; t++) {
+            Target* target = &args.targets[t];
+            int current_status = STATUS_AVAILABLE;
+            int h;
+            
+            if (!attaching[t]) {
+                continue;
+            }
+            
+            if (jobs[t].attached > 0) {
+                current_status = STATUS_ATTACH_SUCCESS;
+                log_info("Attach command for device %s succeeded.", target->identifier);
+                target->failed_host = -1;
+            } else if (jobs[t].attached < 0) {
+                /* No attach can work without vhci_hcd; stop once this cycle is wound up */
+                exit_code = 2;
+            } else {
+                /* Don't print generic failure message for attaches dropped at shutdown */
+                if (jobs[t].error != ECANCELED) {
+                    current_status = STATUS_ATTACH_FAIL;
+                    log_warn("Failed to attach device %s", target->identifier);
+                    /* The listing that offered the device is stale; next time try another host if there is one */
+                    session_invalidate(target->session);
+                    for (h = 0; h < target->host_count; h++) {
+                        if (target->hosts[h] == target->session) {
+                            target->failed_host = h;
+                        }
+                    }
+                }
             }
             
-            /* Update last status */
-            last_status = current_status;
+            /* Keep the imported connection around to notice its shutdown */
+            if (jobs[t].imported_fd >= 0) {
+                if (current_status == STATUS_ATTACH_SUCCESS && !args.poll_only) {
+                    events_watch_socket(&watcher, t, jobs[t].imported_fd);
+                } else {
+                    close(jobs[t].imported_fd);
+                }
+            }
+            
+            finish_check(target, t, current_status, 0);
         }
-        
-        /* Wait before checking again, checking keep_running more frequently */
-        for (int i = 0; i < 5 && keep_running; i++) {
-            sleep(1);
+        if (exit_code) {
+            break;
         }
+        
+        wait_for_next_check(&args, &watcher);
     }
     
-    fprintf(stderr, "Exiting due to signal.\n");
-    return 0;
+    pool_stop(&attach_pool);
+    events_close(&watcher);
+    metrics_close(&metrics);
+    control_close(&control);
+    if (!exit_code) {
+        log_info("Exiting due to signal.");
+    }
+    return exit_code;
 }
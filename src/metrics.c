@@ -0,0 +1,429 @@
+#define _GNU_SOURCE
+#include "metrics.h"
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+// Room for the rendered text of a full table of devices
+#define METRICS_TEXT_SIZE 524288
+// How long a client may take to send its request before it gets the bare text
+#define METRICS_REQUEST_WAIT_MS 100
+// Send timeout for a client that doesn't read its answer
+#define METRICS_SEND_TIMEOUT_MS 1000
+#define METRICS_PREFIX "usbip_auto_attach_"
+
+// Upper bounds of the finite buckets in microseconds, matching bucket_labels
+static const long long bucket_bounds_us[METRICS_BUCKETS - 1] = {
+    1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+    1000000, 2500000, 5000000, 10000000, 30000000
+};
+static const char* const bucket_labels[METRICS_BUCKETS] = {
+    "0.001", "0.0025", "0.005", "0.01", "0.025", "0.05", "0.1", "0.25", "0.5",
+    "1", "2.5", "5", "10", "30", "+Inf"
+};
+static const char* const op_names[METRICS_OPS] = {
+    "port", "list", "attach", "native_list", "native_attach", "sysfs_ports", "native_probe", "attach_settle"
+};
+
+// Guards the counters; attach workers update them from their own threads
+static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Rendered text shared by metrics_dump() and metrics_serve()
+static char text[METRICS_TEXT_SIZE];
+
+// Output cursor with snprintf() semantics: len keeps counting past size
+typedef struct {
+    char* buf;
+    size_t size;
+    size_t len;
+} TextOut;
+
+static void append(TextOut* out, const char* fmt, ...) {
+    va_list ap;
+    size_t room = out->len < out->size ? out->size - out->len : 0;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(room ? out->buf + out->len : NULL, room, fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        out->len += (size_t)n;
+    }
+}
+
+void metrics_init(Metrics* metrics, const char* const* status_names, int status_count, long long now_ms) {
+    memset(metrics, 0, sizeof(*metrics));
+    metrics->status_names = status_names;
+    metrics->status_count = status_count < METRICS_MAX_STATUS ? status_count : METRICS_MAX_STATUS;
+    metrics->start_ms = now_ms;
+    metrics->listen_fd = -1;
+}
+
+long long metrics_now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Helper to copy text into a label value, escaping \, " and newlines
+static void escape_label(char* dst, size_t size, const char* src) {
+    size_t len = 0;
+
+    for (; *src && len + 3 < size; src++) {
+        if (*src == '\\' || *src == '"') {
+            dst[len++] = '\\';
+            dst[len++] = *src;
+        } else if (*src == '\n') {
+            dst[len++] = '\\';
+            dst[len++] = 'n';
+        } else {
+            dst[len++] = *src;
+        }
+    }
+    dst[len] = '\0';
+}
+
+int metrics_add_target(Metrics* metrics, const char* host, const char* identifier) {
+    return metrics_set_target(metrics, metrics->target_count, host, identifier);
+}
+
+int metrics_set_target(Metrics* metrics, int index, const char* host, const char* identifier) {
+    MetricsTarget* target;
+    char name[sizeof(target->name)];
+
+    if (index < 0 || index > metrics->target_count || index >= METRICS_MAX_TARGETS) {
+        return -1;
+    }
+    snprintf(name, sizeof(name), "%s:%s", host, identifier);
+    pthread_mutex_lock(&metrics_lock);
+    target = &metrics->targets[index];
+    memset(target, 0, sizeof(*target));
+    escape_label(target->name, sizeof(target->name), name);
+    target->status = -1;
+    if (index == metrics->target_count) {
+        metrics->target_count++;
+    }
+    pthread_mutex_unlock(&metrics_lock);
+    return index;
+}
+
+void metrics_remove_target(Metrics* metrics, int index) {
+    if (index < 0 || index >= metrics->target_count) {
+        return;
+    }
+    pthread_mutex_lock(&metrics_lock);
+    memset(&metrics->targets[index], 0, sizeof(metrics->targets[index]));
+    metrics->targets[index].status = -1; // An empty name keeps it out of the text
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+void metrics_observe(Metrics* metrics, int op, long long elapsed_us) {
+    MetricsHistogram* histogram;
+    int bucket = 0;
+
+    if (op < 0 || op >= METRICS_OPS) {
+        return;
+    }
+    while (bucket < METRICS_BUCKETS - 1 && elapsed_us > bucket_bounds_us[bucket]) {
+        bucket++;
+    }
+    pthread_mutex_lock(&metrics_lock);
+    histogram = &metrics->ops[op];
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    histogram->sum_us += elapsed_us;
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+void metrics_count_spawn(Metrics* metrics, int op, int started) {
+    if (op < 0 || op >= METRICS_OPS) {
+        return;
+    }
+    pthread_mutex_lock(&metrics_lock);
+    if (started) {
+        metrics->spawns[op]++;
+    } else {
+        metrics->spawn_failures[op]++;
+    }
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+void metrics_count_attach(Metrics* metrics, int op, int success, int exit_code) {
+    MetricsAttachKind* kind;
+    int i;
+
+    pthread_mutex_lock(&metrics_lock);
+    for (i = 0; i < metrics->attach_kind_count; i++) {
+        kind = &metrics->attaches[i];
+        if (kind->op == op && kind->success == success && kind->exit_code == exit_code) {
+            kind->count++;
+            pthread_mutex_unlock(&metrics_lock);
+            return;
+        }
+    }
+    if (metrics->attach_kind_count >= METRICS_MAX_ATTACH_KINDS) {
+        metrics->attaches_dropped++;
+    } else {
+        kind = &metrics->attaches[metrics->attach_kind_count++];
+        kind->op = op;
+        kind->success = success;
+        kind->exit_code = exit_code;
+        kind->count = 1;
+    }
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+void metrics_set_status(Metrics* metrics, int target, int status, long long now_ms) {
+    MetricsTarget* entry;
+
+    if (target < 0 || target >= metrics->target_count || status < 0 || status >= metrics->status_count) {
+        return;
+    }
+    pthread_mutex_lock(&metrics_lock);
+    entry = &metrics->targets[target];
+    if (entry->status >= 0) {
+        entry->status_ms[entry->status] += now_ms - entry->since_ms;
+    }
+    entry->status = status;
+    entry->since_ms = now_ms;
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+// Helper to render the latency histograms
+static void format_histograms(const Metrics* metrics, TextOut* out) {
+    int op, bucket;
+
+    append(out, "# HELP " METRICS_PREFIX "operation_duration_seconds Time taken by usbip commands, native requests, sysfs reads and attaches to settle.\n");
+    append(out, "# TYPE " METRICS_PREFIX "operation_duration_seconds histogram\n");
+    for (op = 0; op < METRICS_OPS; op++) {
+        const MetricsHistogram* histogram = &metrics->ops[op];
+        unsigned long long cumulative = 0;
+
+        for (bucket = 0; bucket < METRICS_BUCKETS; bucket++) {
+            cumulative += histogram->buckets[bucket];
+            append(out, METRICS_PREFIX "operation_duration_seconds_bucket{operation=\"%s\",le=\"%s\"} %llu\n",
+                   op_names[op], bucket_labels[bucket], cumulative);
+        }
+        append(out, METRICS_PREFIX "operation_duration_seconds_sum{operation=\"%s\"} %.6f\n",
+               op_names[op], (double)histogram->sum_us / 1e6);
+        append(out, METRICS_PREFIX "operation_duration_seconds_count{operation=\"%s\"} %llu\n",
+               op_names[op], histogram->count);
+    }
+}
+
+// Helper to render the spawn and attach counters
+static void format_counters(const Metrics* metrics, TextOut* out) {
+    int op, i;
+
+    append(out, "# HELP " METRICS_PREFIX "process_spawns_total Processes started, by usbip command.\n");
+    append(out, "# TYPE " METRICS_PREFIX "process_spawns_total counter\n");
+    for (op = METRICS_OP_PORT; op <= METRICS_OP_ATTACH; op++) {
+        append(out, METRICS_PREFIX "process_spawns_total{command=\"%s\"} %llu\n", op_names[op], metrics->spawns[op]);
+    }
+    append(out, "# HELP " METRICS_PREFIX "process_spawn_failures_total Processes that could not be started, by usbip command.\n");
+    append(out, "# TYPE " METRICS_PREFIX "process_spawn_failures_total counter\n");
+    for (op = METRICS_OP_PORT; op <= METRICS_OP_ATTACH; op++) {
+        append(out, METRICS_PREFIX "process_spawn_failures_total{command=\"%s\"} %llu\n",
+               op_names[op], metrics->spawn_failures[op]);
+    }
+
+    append(out, "# HELP " METRICS_PREFIX "attaches_total Attach attempts by method, result and usbip attach exit code.\n");
+    append(out, "# TYPE " METRICS_PREFIX "attaches_total counter\n");
+    for (i = 0; i < metrics->attach_kind_count; i++) {
+        const MetricsAttachKind* kind = &metrics->attaches[i];
+        const char* method = kind->op == METRICS_OP_NATIVE_ATTACH ? "native" : "exec";
+        const char* result = kind->success ? "success" : "failure";
+
+        if (kind->exit_code >= 0) {
+            append(out, METRICS_PREFIX "attaches_total{method=\"%s\",result=\"%s\",exit_code=\"%d\"} %llu\n",
+                   method, result, kind->exit_code, kind->count);
+        } else {
+            append(out, METRICS_PREFIX "attaches_total{method=\"%s\",result=\"%s\"} %llu\n",
+                   method, result, kind->count);
+        }
+    }
+    append(out, "# HELP " METRICS_PREFIX "attaches_unrecorded_total Attach attempts with too many distinct outcomes to label.\n");
+    append(out, "# TYPE " METRICS_PREFIX "attaches_unrecorded_total counter\n");
+    append(out, METRICS_PREFIX "attaches_unrecorded_total %llu\n", metrics->attaches_dropped);
+}
+
+// Helper to render the per-device status time, current status included
+static void format_status(const Metrics* metrics, long long now_ms, TextOut* out) {
+    int t, status;
+
+    append(out, "# HELP " METRICS_PREFIX "status_seconds_total Time each device has spent in each status.\n");
+    append(out, "# TYPE " METRICS_PREFIX "status_seconds_total counter\n");
+    for (t = 0; t < metrics->target_count; t++) {
+        const MetricsTarget* target = &metrics->targets[t];
+
+        if (!target->name[0]) {
+            continue;
+        }
+        for (status = 0; status < metrics->status_count; status++) {
+            long long ms = target->status_ms[status];
+
+            if (status == target->status) {
+                ms += now_ms - target->since_ms;
+            }
+            if (ms > 0 || status == target->status) {
+                append(out, METRICS_PREFIX "status_seconds_total{target=\"%s\",status=\"%s\"} %.3f\n",
+                       target->name, metrics->status_names[status], (double)ms / 1000.0);
+            }
+        }
+    }
+    append(out, "# HELP " METRICS_PREFIX "status Current status of each device.\n");
+    append(out, "# TYPE " METRICS_PREFIX "status gauge\n");
+    for (t = 0; t < metrics->target_count; t++) {
+        const MetricsTarget* target = &metrics->targets[t];
+
+        if (target->status >= 0) {
+            append(out, METRICS_PREFIX "status{target=\"%s\",status=\"%s\"} 1\n",
+                   target->name, metrics->status_names[target->status]);
+        }
+    }
+}
+
+size_t metrics_format(const Metrics* metrics, long long now_ms, char* buf, size_t size) {
+    TextOut out = {buf, size, 0};
+
+    if (size) {
+        buf[0] = '\0';
+    }
+    pthread_mutex_lock(&metrics_lock);
+    append(&out, "# HELP " METRICS_PREFIX "uptime_seconds Time since the monitor started.\n");
+    append(&out, "# TYPE " METRICS_PREFIX "uptime_seconds gauge\n");
+    append(&out, METRICS_PREFIX "uptime_seconds %.3f\n", (double)(now_ms - metrics->start_ms) / 1000.0);
+    format_histograms(metrics, &out);
+    format_counters(metrics, &out);
+    format_status(metrics, now_ms, &out);
+    pthread_mutex_unlock(&metrics_lock);
+    return out.len;
+}
+
+void metrics_dump(const Metrics* metrics, long long now_ms, FILE* out) {
+    size_t len = metrics_format(metrics, now_ms, text, sizeof(text));
+
+    fwrite(text, 1, len < sizeof(text) ? len : sizeof(text) - 1, out);
+    fflush(out);
+}
+
+int metrics_listen(Metrics* metrics, const char* path) {
+    struct sockaddr_un addr;
+    mode_t old_mask;
+    int bound;
+    int fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memcpy(addr.sun_path, path, strlen(path) + 1);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    unlink(path); // Left behind by a previous run
+    // The socket file is created owner-only, so nobody else can connect at any point;
+    // a chmod after bind() would leave a window with the process umask
+    old_mask = umask(S_IXUSR | S_IRWXG | S_IRWXO);
+    bound = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+    umask(old_mask);
+    if (bound < 0 || listen(fd, 8) < 0) {
+        int saved = errno;
+        close(fd);
+        unlink(path);
+        errno = saved;
+        return -1;
+    }
+    metrics->listen_fd = fd;
+    snprintf(metrics->socket_path, sizeof(metrics->socket_path), "%s", path);
+    return 0;
+}
+
+// Helper to send the whole answer; the client gets what fits before the timeout
+static void send_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+}
+
+// Helper to answer one client
+static void answer(int fd, const Metrics* metrics, long long now_ms) {
+    struct timeval send_timeout = {0, METRICS_SEND_TIMEOUT_MS * 1000};
+    struct pollfd pfd = {fd, POLLIN, 0};
+    char request[512];
+    char header[160];
+    ssize_t n = 0;
+    size_t len;
+
+    // Give an HTTP client a moment to send its request line
+    if (poll(&pfd, 1, METRICS_REQUEST_WAIT_MS) > 0) {
+        n = recv(fd, request, sizeof(request) - 1, MSG_DONTWAIT);
+    }
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+    len = metrics_format(metrics, now_ms, text, sizeof(text));
+    if (len >= sizeof(text)) {
+        len = sizeof(text) - 1;
+    }
+    if (n >= 4 && memcmp(request, "GET ", 4) == 0) {
+        int header_len = snprintf(header, sizeof(header),
+                                  "HTTP/1.0 200 OK\r\n"
+                                  "Content-Type: text/plain; version=0.0.4\r\n"
+                                  "Content-Length: %zu\r\n"
+                                  "Connection: close\r\n\r\n", len);
+        send_all(fd, header, (size_t)header_len);
+    }
+    send_all(fd, text, len);
+}
+
+int metrics_serve(Metrics* metrics, long long now_ms) {
+    int answered = 0;
+
+    if (metrics->listen_fd < 0) {
+        return 0;
+    }
+    // Clients are answered one by one, so a few slow ones mustn't hold up the
+    // caller's loop; the rest stay queued and keep the socket readable
+    while (answered < METRICS_MAX_CLIENTS_PER_SERVE) {
+        int fd = accept4(metrics->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break; // EAGAIN: nobody else waiting
+        }
+        answer(fd, metrics, now_ms);
+        close(fd);
+        answered++;
+    }
+    return answered;
+}
+
+void metrics_close(Metrics* metrics) {
+    if (metrics->listen_fd >= 0) {
+        close(metrics->listen_fd);
+        unlink(metrics->socket_path);
+        metrics->listen_fd = -1;
+    }
+}
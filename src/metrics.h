@@ -0,0 +1,223 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Timed operations, one latency histogram each */
+#define METRICS_OP_PORT          0  /* `usbip port` */
+#define METRICS_OP_LIST          1  /* `usbip list -r` */
+#define METRICS_OP_ATTACH        2  /* `usbip attach` */
+#define METRICS_OP_NATIVE_LIST   3  /* OP_REQ_DEVLIST over the built-in client */
+#define METRICS_OP_NATIVE_ATTACH 4  /* OP_REQ_IMPORT plus the sysfs attach */
+#define METRICS_OP_SYSFS_PORTS   5  /* Reading the vhci_hcd status files */
+#define METRICS_OP_NATIVE_PROBE  6  /* Liveness connect standing in for a cached listing */
+#define METRICS_OP_ATTACH_SETTLE 7  /* From `usbip attach` returning to the device showing on a port */
+#define METRICS_OPS              8
+
+/* Histogram buckets: 1 ms to 30 s, plus +Inf */
+#define METRICS_BUCKETS 15
+/* Distinct (method, result, exit code) combinations counted for attaches */
+#define METRICS_MAX_ATTACH_KINDS 16
+/* Devices and status values tracked for time-in-status */
+#define METRICS_MAX_TARGETS 256
+#define METRICS_MAX_STATUS 16
+/* Scrapes answered per metrics_serve() call */
+#define METRICS_MAX_CLIENTS_PER_SERVE 4
+
+/* Latency distribution of one operation; buckets are not cumulative */
+typedef struct {
+    unsigned long long buckets[METRICS_BUCKETS];
+    unsigned long long count;
+    long long sum_us;
+} MetricsHistogram;
+
+/* Attach attempts with one outcome */
+typedef struct {
+    int op;            /* METRICS_OP_ATTACH or METRICS_OP_NATIVE_ATTACH */
+    int success;       /* 1 if the device ended up attached */
+    int exit_code;     /* Exit code of `usbip attach`, -1 for the built-in client */
+    unsigned long long count;
+} MetricsAttachKind;
+
+/* Time a device has spent in each status */
+typedef struct {
+    char name[288];    /* "<host>:<identifier>", escaped for a label value */
+    int status;        /* Current status, -1 before the first check */
+    long long since_ms;
+    long long status_ms[METRICS_MAX_STATUS];
+} MetricsTarget;
+
+/* Everything the monitor counts; plain fixed-size arrays, updated in place.
+ * The update and format calls may be made from several threads. */
+typedef struct {
+    MetricsHistogram ops[METRICS_OPS];
+    unsigned long long spawns[METRICS_OPS];         /* Processes started per operation */
+    unsigned long long spawn_failures[METRICS_OPS]; /* Processes that couldn't be started */
+    MetricsAttachKind attaches[METRICS_MAX_ATTACH_KINDS];
+    int attach_kind_count;
+    unsigned long long attaches_dropped;            /* Outcomes that didn't fit in attaches */
+    MetricsTarget targets[METRICS_MAX_TARGETS];
+    int target_count;
+    const char* const* status_names;                /* Label value for each status */
+    int status_count;
+    long long start_ms;
+    int listen_fd;                                  /* Unix socket for scrapes, -1 if none */
+    char socket_path[108];
+} Metrics;
+
+/**
+ * @brief Initializes the counters.
+ *
+ * @param metrics Metrics to initialize.
+ * @param status_names Label value for each status number, kept by reference.
+ * @param status_count Number of entries in status_names (at most METRICS_MAX_STATUS).
+ * @param now_ms Current monotonic time in milliseconds, the start of the uptime.
+ */
+void metrics_init(Metrics* metrics, const char* const* status_names, int status_count, long long now_ms);
+
+/**
+ * @brief Returns CLOCK_MONOTONIC in microseconds, for timing operations.
+ *
+ * @return Current monotonic time in microseconds.
+ */
+long long metrics_now_us(void);
+
+/**
+ * @brief Registers a monitored device for time-in-status accounting.
+ *
+ * @param metrics Metrics to update.
+ * @param host Remote host of the device.
+ * @param identifier Bus ID or device ID.
+ * @return Index to pass to metrics_set_status(), or -1 if the table is full.
+ */
+int metrics_add_target(Metrics* metrics, const char* host, const char* identifier);
+
+/**
+ * @brief Registers a device in a given slot, e.g. one freed by metrics_remove_target().
+ *
+ * Any history of the slot is discarded.
+ *
+ * @param metrics Metrics to update.
+ * @param index Slot to use, at most the current number of slots.
+ * @param host Remote host of the device.
+ * @param identifier Bus ID or device ID.
+ * @return index, or -1 if it is out of range.
+ */
+int metrics_set_target(Metrics* metrics, int index, const char* host, const char* identifier);
+
+/**
+ * @brief Stops reporting a device that is no longer monitored.
+ *
+ * The slot stays allocated so other indices are unchanged.
+ *
+ * @param metrics Metrics to update.
+ * @param index Index from metrics_add_target() or metrics_set_target().
+ */
+void metrics_remove_target(Metrics* metrics, int index);
+
+/**
+ * @brief Records how long one operation took.
+ *
+ * @param metrics Metrics to update.
+ * @param op METRICS_OP_* value.
+ * @param elapsed_us Duration in microseconds.
+ */
+void metrics_observe(Metrics* metrics, int op, long long elapsed_us);
+
+/**
+ * @brief Counts a process started, or that failed to start, for an operation.
+ *
+ * @param metrics Metrics to update.
+ * @param op METRICS_OP_* value.
+ * @param started 1 if the process was started, 0 if spawning it failed.
+ */
+void metrics_count_spawn(Metrics* metrics, int op, int started);
+
+/**
+ * @brief Counts the outcome of one attach attempt.
+ *
+ * @param metrics Metrics to update.
+ * @param op METRICS_OP_ATTACH or METRICS_OP_NATIVE_ATTACH.
+ * @param success 1 if the device ended up attached.
+ * @param exit_code Exit code of `usbip attach`, or -1 for the built-in client.
+ */
+void metrics_count_attach(Metrics* metrics, int op, int success, int exit_code);
+
+/**
+ * @brief Records the status of a device after a check.
+ *
+ * The time since the previous call is credited to the previous status.
+ *
+ * @param metrics Metrics to update.
+ * @param target Index from metrics_add_target().
+ * @param status New status, 0 to status_count - 1.
+ * @param now_ms Current monotonic time in milliseconds.
+ */
+void metrics_set_status(Metrics* metrics, int target, int status, long long now_ms);
+
+/**
+ * @brief Renders every metric in the Prometheus text exposition format.
+ *
+ * @param metrics Metrics to render.
+ * @param now_ms Current monotonic time in milliseconds.
+ * @param buf Output buffer, always NUL-terminated if size is nonzero.
+ * @param size Size of buf.
+ * @return Length of the full text, which may exceed size like snprintf().
+ */
+size_t metrics_format(const Metrics* metrics, long long now_ms, char* buf, size_t size);
+
+/**
+ * @brief Writes the Prometheus text to a stream, e.g. stderr on SIGUSR1.
+ *
+ * @param metrics Metrics to render.
+ * @param now_ms Current monotonic time in milliseconds.
+ * @param out Stream to write to.
+ */
+void metrics_dump(const Metrics* metrics, long long now_ms, FILE* out);
+
+/**
+ * @brief Listens for scrapes on a Unix stream socket.
+ *
+ * A stale socket file at path is replaced, and the new one is only
+ * accessible to the owner (mode 0600). The socket is non-blocking; wait
+ * for connections with events_watch_listener() and answer them with
+ * metrics_serve().
+ *
+ * @param metrics Metrics to serve.
+ * @param path Filesystem path of the socket.
+ * @return 0 on success, -1 on failure (errno set).
+ */
+int metrics_listen(Metrics* metrics, const char* path);
+
+/**
+ * @brief Answers pending scrapes on the listening socket.
+ *
+ * A client that sends an HTTP GET, e.g. `curl --unix-socket`, gets an HTTP
+ * response; any other client, e.g. `socat`, gets the bare text. Each client
+ * is given a short grace period to send its request. At most
+ * METRICS_MAX_CLIENTS_PER_SERVE clients are answered per call; any others
+ * stay queued for the next one.
+ *
+ * @param metrics Metrics to serve.
+ * @param now_ms Current monotonic time in milliseconds.
+ * @return Number of clients answered.
+ */
+int metrics_serve(Metrics* metrics, long long now_ms);
+
+/**
+ * @brief Closes the listening socket and removes its file.
+ *
+ * @param metrics Metrics whose socket to close.
+ */
+void metrics_close(Metrics* metrics);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // METRICS_H
@@ -1,4 +1,5 @@
 #include "parser.h"
+#include "scan.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,126 +13,547 @@ static const char* trim_leading(const char* str) {
     return str;
 }
 
-// Helper function to check if a string starts with a prefix
-static int starts_with(const char* str, const char* prefix) {
-    return strncmp(str, prefix, strlen(prefix)) == 0;
+// Slice of the input, not NUL-terminated
+typedef struct {
+    const char* ptr;
+    size_t len;
+} Span;
+
+// A record as found by the tokenizer, pointing into the input
+typedef struct {
+    int port;
+    int speed;
+    uint16_t vendor_id;
+    uint16_t product_id;
+    Span local_busid;
+    Span host;
+    Span service;
+    Span busid;
+} RawRecord;
+
+// Callback for each tokenized record, returns nonzero to stop scanning
+typedef int (*raw_record_fn)(const RawRecord* record, void* ctx);
+
+// Speed names as printed by usbip_speed_string(), longest prefix first
+static const struct {
+    const char* name;
+    int speed;
+} speed_names[] = {
+    {"Super Speed Plus", 6},
+    {"Super Speed", 5},
+    {"Wireless", 4},
+    {"High Speed", 3},
+    {"Full Speed", 2},
+    {"Low Speed", 1},
+};
+
+#define USBIP_URL_MARKER "-> usbip://"
+#define USBIP_URL_MARKER_LEN 11
+
+// Helper to parse up to four hex digits
+static int parse_hex16(const char* p, const char* end, uint16_t* value) {
+    unsigned int v = 0;
+    int digits = 0;
+    while (p < end && digits < 4 && isxdigit((unsigned char)*p)) {
+        v = v * 16 + (unsigned int)(isdigit((unsigned char)*p) ? *p - '0' : (tolower((unsigned char)*p) - 'a' + 10));
+        p++;
+        digits++;
+    }
+    *value = (uint16_t)v;
+    return digits == 4;
 }
 
-int parse_usbip_port(const char* output, const char* identifier, int is_busid) {
-    const char* line_start = output;
-    const char* line_end;
-    char line_buffer[512]; // Buffer for storing the current line
-    size_t line_len;
-    
-    // Instead of regex, we'll construct search patterns
-    char pattern_buffer[256];
-    
-    if (is_busid) {
-        // Looking for: "-> usbip://<host>/<busid>"
-        snprintf(pattern_buffer, sizeof(pattern_buffer), "-> usbip://%s", identifier);
-    } else {
-        // Looking for: "-> usbip://<host>/devid=<devid>"
-        snprintf(pattern_buffer, sizeof(pattern_buffer), "-> usbip://");
+// Helper for a "Port NN: <Port in Use> at High Speed(480Mbps)" line
+static void parse_port_line(const char* line, const char* end, RawRecord* pending) {
+    const char* at;
+    size_t i;
+
+    pending->port = 0;
+    for (line += 5; line < end && isdigit((unsigned char)*line); line++) {
+        pending->port = pending->port * 10 + (*line - '0');
+    }
+    pending->speed = 0;
+    pending->vendor_id = 0;
+    pending->product_id = 0;
+
+    at = scan_find(line, end, " at ", 4);
+    if (!at) {
+        return;
+    }
+    at += 4;
+    for (i = 0; i < sizeof(speed_names) / sizeof(speed_names[0]); i++) {
+        size_t name_len = strlen(speed_names[i].name);
+        if ((size_t)(end - at) >= name_len && memcmp(at, speed_names[i].name, name_len) == 0) {
+            pending->speed = speed_names[i].speed;
+            return;
+        }
+    }
+}
+
+// Helper for a "Vendor : Product (vvvv:pppp)" line, ignores anything else
+static void parse_vendor_line(const char* line, const char* end, RawRecord* pending) {
+    // Needs at least "(vvvv:pppp)" at the end of the line
+    if (end - line < 11 || end[-1] != ')' || end[-11] != '(' || end[-6] != ':') {
+        return;
     }
-    
-    while (line_start && *line_start) {
-        // Find end of line
-        line_end = strchr(line_start, '\n');
+    if (!parse_hex16(end - 10, end - 6, &pending->vendor_id) ||
+        !parse_hex16(end - 5, end - 1, &pending->product_id)) {
+        pending->vendor_id = 0;
+        pending->product_id = 0;
+    }
+}
+
+// Helper for a "1-1 -> usbip://host:3240/7-4" line, returns 1 if it was one
+static int parse_url_line(const char* line, const char* end, RawRecord* record) {
+    const char* marker = scan_find(line, end, USBIP_URL_MARKER, USBIP_URL_MARKER_LEN);
+    const char* host_start;
+    const char* slash;
+    const char* colon;
+    const char* p;
+
+    if (!marker) {
+        return 0;
+    }
+
+    // Local busid is the token before the arrow
+    p = marker;
+    while (p > line && isspace((unsigned char)p[-1])) {
+        p--;
+    }
+    record->local_busid.ptr = line;
+    record->local_busid.len = (size_t)(p - line);
+
+    host_start = marker + USBIP_URL_MARKER_LEN;
+    slash = scan_byte(host_start, end, '/');
+    if (!slash) {
+        return 0;
+    }
+
+    // Host may be an IPv6 literal, the service follows the last colon
+    colon = NULL;
+    for (p = host_start; p < slash; p++) {
+        if (*p == ':') {
+            colon = p;
+        }
+    }
+    record->host.ptr = host_start;
+    record->host.len = (size_t)((colon ? colon : slash) - host_start);
+    record->service.ptr = colon ? colon + 1 : slash;
+    record->service.len = colon ? (size_t)(slash - colon - 1) : 0;
+
+    // Remote busid runs until whitespace or a query string
+    p = slash + 1;
+    record->busid.ptr = p;
+    while (p < end && !isspace((unsigned char)*p) && *p != '?') {
+        p++;
+    }
+    record->busid.len = (size_t)(p - record->busid.ptr);
+    return 1;
+}
+
+// Single pass over `usbip port` output, no copies of lines
+static void tokenize_port_output(const char* output, raw_record_fn fn, void* ctx) {
+    const char* line_start = output;
+    const char* output_end = output + strlen(output);
+    RawRecord pending;
+
+    memset(&pending, 0, sizeof(pending));
+    pending.port = -1;
+
+    while (line_start < output_end) {
+        const char* line_end = scan_byte(line_start, output_end, '\n');
+        const char* next = line_end ? line_end + 1 : output_end;
+        const char* line = trim_leading(line_start);
+
         if (!line_end) {
-            // Last line without newline
-            line_len = strlen(line_start);
-            line_end = line_start + line_len;
-        } else {
-            line_len = line_end - line_start;
+            line_end = output_end;
+        }
+        // Tolerate CRLF and trailing blanks
+        while (line_end > line && isspace((unsigned char)line_end[-1])) {
+            line_end--;
         }
-        
-        // Copy line to buffer and null-terminate it
-        if (line_len < sizeof(line_buffer) - 1) {
-            memcpy(line_buffer, line_start, line_len);
-            line_buffer[line_len] = '\0';
-            
-            // Trim leading whitespace
-            const char* trimmed_line = trim_leading(line_buffer);
-            
-            if (is_busid) {
-                // For busid, check if line contains "-> usbip://" followed by identifier
-                const char* usbip_pos = strstr(trimmed_line, "-> usbip://");
-                if (usbip_pos) {
-                    const char* path_pos = strchr(usbip_pos + 11, '/'); // 11 is length of "-> usbip://"
-                    if (path_pos) {
-                        // Extract the path part after the slash
-                        path_pos++; // Move past the slash
-                        
-                        // Check if path starts with identifier and is followed by end or whitespace
-                        size_t id_len = strlen(identifier);
-                        if (strncmp(path_pos, identifier, id_len) == 0 && 
-                            (path_pos[id_len] == '\0' || isspace((unsigned char)path_pos[id_len]) || 
-                             path_pos[id_len] == '?' || path_pos[id_len] == ' ')) {
-                            return 1; // Found match
-                        }
-                    }
+        if (line > line_end) {
+            line = line_end;
+        }
+
+        if ((size_t)(line_end - line) > 5 && memcmp(line, "Port ", 5) == 0 && isdigit((unsigned char)line[5])) {
+            parse_port_line(line, line_end, &pending);
+        } else {
+            RawRecord record = pending;
+            if (parse_url_line(line, line_end, &record)) {
+                if (fn(&record, ctx)) {
+                    return;
                 }
             } else {
-                // For devid, check if line contains "devid=<identifier>"
-                char devid_pattern[256];
-                snprintf(devid_pattern, sizeof(devid_pattern), "devid=%s", identifier);
-                if (strstr(trimmed_line, devid_pattern)) {
-                    return 1; // Found match
-                }
+                parse_vendor_line(line, line_end, &pending);
             }
         }
-        
-        // Move to next line
-        line_start = line_end;
-        if (line_start && *line_start == '\n') {
-            line_start++; // Skip newline
+
+        line_start = next;
+    }
+}
+
+// FNV-1a, continued over several pieces
+static uint32_t hash_update(uint32_t hash, const char* p, size_t len) {
+    while (len--) {
+        hash ^= (unsigned char)*p++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+#define HASH_SEED 2166136261u
+
+// Helper to match a busid span against an identifier (exact key match)
+static int span_matches(const char* busid, size_t busid_len, const char* identifier, int is_busid) {
+    size_t id_len = strlen(identifier);
+    if (!is_busid) {
+        if (busid_len < 6 || memcmp(busid, "devid=", 6) != 0) {
+            return 0;
         }
+        busid += 6;
+        busid_len -= 6;
     }
-    
-    return 0; // No match found
+    return busid_len == id_len && memcmp(busid, identifier, id_len) == 0;
 }
 
-int parse_usbip_list(const char* output, const char* busid) {
-    const char* line_start = output;
+int port_busid_matches(const char* busid, const char* identifier, int is_busid) {
+    return span_matches(busid, strlen(busid), identifier, is_busid);
+}
+
+// Helper to drop the brackets of an IPv6 literal, so "[fe80::1]" and "fe80::1" are one host
+static Span unbracket(const char* host, size_t len) {
+    Span span;
+    if (len >= 2 && host[0] == '[' && host[len - 1] == ']') {
+        host++;
+        len -= 2;
+    }
+    span.ptr = host;
+    span.len = len;
+    return span;
+}
+
+int port_host_matches(const char* record_host, const char* host) {
+    Span a = unbracket(record_host, strlen(record_host));
+    Span b = unbracket(host, strlen(host));
+    return a.len == b.len && memcmp(a.ptr, b.ptr, a.len) == 0;
+}
+
+// Helper to hash the index key of a record: its host, a separator, then its remote busid field
+static uint32_t key_hash(const char* host, size_t host_len, const char* busid, size_t busid_len) {
+    Span unbracketed = unbracket(host, host_len);
+    uint32_t hash = hash_update(HASH_SEED, unbracketed.ptr, unbracketed.len);
+    hash = hash_update(hash, "/", 1);
+    return hash_update(hash, busid, busid_len);
+}
+
+void port_table_reset(PortTable* table) {
+    table->count = 0;
+    table->truncated = 0;
+    table->pool_used = 0;
+    memset(table->index, 0, sizeof(table->index));
+}
+
+// Helper to copy a span into the pool, returns NULL if it doesn't fit
+static const char* pool_add(PortTable* table, const char* s, size_t len) {
+    char* dest;
+    if (table->pool_used + len + 1 > sizeof(table->pool)) {
+        return NULL;
+    }
+    dest = table->pool + table->pool_used;
+    memcpy(dest, s, len);
+    dest[len] = '\0';
+    table->pool_used += len + 1;
+    return dest;
+}
+
+// Helper shared by port_table_add() and the tokenizer callback
+static int table_add_raw(PortTable* table, const RawRecord* raw) {
+    PortRecord* record;
+    uint32_t slot;
+    size_t pool_mark = table->pool_used;
+
+    if (table->count >= PORT_TABLE_MAX_RECORDS) {
+        table->truncated = 1;
+        return -1;
+    }
+
+    record = &table->records[table->count];
+    record->port = raw->port;
+    record->speed = raw->speed;
+    record->vendor_id = raw->vendor_id;
+    record->product_id = raw->product_id;
+    record->local_busid = pool_add(table, raw->local_busid.ptr, raw->local_busid.len);
+    record->host = pool_add(table, raw->host.ptr, raw->host.len);
+    record->service = pool_add(table, raw->service.ptr, raw->service.len);
+    record->busid = pool_add(table, raw->busid.ptr, raw->busid.len);
+    if (!record->local_busid || !record->host || !record->service || !record->busid) {
+        table->pool_used = pool_mark;
+        table->truncated = 1;
+        return -1;
+    }
+
+    // Linear probing on host and busid; the first record for a key wins
+    slot = key_hash(raw->host.ptr, raw->host.len, raw->busid.ptr, raw->busid.len) & (PORT_TABLE_INDEX_SIZE - 1);
+    while (table->index[slot] != 0) {
+        const PortRecord* other = &table->records[table->index[slot] - 1];
+        if (strcmp(other->busid, record->busid) == 0 && port_host_matches(other->host, record->host)) {
+            break;
+        }
+        slot = (slot + 1) & (PORT_TABLE_INDEX_SIZE - 1);
+    }
+    if (table->index[slot] == 0) {
+        table->index[slot] = (uint16_t)(table->count + 1);
+    }
+
+    table->count++;
+    return 0;
+}
+
+// Helper to make a span from a possibly NULL string
+static Span span_of(const char* s) {
+    Span span;
+    span.ptr = s ? s : "";
+    span.len = strlen(span.ptr);
+    return span;
+}
+
+int port_table_add(PortTable* table, const PortRecord* record) {
+    RawRecord raw;
+    raw.port = record->port;
+    raw.speed = record->speed;
+    raw.vendor_id = record->vendor_id;
+    raw.product_id = record->product_id;
+    raw.local_busid = span_of(record->local_busid);
+    raw.host = span_of(record->host);
+    raw.service = span_of(record->service);
+    raw.busid = span_of(record->busid);
+    return table_add_raw(table, &raw);
+}
+
+static int table_add_callback(const RawRecord* record, void* ctx) {
+    table_add_raw((PortTable*)ctx, record);
+    return 0;
+}
+
+int port_table_parse(PortTable* table, const char* output) {
+    port_table_reset(table);
+    tokenize_port_output(output, table_add_callback, table);
+    return table->count;
+}
+
+const PortRecord* port_table_find(const PortTable* table, const char* host, const char* identifier, int is_busid) {
+    uint32_t hash;
+    uint32_t slot;
+
+    if (is_busid) {
+        hash = key_hash(host, strlen(host), identifier, strlen(identifier));
+    } else {
+        hash = key_hash(host, strlen(host), "devid=", 6);
+        hash = hash_update(hash, identifier, strlen(identifier));
+    }
+
+    for (slot = hash & (PORT_TABLE_INDEX_SIZE - 1); table->index[slot] != 0;
+         slot = (slot + 1) & (PORT_TABLE_INDEX_SIZE - 1)) {
+        const PortRecord* record = &table->records[table->index[slot] - 1];
+        if (port_busid_matches(record->busid, identifier, is_busid) && port_host_matches(record->host, host)) {
+            return record;
+        }
+    }
+    return NULL;
+}
+
+// State for the early-exit scan behind parse_usbip_port()
+typedef struct {
+    const char* identifier;
+    int is_busid;
+    int found;
+} MatchContext;
+
+static int match_callback(const RawRecord* record, void* ctx) {
+    MatchContext* match = ctx;
+    match->found = span_matches(record->busid.ptr, record->busid.len, match->identifier, match->is_busid);
+    return match->found;
+}
+
+int device_matcher_init(DeviceMatcher* matcher, const char* identifier, int is_busid) {
+    size_t id_len = strlen(identifier);
+    size_t prefix_len = is_busid ? 1 : 7;
+
+    if (id_len > DEVICE_MATCHER_ID_MAX) {
+        return -1;
+    }
+    memcpy(matcher->port_needle, is_busid ? "/" : "/devid=", prefix_len);
+    memcpy(matcher->port_needle + prefix_len, identifier, id_len);
+    matcher->port_len = prefix_len + id_len;
+    matcher->port_needle[matcher->port_len] = '\0';
+
+    memcpy(matcher->list_needle, identifier, id_len);
+    matcher->list_needle[id_len] = ':';
+    matcher->list_len = id_len + 1;
+    matcher->list_needle[matcher->list_len] = '\0';
+    return 0;
+}
+
+// Helper to find the start of the line holding p
+static const char* line_start_of(const char* start, const char* p) {
+    while (p > start && p[-1] != '\n') {
+        p--;
+    }
+    return p;
+}
+
+// Helper to check that a "/<busid>" hit is the remote busid of a URL line,
+// following the same rules as the tokenizer
+static int is_port_match(const char* start, const char* end, const char* hit, size_t hit_len) {
+    const char* after = hit + hit_len;
+    const char* line;
     const char* line_end;
-    char line_buffer[512]; // Buffer for storing the current line
-    size_t line_len;
-    
-    // Prepare the prefix to search for (busid:)
-    char prefix_buffer[256];
-    snprintf(prefix_buffer, sizeof(prefix_buffer), "%s:", busid);
-    
-    while (line_start && *line_start) {
-        // Find end of line
-        line_end = strchr(line_start, '\n');
-        if (!line_end) {
-            // Last line without newline
-            line_len = strlen(line_start);
-            line_end = line_start + line_len;
-        } else {
-            line_len = line_end - line_start;
+    const char* marker;
+
+    // The remote busid runs until whitespace or a query string
+    if (after < end && !isspace((unsigned char)*after) && *after != '?') {
+        return 0;
+    }
+
+    line = line_start_of(start, hit);
+    while (line < hit && isspace((unsigned char)*line)) {
+        line++;
+    }
+    line_end = scan_byte(hit, end, '\n');
+    if (!line_end) {
+        line_end = end;
+    }
+    if ((size_t)(line_end - line) > 5 && memcmp(line, "Port ", 5) == 0 && isdigit((unsigned char)line[5])) {
+        return 0;
+    }
+
+    // The busid follows the first slash after the first marker of the line
+    marker = scan_find(line, line_end, USBIP_URL_MARKER, USBIP_URL_MARKER_LEN);
+    if (!marker || marker + USBIP_URL_MARKER_LEN > hit) {
+        return 0;
+    }
+    return scan_byte(marker + USBIP_URL_MARKER_LEN, hit + 1, '/') == hit;
+}
+
+int device_matcher_port(const DeviceMatcher* matcher, const char* output, size_t len) {
+    const char* end = output + len;
+    const char* p = output;
+    const char* hit;
+
+    while ((hit = scan_find(p, end, matcher->port_needle, matcher->port_len)) != NULL) {
+        if (is_port_match(output, end, hit, matcher->port_len)) {
+            return 1;
         }
-        
-        // Copy line to buffer and null-terminate it
-        if (line_len < sizeof(line_buffer) - 1) {
-            memcpy(line_buffer, line_start, line_len);
-            line_buffer[line_len] = '\0';
-            
-            // Trim leading whitespace
-            const char* trimmed_line = trim_leading(line_buffer);
-            
-            // Check if line starts with the busid:
-            if (starts_with(trimmed_line, prefix_buffer)) {
-                return 1; // Found match
+        p = hit + 1;
+    }
+    return 0;
+}
+
+int device_matcher_list(const DeviceMatcher* matcher, const char* output, size_t len) {
+    const char* end = output + len;
+    const char* p = output;
+    const char* hit;
+
+    while ((hit = scan_find(p, end, matcher->list_needle, matcher->list_len)) != NULL) {
+        // Only leading whitespace may come before the busid
+        const char* q = hit;
+        while (q > output && q[-1] != '\n' && isspace((unsigned char)q[-1])) {
+            q--;
+        }
+        if (q == output || q[-1] == '\n') {
+            return 1;
+        }
+        p = hit + 1;
+    }
+    return 0;
+}
+
+int parse_usbip_port(const char* output, const char* identifier, int is_busid) {
+    DeviceMatcher matcher;
+    MatchContext match;
+
+    if (device_matcher_init(&matcher, identifier, is_busid) == 0) {
+        return device_matcher_port(&matcher, output, strlen(output));
+    }
+    match.identifier = identifier;
+    match.is_busid = is_busid;
+    match.found = 0;
+    tokenize_port_output(output, match_callback, &match);
+    return match.found;
+}
+
+// Scanner states, carried over between chunks
+#define LIST_SCAN_LINE_START 0  // Skipping leading whitespace
+#define LIST_SCAN_MATCHING   1  // Comparing against "<busid>:"
+#define LIST_SCAN_SKIP_LINE  2  // Mismatch, waiting for the next line
+
+void list_scanner_init(ListScanner* scanner, const char* busid) {
+    scanner->busid = busid;
+    scanner->busid_len = strlen(busid);
+    scanner->matched = 0;
+    scanner->state = LIST_SCAN_LINE_START;
+    scanner->found = 0;
+}
+
+int list_scanner_feed(ListScanner* scanner, const char* chunk, size_t len) {
+    const char* p = chunk;
+    const char* end = chunk + len;
+
+    while (p < end && !scanner->found) {
+        switch (scanner->state) {
+        case LIST_SCAN_LINE_START:
+            while (p < end && *p != '\n' && isspace((unsigned char)*p)) {
+                p++;
+            }
+            if (p == end) {
+                break;
+            }
+            if (*p == '\n') {
+                p++;
+                break;
+            }
+            scanner->state = LIST_SCAN_MATCHING;
+            scanner->matched = 0;
+            // fall through
+        case LIST_SCAN_MATCHING:
+            // The needle is the busid followed by ':', matched byte by byte
+            // so it can straddle chunk boundaries
+            while (p < end) {
+                char expected = scanner->matched < scanner->busid_len ? scanner->busid[scanner->matched] : ':';
+                if (*p != expected) {
+                    scanner->state = LIST_SCAN_SKIP_LINE;
+                    break;
+                }
+                p++;
+                if (++scanner->matched > scanner->busid_len) {
+                    scanner->found = 1;
+                    break;
+                }
             }
+            break;
+        case LIST_SCAN_SKIP_LINE: {
+            const char* newline = scan_byte(p, end, '\n');
+            if (!newline) {
+                p = end;
+            } else {
+                p = newline + 1;
+                scanner->state = LIST_SCAN_LINE_START;
+            }
+            break;
         }
-        
-        // Move to next line
-        line_start = line_end;
-        if (line_start && *line_start == '\n') {
-            line_start++; // Skip newline
         }
     }
-    
-    return 0; // No match found
+    return scanner->found;
+}
+
+int parse_usbip_list(const char* output, const char* busid) {
+    DeviceMatcher matcher;
+    ListScanner scanner;
+
+    if (device_matcher_init(&matcher, busid, 1) == 0) {
+        return device_matcher_list(&matcher, output, strlen(output));
+    }
+    list_scanner_init(&scanner, busid);
+    return list_scanner_feed(&scanner, output, strlen(output));
 }
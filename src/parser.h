@@ -1,15 +1,164 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Capacity of a PortTable */
+#define PORT_TABLE_MAX_RECORDS 512
+#define PORT_TABLE_INDEX_SIZE 1024   /* Hash slots, power of two above twice the records */
+#define PORT_TABLE_POOL_SIZE 65536   /* Bytes for the strings of all records */
+
+/* One imported device, from `usbip port` or the vhci_hcd sysfs state */
+typedef struct {
+    int port;                /* vhci port number, -1 if unknown */
+    int speed;               /* Kernel usb_device_speed: 1 low ... 5 super, 0 unknown */
+    uint16_t vendor_id;      /* 0 if unknown */
+    uint16_t product_id;     /* 0 if unknown */
+    const char* local_busid; /* Local busid of the virtual device */
+    const char* host;        /* Remote host */
+    const char* service;     /* Remote TCP port */
+    const char* busid;       /* Remote busid, or "devid=<id>" */
+} PortRecord;
+
+/*
+ * All imported devices of one snapshot, with a hash index on the remote
+ * host and busid/devid, so one busid imported from two hosts is two keys.
+ * Record strings live in the table's own pool, so a table must not be
+ * copied by value. Tables are large; keep them static or on the heap.
+ */
+typedef struct {
+    PortRecord records[PORT_TABLE_MAX_RECORDS];
+    int count;
+    int truncated;           /* 1 if records or strings didn't fit */
+    uint16_t index[PORT_TABLE_INDEX_SIZE]; /* Record index + 1, 0 for empty */
+    char pool[PORT_TABLE_POOL_SIZE];
+    size_t pool_used;
+} PortTable;
+
+/**
+ * @brief Empties a table.
+ *
+ * @param table Table to reset.
+ */
+void port_table_reset(PortTable* table);
+
+/**
+ * @brief Adds one record to a table, copying its strings into the pool.
+ *
+ * @param table Table to add to.
+ * @param record Record to add; its strings may be temporary.
+ * @return 0 on success, -1 if the table is full (truncated is then set).
+ */
+int port_table_add(PortTable* table, const PortRecord* record);
+
+/**
+ * @brief Tokenizes the output of `usbip port` into a table in a single pass.
+ *
+ * The table is reset first. Every "-> usbip://" line becomes a record, combined
+ * with the port number, speed and vendor:product of the "Port NN:" block it
+ * belongs to.
+ *
+ * @param table Table receiving the records.
+ * @param output The string output from the `usbip port` command.
+ * @return Number of records parsed.
+ */
+int port_table_parse(PortTable* table, const char* output);
+
+/**
+ * @brief Looks up an attached device through the hash index.
+ *
+ * @param table Table to search.
+ * @param host Remote host the device was imported from, compared as by port_host_matches().
+ * @param identifier The busid (e.g., "1-2") or devid to look for.
+ * @param is_busid True if the identifier is a busid, false if it's a devid.
+ * @return The matching record, or NULL if the device is not attached.
+ */
+const PortRecord* port_table_find(const PortTable* table, const char* host, const char* identifier, int is_busid);
+
+/**
+ * @brief Checks a remote busid field ("1-2" or "devid=<id>") against an identifier.
+ *
+ * Uses the same rules as port_table_find(), for callers matching records
+ * one at a time.
+ *
+ * @param busid Remote busid field of a record.
+ * @param identifier The busid or devid to look for.
+ * @param is_busid True if the identifier is a busid, false if it's a devid.
+ * @return 1 on match, 0 otherwise.
+ */
+int port_busid_matches(const char* busid, const char* identifier, int is_busid);
+
+/**
+ * @brief Checks the remote host of a record against a host.
+ *
+ * Hosts are compared as strings, as usbip records the host it was given;
+ * brackets around an IPv6 literal are ignored on either side.
+ *
+ * @param record_host Remote host field of a record.
+ * @param host Host to look for.
+ * @return 1 on match, 0 otherwise.
+ */
+int port_host_matches(const char* record_host, const char* host);
+
+/* Longest busid/devid a DeviceMatcher takes */
+#define DEVICE_MATCHER_ID_MAX 64
+
+/*
+ * Search patterns for one device, built once and reused for every output.
+ * Matching scans the whole buffer for the pattern with the vectorized
+ * search and only looks at the lines around each hit.
+ */
+typedef struct {
+    char port_needle[DEVICE_MATCHER_ID_MAX + 8]; /* "/<busid>" or "/devid=<id>" */
+    size_t port_len;
+    char list_needle[DEVICE_MATCHER_ID_MAX + 2]; /* "<busid>:" */
+    size_t list_len;
+} DeviceMatcher;
+
+/**
+ * @brief Builds the search patterns for a device.
+ *
+ * @param matcher Matcher to initialize.
+ * @param identifier The busid (e.g., "1-2") or devid to look for.
+ * @param is_busid True if the identifier is a busid, false if it's a devid.
+ * @return 0 on success, -1 if the identifier is longer than DEVICE_MATCHER_ID_MAX.
+ */
+int device_matcher_init(DeviceMatcher* matcher, const char* identifier, int is_busid);
+
+/**
+ * @brief Checks `usbip port` output for the device, like parse_usbip_port().
+ *
+ * @param matcher Matcher from device_matcher_init().
+ * @param output Output of `usbip port`, not necessarily NUL-terminated.
+ * @param len Number of bytes in output.
+ * @return 1 if the device is found attached, 0 otherwise.
+ */
+int device_matcher_port(const DeviceMatcher* matcher, const char* output, size_t len);
+
+/**
+ * @brief Checks `usbip list -r <host>` output for the busid, like parse_usbip_list().
+ *
+ * Only meaningful for a matcher built from a busid.
+ *
+ * @param matcher Matcher from device_matcher_init().
+ * @param output Output of `usbip list -r <host>`, not necessarily NUL-terminated.
+ * @param len Number of bytes in output.
+ * @return 1 if the busid is found, 0 otherwise.
+ */
+int device_matcher_list(const DeviceMatcher* matcher, const char* output, size_t len);
+
 /**
  * @brief Parses the output of `usbip port` to check if a device is attached.
  *
  * Checks for lines indicating attachment via busid (e.g., ".../X-Y") or
- * devid (e.g., ".../devid=...") based on the provided identifier.
+ * devid (e.g., ".../devid=...") based on the provided identifier. Goes
+ * through a DeviceMatcher, or the PortTable tokenizer for identifiers too
+ * long for one, and stops at the first match.
  *
  * @param output The string output from the `usbip port` command.
  * @param identifier The busid (e.g., "1-2") or devid (e.g., "abcdef123...") to look for.
@@ -18,10 +167,43 @@ extern "C" {
  */
 int parse_usbip_port(const char* output, const char* identifier, int is_busid);
 
+/* Incremental matcher for `usbip list -r <host>` output */
+typedef struct {
+    const char* busid;       /* Not copied, must outlive the scanner */
+    size_t busid_len;
+    size_t matched;          /* Bytes of "<busid>:" matched on the current line */
+    int state;
+    int found;
+} ListScanner;
+
+/**
+ * @brief Prepares a scanner looking for one busid.
+ *
+ * @param scanner Scanner to initialize.
+ * @param busid The busid (e.g., "1-2") to look for.
+ */
+void list_scanner_init(ListScanner* scanner, const char* busid);
+
+/**
+ * @brief Feeds the next chunk of `usbip list -r <host>` output to a scanner.
+ *
+ * Chunks may split lines anywhere, and lines may be of any length; nothing is
+ * copied or buffered. Once the busid is found the scanner ignores further
+ * input, so the caller can stop reading.
+ *
+ * @param scanner Scanner from list_scanner_init().
+ * @param chunk Bytes of output, not necessarily NUL-terminated.
+ * @param len Number of bytes in chunk.
+ * @return 1 if the busid has been found so far, 0 otherwise.
+ */
+int list_scanner_feed(ListScanner* scanner, const char* chunk, size_t len);
+
 /**
  * @brief Parses the output of `usbip list -r <host>` to check if a device is available.
  *
  * Checks for lines starting with the exact busid followed by a colon (e.g., "X-Y:").
+ * Equivalent to feeding the whole output to a ListScanner, but goes through
+ * a DeviceMatcher where the busid fits one.
  *
  * @param output The string output from the `usbip list -r <host>` command.
  * @param busid The busid (e.g., "1-2") to look for.
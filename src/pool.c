@@ -0,0 +1,190 @@
+#define _DEFAULT_SOURCE
+#include "pool.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+// Job states
+#define POOL_JOB_QUEUED  0
+#define POOL_JOB_RUNNING 1
+#define POOL_JOB_DONE    2
+
+// How often pool_wait() looks at the shutdown flag
+#define POOL_CANCEL_CHECK_MS 100
+
+// Signal mask of the thread that started the pools, applied while a job runs
+static sigset_t job_mask;
+
+// Helper returning the first queued job whose key is under its limit, or NULL
+static PoolJob* next_runnable(WorkPool* pool) {
+    int i, j;
+
+    for (i = 0; i < pool->job_count; i++) {
+        PoolJob* job = &pool->jobs[i];
+        int running = 0;
+
+        if (job->state != POOL_JOB_QUEUED) {
+            continue;
+        }
+        if (pool->key_limit <= 0) {
+            return job;
+        }
+        for (j = 0; j < pool->job_count; j++) {
+            if (pool->jobs[j].state == POOL_JOB_RUNNING && strcmp(pool->jobs[j].key, job->key) == 0) {
+                running++;
+            }
+        }
+        if (running < pool->key_limit) {
+            return job;
+        }
+    }
+    return NULL;
+}
+
+// Thread body: run jobs until the pool stops
+static void* worker_main(void* arg) {
+    WorkPool* pool = arg;
+    PoolJob* job;
+    sigset_t all_signals;
+
+    sigfillset(&all_signals);
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!(job = next_runnable(pool)) && !pool->stopping) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        if (!job) {
+            break;
+        }
+        job->state = POOL_JOB_RUNNING;
+        pthread_mutex_unlock(&pool->lock);
+
+        // Let signals interrupt the job's waits, as they would on the starting thread
+        pthread_sigmask(SIG_SETMASK, &job_mask, NULL);
+        job->fn(job->arg);
+        pthread_sigmask(SIG_SETMASK, &all_signals, NULL);
+
+        pthread_mutex_lock(&pool->lock);
+        job->state = POOL_JOB_DONE;
+        pool->unfinished--;
+        // A job with the same key may be runnable now
+        pthread_cond_broadcast(&pool->work);
+        pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+int pool_start(WorkPool* pool, int thread_count, int key_limit) {
+    sigset_t all_signals;
+    int i;
+
+    memset(pool, 0, sizeof(*pool));
+    pool->key_limit = key_limit;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    if (thread_count > POOL_MAX_THREADS) {
+        thread_count = POOL_MAX_THREADS;
+    }
+    // Threads start with every signal blocked, inherited from here
+    sigfillset(&all_signals);
+    pthread_sigmask(SIG_BLOCK, &all_signals, &job_mask);
+    for (i = 0; i < thread_count; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) {
+            break;
+        }
+        pool->thread_count++;
+    }
+    pthread_sigmask(SIG_SETMASK, &job_mask, NULL);
+    return pool->thread_count > 0 ? 0 : -1;
+}
+
+// Handler of the cancel signal; interrupting the job's wait is all it is for
+static void on_cancel_signal(int signo) {
+    (void)signo;
+}
+
+void pool_set_keep_running(WorkPool* pool, const volatile sig_atomic_t* flag, int signo) {
+    struct sigaction sa;
+
+    // No SA_RESTART, so blocking calls fail with EINTR and check the flag
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_cancel_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(signo, &sa, NULL);
+    pool->keep_running = flag;
+    pool->cancel_signal = signo;
+}
+
+int pool_submit(WorkPool* pool, const char* key, pool_job_fn fn, void* arg) {
+    PoolJob* job;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->job_count == POOL_MAX_JOBS) {
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+    job = &pool->jobs[pool->job_count++];
+    job->fn = fn;
+    job->arg = arg;
+    snprintf(job->key, sizeof(job->key), "%s", key ? key : "");
+    job->state = POOL_JOB_QUEUED;
+    pool->unfinished++;
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+// Helper to interrupt every thread once the shutdown flag clears
+static void forward_cancel(WorkPool* pool, int* forwarded) {
+    int i;
+
+    if (*forwarded || !pool->keep_running || *pool->keep_running) {
+        return;
+    }
+    for (i = 0; i < pool->thread_count; i++) {
+        pthread_kill(pool->threads[i], pool->cancel_signal);
+    }
+    *forwarded = 1;
+}
+
+void pool_wait(WorkPool* pool) {
+    int forwarded = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->unfinished > 0) {
+        struct timespec until;
+
+        // Signals don't wake a condition wait, so look at the flag now and then
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += POOL_CANCEL_CHECK_MS * 1000000L;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&pool->done, &pool->lock, &until);
+        forward_cancel(pool, &forwarded);
+    }
+    pool->job_count = 0;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_stop(WorkPool* pool) {
+    int i;
+
+    pool_wait(pool);
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    for (i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pool->thread_count = 0;
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->done);
+}
@@ -0,0 +1,106 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>
+#include <signal.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Most worker threads in a pool */
+#define POOL_MAX_THREADS 64
+/* Most jobs queued between two pool_wait() calls */
+#define POOL_MAX_JOBS 256
+/* Longest job key kept, terminator included */
+#define POOL_KEY_MAX 256
+/* Defaults for attach concurrency: total, and per remote host */
+#define POOL_DEFAULT_THREADS 8
+#define POOL_DEFAULT_KEY_LIMIT 8
+
+/* Work run on a pool thread */
+typedef void (*pool_job_fn)(void* arg);
+
+/* A queued or running job */
+typedef struct {
+    pool_job_fn fn;
+    void* arg;
+    char key[POOL_KEY_MAX];  /* Jobs with equal keys share key_limit */
+    int state;               /* POOL_JOB_* in pool.c */
+} PoolJob;
+
+/* Fixed set of threads running batches of jobs */
+typedef struct {
+    pthread_t threads[POOL_MAX_THREADS];
+    int thread_count;
+    int key_limit;           /* Most jobs with one key running at once, 0 for no limit */
+    pthread_mutex_t lock;
+    pthread_cond_t work;     /* A job was queued or finished, or the pool is stopping */
+    pthread_cond_t done;     /* A job finished */
+    PoolJob jobs[POOL_MAX_JOBS];
+    int job_count;           /* Jobs in the current batch */
+    int unfinished;          /* Jobs of the batch not done yet */
+    int stopping;
+    const volatile sig_atomic_t* keep_running; /* Shutdown flag forwarded to busy threads */
+    int cancel_signal;       /* Signal raised in the threads when keep_running clears */
+} WorkPool;
+
+/**
+ * @brief Starts the threads of a pool.
+ *
+ * Idle threads block every signal, so signals sent to the process reach the
+ * thread that started the pool unless a job is running.
+ *
+ * @param pool Pool to start.
+ * @param thread_count Number of threads, 1 to POOL_MAX_THREADS.
+ * @param key_limit Most jobs sharing a key that may run at once, 0 for no limit.
+ * @return 0 on success, -1 if no thread could be started.
+ */
+int pool_start(WorkPool* pool, int thread_count, int key_limit);
+
+/**
+ * @brief Makes pool_wait() interrupt running jobs on shutdown.
+ *
+ * Jobs blocked in system calls only notice a shutdown flag when a signal
+ * interrupts them, and the process-wide signal reaches a single thread. Once
+ * the flag reads zero, pool_wait() raises signo in every pool thread so all
+ * running jobs see it.
+ *
+ * @param pool Pool to configure.
+ * @param flag Flag cleared by the signal handler, or NULL to disable.
+ * @param signo Signal the pool takes over with a handler that does nothing,
+ *              e.g. SIGUSR2; it must not be used for anything else.
+ */
+void pool_set_keep_running(WorkPool* pool, const volatile sig_atomic_t* flag, int signo);
+
+/**
+ * @brief Queues a job for the next free thread.
+ *
+ * @param pool Started pool.
+ * @param key Concurrency key, e.g. the remote host; at most key_limit jobs
+ *            with the same key run at once.
+ * @param fn Function to run.
+ * @param arg Argument passed to fn; must stay valid until pool_wait() returns.
+ * @return 0 on success, -1 if the batch already holds POOL_MAX_JOBS jobs.
+ */
+int pool_submit(WorkPool* pool, const char* key, pool_job_fn fn, void* arg);
+
+/**
+ * @brief Waits for every job queued since the previous call to finish.
+ *
+ * @param pool Started pool.
+ */
+void pool_wait(WorkPool* pool);
+
+/**
+ * @brief Finishes queued jobs, then stops and joins the threads.
+ *
+ * @param pool Started pool.
+ */
+void pool_stop(WorkPool* pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // POOL_H
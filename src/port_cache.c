@@ -0,0 +1,67 @@
+#include "port_cache.h"
+#include <stdio.h>
+
+void port_cache_init(PortCache* cache, int max_age_ms, port_cache_fill_fn fill, void* fill_ctx) {
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->fill = fill;
+    cache->fill_ctx = fill_ctx;
+    cache->max_age_ms = max_age_ms;
+    port_table_reset(&cache->table);
+    cache->filled = 0;
+    cache->valid = 0;
+    cache->taken_ms = 0;
+    cache->generation = 0;
+    cache->taken_generation = 0;
+    cache->fills = 0;
+}
+
+// Helper behind port_cache_refresh(), called with the lock held
+static int refresh_locked(PortCache* cache, long long now_ms) {
+    if (cache->filled && cache->taken_generation == cache->generation &&
+        now_ms - cache->taken_ms < cache->max_age_ms) {
+        return cache->valid;
+    }
+    cache->taken_generation = cache->generation;
+    cache->taken_ms = now_ms;
+    cache->valid = cache->fill(&cache->table, cache->fill_ctx) ? 1 : 0;
+    cache->filled = 1;
+    cache->fills++;
+    return cache->valid;
+}
+
+int port_cache_refresh(PortCache* cache, long long now_ms) {
+    int valid;
+
+    pthread_mutex_lock(&cache->lock);
+    valid = refresh_locked(cache, now_ms);
+    pthread_mutex_unlock(&cache->lock);
+    return valid;
+}
+
+int port_cache_find_local(PortCache* cache, const char* host, const char* identifier, int is_busid, long long now_ms,
+                          char* local_busid, size_t local_size) {
+    const PortRecord* record = NULL;
+    int found = -1;
+
+    pthread_mutex_lock(&cache->lock);
+    if (refresh_locked(cache, now_ms)) {
+        record = port_table_find(&cache->table, host, identifier, is_busid);
+        found = record != NULL;
+    }
+    if (local_busid && local_size > 0) {
+        snprintf(local_busid, local_size, "%s", record && record->local_busid ? record->local_busid : "");
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return found;
+}
+
+int port_cache_find(PortCache* cache, const char* host, const char* identifier, int is_busid, long long now_ms) {
+    return port_cache_find_local(cache, host, identifier, is_busid, now_ms, NULL, 0);
+}
+
+void port_cache_invalidate(PortCache* cache) {
+    // Waits out a fill in progress, which may have read the ports before the change
+    pthread_mutex_lock(&cache->lock);
+    cache->generation++;
+    pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,106 @@
+#ifndef PORT_CACHE_H
+#define PORT_CACHE_H
+
+#include "parser.h"
+#include <stddef.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Default age after which the port state is read again */
+#define PORT_CACHE_DEFAULT_MAX_AGE_MS 1000
+
+/* Replaces the contents of a table with the current local port state; returns 1 on success, 0 on failure */
+typedef int (*port_cache_fill_fn)(PortTable* table, void* ctx);
+
+/* Most recent view of the local vhci ports, shared by the main loop and the attach workers */
+typedef struct {
+    pthread_mutex_t lock;         /* Held while the table is read or refilled */
+    port_cache_fill_fn fill;
+    void* fill_ctx;
+    int max_age_ms;               /* Age after which the table is refilled */
+    PortTable table;              /* Indexed by remote busid */
+    int filled;                   /* 1 once a fill was attempted for the current generation */
+    int valid;                    /* 1 if the last fill succeeded */
+    long long taken_ms;           /* Monotonic time the last fill started */
+    unsigned long generation;     /* Bumped by port_cache_invalidate() */
+    unsigned long taken_generation; /* Generation the table was filled in */
+    unsigned long fills;          /* Fills so far, for debug logs and tests */
+} PortCache;
+
+/**
+ * @brief Sets up an empty cache.
+ *
+ * @param cache Cache to initialize.
+ * @param max_age_ms Age after which the port state is read again.
+ * @param fill Reads the port state, e.g. from vhci sysfs or `usbip port`.
+ * @param fill_ctx Passed through to fill.
+ */
+void port_cache_init(PortCache* cache, int max_age_ms, port_cache_fill_fn fill, void* fill_ctx);
+
+/**
+ * @brief Makes sure the cache holds a current view of the ports.
+ *
+ * The table is refilled if it is older than max_age_ms or was invalidated
+ * since it was read. Callers asking at the same time share one fill: the
+ * others wait for it and reuse its result. A failed fill is remembered just
+ * like a successful one, so a broken `usbip port` runs once per window too.
+ *
+ * @param cache Cache to refresh.
+ * @param now_ms Current monotonic time in milliseconds.
+ * @return 1 if the ports could be read, 0 otherwise.
+ */
+int port_cache_refresh(PortCache* cache, long long now_ms);
+
+/**
+ * @brief Looks up a device in the current view of the ports.
+ *
+ * Refreshes the cache first, as port_cache_refresh() does.
+ *
+ * @param cache Cache to search.
+ * @param host Remote host the device is imported from.
+ * @param identifier Remote busid or device ID.
+ * @param is_busid 1 if identifier is a busid.
+ * @param now_ms Current monotonic time in milliseconds.
+ * @return 1 if the device is attached, 0 if not, -1 if the ports could not be read.
+ */
+int port_cache_find(PortCache* cache, const char* host, const char* identifier, int is_busid, long long now_ms);
+
+/**
+ * @brief Looks up a device like port_cache_find(), also giving its local busid.
+ *
+ * The local busid names the virtual device on this machine, e.g. "3-1", as
+ * found in the kernel's uevents for it.
+ *
+ * @param cache Cache to search.
+ * @param host Remote host the device is imported from.
+ * @param identifier Remote busid or device ID.
+ * @param is_busid 1 if identifier is a busid.
+ * @param now_ms Current monotonic time in milliseconds.
+ * @param local_busid Receives the local busid, "" if not attached or unknown.
+ * @param local_size Size of local_busid.
+ * @return 1 if the device is attached, 0 if not, -1 if the ports could not be read.
+ */
+int port_cache_find_local(PortCache* cache, const char* host, const char* identifier, int is_busid, long long now_ms,
+                          char* local_busid, size_t local_size);
+
+/**
+ * @brief Marks the cached view as out of date.
+ *
+ * For when the ports changed: an attach was made, or the kernel reported
+ * something that could be a detach. The next lookup reads them again, and
+ * a read already under way when this is called doesn't count. Attach
+ * workers invalidate as their attach returns, so those finishing close
+ * together share the one read that follows.
+ *
+ * @param cache Cache to invalidate.
+ */
+void port_cache_invalidate(PortCache* cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PORT_CACHE_H
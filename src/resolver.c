@@ -0,0 +1,108 @@
+#define _DEFAULT_SOURCE
+#include "resolver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Helper to check for an executable regular file, filling st on success
+static int executable(const char* path, struct stat* st) {
+    return fstatat(AT_FDCWD, path, st, 0) == 0 && S_ISREG(st->st_mode) && access(path, X_OK) == 0;
+}
+
+// Helper to remember which file path names
+static void remember(Resolver* resolver, const char* path, const struct stat* st) {
+    snprintf(resolver->path, sizeof(resolver->path), "%s", path);
+    resolver->dev = st->st_dev;
+    resolver->ino = st->st_ino;
+    resolver->mtime = st->st_mtim;
+}
+
+// Helper to look the program up, called with the lock held; returns 0 if found
+static int search(Resolver* resolver) {
+    char candidate[RESOLVER_PATH_MAX];
+    struct stat st;
+    const char* dir;
+
+    resolver->resolutions++;
+    resolver->path[0] = '\0';
+    if (resolver->user_path[0] && executable(resolver->user_path, &st)) {
+        remember(resolver, resolver->user_path, &st);
+        return 0;
+    }
+
+    // Walk PATH in place rather than on a copy
+    dir = getenv("PATH");
+    while (dir && *dir) {
+        size_t len = strcspn(dir, ":");
+
+        if (len > 0 && // Skip empty path components
+            snprintf(candidate, sizeof(candidate), "%.*s/%s", (int)len, dir, resolver->name) < (int)sizeof(candidate) &&
+            executable(candidate, &st)) {
+            remember(resolver, candidate, &st);
+            return 0;
+        }
+        dir += len;
+        if (*dir == ':') {
+            dir++;
+        }
+    }
+    return -1;
+}
+
+int resolver_init(Resolver* resolver, const char* name, const char* user_path) {
+    int ret;
+
+    pthread_mutex_init(&resolver->lock, NULL);
+    snprintf(resolver->name, sizeof(resolver->name), "%s", name);
+    snprintf(resolver->user_path, sizeof(resolver->user_path), "%s", user_path ? user_path : "");
+    resolver->resolutions = 0;
+    pthread_mutex_lock(&resolver->lock);
+    ret = search(resolver);
+    pthread_mutex_unlock(&resolver->lock);
+    return ret;
+}
+
+int resolver_copy(Resolver* resolver, char* buf, size_t size) {
+    int found;
+
+    pthread_mutex_lock(&resolver->lock);
+    found = resolver->path[0] != '\0';
+    snprintf(buf, size, "%s", resolver->path);
+    pthread_mutex_unlock(&resolver->lock);
+    return found;
+}
+
+int resolver_revalidate(Resolver* resolver) {
+    struct stat st;
+    char old_path[RESOLVER_PATH_MAX];
+    dev_t old_dev;
+    ino_t old_ino;
+    struct timespec old_mtime;
+    int ret;
+
+    pthread_mutex_lock(&resolver->lock);
+    if (resolver->path[0] && executable(resolver->path, &st) &&
+        st.st_dev == resolver->dev && st.st_ino == resolver->ino &&
+        st.st_mtim.tv_sec == resolver->mtime.tv_sec && st.st_mtim.tv_nsec == resolver->mtime.tv_nsec) {
+        pthread_mutex_unlock(&resolver->lock);
+        return RESOLVER_UNCHANGED;
+    }
+
+    memcpy(old_path, resolver->path, sizeof(old_path));
+    old_dev = resolver->dev;
+    old_ino = resolver->ino;
+    old_mtime = resolver->mtime;
+    if (search(resolver) < 0) {
+        ret = RESOLVER_MISSING;
+    } else if (strcmp(old_path, resolver->path) != 0 || old_dev != resolver->dev || old_ino != resolver->ino ||
+               old_mtime.tv_sec != resolver->mtime.tv_sec || old_mtime.tv_nsec != resolver->mtime.tv_nsec) {
+        ret = RESOLVER_CHANGED;
+    } else {
+        ret = RESOLVER_UNCHANGED;
+    }
+    pthread_mutex_unlock(&resolver->lock);
+    return ret;
+}
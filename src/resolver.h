@@ -0,0 +1,73 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Longest program path kept, terminator included */
+#define RESOLVER_PATH_MAX 256
+/* Longest program name looked up in PATH, terminator included */
+#define RESOLVER_NAME_MAX 64
+
+/* Outcomes of resolver_revalidate() */
+#define RESOLVER_MISSING  -1  /* Neither the old path nor anything in PATH can be run */
+#define RESOLVER_UNCHANGED 0  /* The resolved file is still in place */
+#define RESOLVER_CHANGED   1  /* Resolved again to another path or another file */
+
+/* Where an executable was found, and which file it was */
+typedef struct {
+    pthread_mutex_t lock;            /* Guards path and identity; commands run from several threads */
+    char name[RESOLVER_NAME_MAX];    /* Program looked up in PATH, e.g. "usbip" */
+    char user_path[RESOLVER_PATH_MAX]; /* Path given by the user, tried first, empty for none */
+    char path[RESOLVER_PATH_MAX];    /* Resolved path, empty if not found */
+    dev_t dev;                       /* Identity of the file at path when resolved */
+    ino_t ino;
+    struct timespec mtime;
+    unsigned long resolutions;       /* Times the path was looked up, for debug logs and tests */
+} Resolver;
+
+/**
+ * @brief Sets up a resolver and looks the program up.
+ *
+ * The user's path is used if it names an executable, otherwise each
+ * directory of PATH is searched for name, as a shell would.
+ *
+ * @param resolver Resolver to initialize.
+ * @param name Program name to look for in PATH.
+ * @param user_path Path given by the user, or NULL or "" for none.
+ * @return 0 if the program was found, -1 otherwise.
+ */
+int resolver_init(Resolver* resolver, const char* name, const char* user_path);
+
+/**
+ * @brief Copies the resolved path.
+ *
+ * @param resolver Resolver to read.
+ * @param buf Receives the path.
+ * @param size Size of buf.
+ * @return 1 if a path is known, 0 if the program wasn't found.
+ */
+int resolver_copy(Resolver* resolver, char* buf, size_t size);
+
+/**
+ * @brief Checks whether the resolved file is still the one that was found.
+ *
+ * Meant for after a failed run, so steady-state runs cost nothing. A single
+ * fstatat() of the path settles the common case; PATH is only searched
+ * again if the file is gone or was replaced, e.g. by a package upgrade.
+ *
+ * @param resolver Resolver to check.
+ * @return RESOLVER_UNCHANGED, RESOLVER_CHANGED or RESOLVER_MISSING.
+ */
+int resolver_revalidate(Resolver* resolver);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RESOLVER_H
@@ -0,0 +1,250 @@
+#define _GNU_SOURCE
+#include "runner.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+// Bytes requested per read(); usbip output usually arrives in one go
+#define RUNNER_READ_CHUNK 65536
+
+extern char** environ;
+
+// Cleared by the caller's signal handler to abandon the running command
+static const volatile sig_atomic_t* keep_running_flag;
+
+void runner_set_keep_running(const volatile sig_atomic_t* flag) {
+    keep_running_flag = flag;
+}
+
+// Helper to check whether the caller asked to stop
+static int cancelled(void) {
+    return keep_running_flag && !*keep_running_flag;
+}
+
+// Helper returning CLOCK_MONOTONIC in milliseconds
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Helper to make room for one more chunk plus the terminator
+static int reserve(RunnerBuffer* buf, size_t needed) {
+    size_t capacity = buf->capacity ? buf->capacity : RUNNER_READ_CHUNK + 1;
+    char* grown;
+
+    if (buf->data && needed <= buf->capacity) {
+        return 0;
+    }
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    grown = realloc(buf->data, capacity);
+    if (!grown) {
+        return -1;
+    }
+    buf->data = grown;
+    buf->capacity = capacity;
+    return 0;
+}
+
+// File actions of the last spawn on this thread and the pipe they were built
+// for. Building them allocates, and the pipe almost always gets the same fd,
+// so they are kept for the next run.
+static __thread posix_spawn_file_actions_t cached_actions;
+static __thread int cached_out_fd = -1;
+
+// Helper to get file actions putting stdout and stderr on out_fd and stdin on /dev/null
+static posix_spawn_file_actions_t* file_actions(int out_fd) {
+    if (cached_out_fd == out_fd) {
+        return &cached_actions;
+    }
+    if (cached_out_fd >= 0) {
+        posix_spawn_file_actions_destroy(&cached_actions);
+        cached_out_fd = -1;
+    }
+    if (posix_spawn_file_actions_init(&cached_actions) != 0) {
+        return NULL;
+    }
+    if (posix_spawn_file_actions_addopen(&cached_actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0) != 0 ||
+        posix_spawn_file_actions_adddup2(&cached_actions, out_fd, STDOUT_FILENO) != 0 ||
+        posix_spawn_file_actions_adddup2(&cached_actions, out_fd, STDERR_FILENO) != 0) {
+        posix_spawn_file_actions_destroy(&cached_actions);
+        return NULL;
+    }
+    cached_out_fd = out_fd;
+    return &cached_actions;
+}
+
+// Helper to start argv[0] with stdout and stderr on the pipe and stdin on /dev/null.
+// The command gets its own process group so anything it forks is killed with it.
+static int spawn(const char* const* argv, int out_fd, pid_t* pid) {
+    posix_spawn_file_actions_t* actions = file_actions(out_fd);
+    posix_spawnattr_t attr;
+    int ret;
+
+    if (!actions || posix_spawnattr_init(&attr) != 0) {
+        return -1;
+    }
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+
+    ret = posix_spawn(pid, argv[0], actions, &attr, (char* const*)argv, environ);
+    posix_spawnattr_destroy(&attr);
+    if (ret != 0) {
+        errno = ret;
+        return -1;
+    }
+    return 0;
+}
+
+// Helper to reap the child, killing it if it outlives the deadline after
+// closing its output or the caller is cancelled. Returns the raw wait status or -1.
+static int reap(pid_t pid, long long deadline, RunnerResult* result) {
+    const struct timespec pause = {0, 5 * 1000000};
+    int status;
+
+    for (;;) {
+        pid_t ret = waitpid(pid, &status, deadline >= 0 ? WNOHANG : 0);
+        if (ret == pid) {
+            return status;
+        }
+        if (ret < 0 && errno != EINTR) {
+            return -1;
+        }
+        if (ret == 0) {
+            if (cancelled()) {
+                kill(-pid, SIGKILL);
+                result->cancelled = 1;
+                deadline = -1;
+            } else if (now_ms() >= deadline) {
+                kill(-pid, SIGKILL);
+                result->timed_out = 1;
+                deadline = -1;
+            } else {
+                nanosleep(&pause, NULL);
+            }
+        }
+    }
+}
+
+int runner_run(const char* const* argv, int timeout_ms, RunnerBuffer* buf,
+               runner_output_fn on_output, void* ctx, RunnerResult* result) {
+    long long deadline = timeout_ms >= 0 ? now_ms() + timeout_ms : -1;
+    int pipe_fds[2];
+    int status;
+    pid_t pid;
+
+    result->exit_code = -1;
+    result->success = 0;
+    result->timed_out = 0;
+    result->stopped = 0;
+    result->cancelled = 0;
+
+    buf->len = 0;
+    if (reserve(buf, RUNNER_READ_CHUNK + 1) < 0) {
+        return -1;
+    }
+    buf->data[0] = '\0';
+
+    if (pipe2(pipe_fds, O_CLOEXEC) < 0) {
+        return -1;
+    }
+    if (spawn(argv, pipe_fds[1], &pid) < 0) {
+        int saved = errno;
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        errno = saved;
+        return -1;
+    }
+    close(pipe_fds[1]);
+
+    for (;;) {
+        struct pollfd pfd = {pipe_fds[0], POLLIN, 0};
+        int remaining = -1;
+        size_t offset = on_output ? 0 : buf->len;
+        ssize_t n;
+        int ret;
+
+        if (deadline >= 0) {
+            long long left = deadline - now_ms();
+            if (left <= 0) {
+                result->timed_out = 1;
+                break;
+            }
+            remaining = (int)left;
+        }
+
+        ret = poll(&pfd, 1, remaining);
+        if (ret < 0 && errno != EINTR) {
+            break;
+        }
+        if (cancelled()) {
+            // A signal asked us to stop, don't wait for the command
+            result->cancelled = 1;
+            break;
+        }
+        if (ret <= 0) {
+            continue;
+        }
+
+        if (reserve(buf, offset + RUNNER_READ_CHUNK + 1) < 0) {
+            break;
+        }
+        n = read(pipe_fds[0], buf->data + offset, RUNNER_READ_CHUNK);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break; // EOF: the command closed its output
+        }
+        buf->data[offset + (size_t)n] = '\0';
+
+        if (on_output) {
+            if (on_output(buf->data, (size_t)n, ctx)) {
+                result->stopped = 1;
+                break;
+            }
+        } else {
+            buf->len += (size_t)n;
+        }
+    }
+
+    close(pipe_fds[0]);
+    if (result->timed_out || result->stopped || result->cancelled) {
+        kill(-pid, SIGKILL);
+        deadline = -1;
+    }
+    status = reap(pid, deadline, result);
+
+    if (result->stopped) {
+        // Killed on purpose, what we needed was seen
+        result->exit_code = 0;
+        result->success = 1;
+    } else if (status != -1 && WIFEXITED(status)) {
+        result->exit_code = WEXITSTATUS(status);
+        result->success = result->exit_code == 0 && !result->timed_out && !result->cancelled;
+    } else if (status != -1 && WIFSIGNALED(status)) {
+        result->exit_code = 128 + WTERMSIG(status); // Mimic shell signal exit codes
+    }
+    if (on_output) {
+        buf->len = 0;
+        buf->data[0] = '\0';
+    }
+    return 0;
+}
+
+void runner_buffer_free(RunnerBuffer* buf) {
+    free(buf->data);
+    buf->data = NULL;
+    buf->len = 0;
+    buf->capacity = 0;
+}
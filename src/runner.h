@@ -0,0 +1,73 @@
+#ifndef RUNNER_H
+#define RUNNER_H
+
+#include <stddef.h>
+#include <signal.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Output buffer owned by the caller and reused across runs */
+typedef struct {
+    char* data;        /* NUL-terminated output, NULL until the first run */
+    size_t len;
+    size_t capacity;
+} RunnerBuffer;
+
+/* Receives output as it arrives; returns nonzero to stop the command */
+typedef int (*runner_output_fn)(const char* chunk, size_t len, void* ctx);
+
+/* Outcome of runner_run() */
+typedef struct {
+    int exit_code;     /* Exit status, 128 + signal if killed, -1 if it never ran */
+    int success;       /* 1 if the command exited with status 0, or was stopped by on_output */
+    int timed_out;     /* 1 if the deadline expired and the command was killed */
+    int stopped;       /* 1 if on_output ended the command early */
+    int cancelled;     /* 1 if the keep-running flag was cleared and the command was killed */
+} RunnerResult;
+
+/**
+ * @brief Runs a program directly, without a shell, capturing stdout and stderr.
+ *
+ * The program is started with posix_spawn() and its combined output is read
+ * through a pipe with large read() calls. Unless on_output is given, the output
+ * is collected into buf, which grows as needed and keeps its allocation for
+ * the next run. With on_output, each chunk is handed over instead (buf is still
+ * used as scratch space) and the command is killed as soon as it returns nonzero.
+ *
+ * @param argv NULL-terminated argument vector; argv[0] is the path of the program.
+ * @param timeout_ms Deadline for the whole run in milliseconds, or -1 for none.
+ *                   An expired command is killed with SIGKILL and reaped, as is
+ *                   one still running when the keep-running flag is cleared.
+ * @param buf Caller-owned output buffer.
+ * @param on_output Optional streaming callback, or NULL to collect the output.
+ * @param ctx Passed to on_output.
+ * @param result Receives the outcome.
+ * @return 0 if the command was started, -1 if it couldn't be (errno set).
+ */
+int runner_run(const char* const* argv, int timeout_ms, RunnerBuffer* buf,
+               runner_output_fn on_output, void* ctx, RunnerResult* result);
+
+/**
+ * @brief Registers the flag that signal handlers clear to request shutdown.
+ *
+ * Signals interrupt the wait for output; once the flag reads zero the running
+ * command is killed and runner_run() returns with cancelled set.
+ *
+ * @param flag Flag to watch, or NULL to never cancel.
+ */
+void runner_set_keep_running(const volatile sig_atomic_t* flag);
+
+/**
+ * @brief Releases the memory held by an output buffer.
+ *
+ * @param buf Buffer to release; it may be reused afterwards.
+ */
+void runner_buffer_free(RunnerBuffer* buf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RUNNER_H
@@ -0,0 +1,140 @@
+#include "scan.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__) && !defined(SCAN_NO_SIMD)
+#define SCAN_SSE2 1
+#include <emmintrin.h>
+#elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && !defined(SCAN_NO_SIMD)
+#define SCAN_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Bytes compared per vector step
+#define SCAN_BLOCK 16
+
+static int simd_enabled = 1;
+
+const char* scan_implementation(void) {
+#if defined(SCAN_SSE2)
+    return "sse2";
+#elif defined(SCAN_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
+
+void scan_set_simd(int enabled) {
+    simd_enabled = enabled;
+}
+
+// Scalar code, also used for the tail shorter than a block
+static const char* find_scalar(const char* p, const char* end, const char* needle, size_t needle_len) {
+    while ((size_t)(end - p) >= needle_len) {
+        const char* hit = memchr(p, needle[0], (size_t)(end - p) - needle_len + 1);
+        if (!hit) {
+            return NULL;
+        }
+        if (memcmp(hit + 1, needle + 1, needle_len - 1) == 0) {
+            return hit;
+        }
+        p = hit + 1;
+    }
+    return NULL;
+}
+
+#if defined(SCAN_SSE2) || defined(SCAN_NEON)
+
+#if defined(SCAN_SSE2)
+typedef __m128i Vector;
+#define vector_splat(c) _mm_set1_epi8((char)(c))
+#define vector_load(p) _mm_loadu_si128((const __m128i*)(const void*)(p))
+
+// Bit i set where bytes i of a and b both match, one bit per byte
+static uint64_t match_mask(Vector a, Vector first, Vector b, Vector last) {
+    __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last));
+    return (uint64_t)_mm_movemask_epi8(eq);
+}
+#define MASK_SHIFT 0
+
+// Bit i set where byte i of a equals c
+static uint64_t byte_mask(Vector a, Vector c) {
+    return (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a, c));
+}
+#else
+typedef uint8x16_t Vector;
+#define vector_splat(c) vdupq_n_u8((uint8_t)(c))
+#define vector_load(p) vld1q_u8((const uint8_t*)(const void*)(p))
+
+// NEON has no movemask; narrowing by 4 bits keeps a nibble per byte
+static uint64_t narrow_mask(uint8x16_t eq) {
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+}
+
+static uint64_t match_mask(Vector a, Vector first, Vector b, Vector last) {
+    return narrow_mask(vandq_u8(vceqq_u8(a, first), vceqq_u8(b, last)));
+}
+#define MASK_SHIFT 2
+
+static uint64_t byte_mask(Vector a, Vector c) {
+    return narrow_mask(vceqq_u8(a, c));
+}
+#endif
+
+// Helper to take the lowest set position of a mask, in bytes
+static size_t next_position(uint64_t* mask) {
+    int bit = __builtin_ctzll(*mask);
+    // Clear the whole bit group of this byte
+    *mask &= ~((((uint64_t)1 << (1 << MASK_SHIFT)) - 1) << bit);
+    return (size_t)bit >> MASK_SHIFT;
+}
+
+static const char* byte_simd(const char* p, const char* end, char c) {
+    Vector wanted = vector_splat(c);
+
+    for (; end - p >= SCAN_BLOCK; p += SCAN_BLOCK) {
+        uint64_t mask = byte_mask(vector_load(p), wanted);
+        if (mask) {
+            return p + next_position(&mask);
+        }
+    }
+    return memchr(p, c, (size_t)(end - p));
+}
+
+static const char* find_simd(const char* p, const char* end, const char* needle, size_t needle_len) {
+    Vector first = vector_splat(needle[0]);
+    Vector last = vector_splat(needle[needle_len - 1]);
+
+    // Both loads of a step stay inside the buffer
+    for (; (size_t)(end - p) >= needle_len - 1 + SCAN_BLOCK; p += SCAN_BLOCK) {
+        uint64_t mask = match_mask(vector_load(p), first, vector_load(p + needle_len - 1), last);
+        while (mask) {
+            const char* candidate = p + next_position(&mask);
+            if (needle_len <= 2 || memcmp(candidate + 1, needle + 1, needle_len - 2) == 0) {
+                return candidate;
+            }
+        }
+    }
+    return find_scalar(p, end, needle, needle_len);
+}
+
+#endif
+
+const char* scan_byte(const char* p, const char* end, char c) {
+#if defined(SCAN_SSE2) || defined(SCAN_NEON)
+    if (simd_enabled) {
+        return byte_simd(p, end, c);
+    }
+#endif
+    return memchr(p, c, (size_t)(end - p));
+}
+
+const char* scan_find(const char* p, const char* end, const char* needle, size_t needle_len) {
+#if defined(SCAN_SSE2) || defined(SCAN_NEON)
+    if (simd_enabled && needle_len > 1) {
+        return find_simd(p, end, needle, needle_len);
+    }
+#endif
+    return find_scalar(p, end, needle, needle_len);
+}
@@ -0,0 +1,59 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Names the vectorized code compiled in.
+ *
+ * SSE2 is used on amd64 and NEON on arm64, picked at build time from the
+ * compiler's target; other targets, or builds with -DSCAN_NO_SIMD, only
+ * have the scalar code.
+ *
+ * @return "sse2", "neon" or "scalar".
+ */
+const char* scan_implementation(void);
+
+/**
+ * @brief Switches between the vectorized and the scalar code.
+ *
+ * For tests and benchmarks comparing the two; the vectorized code is used
+ * by default when compiled in.
+ *
+ * @param enabled 0 to force the scalar code.
+ */
+void scan_set_simd(int enabled);
+
+/**
+ * @brief Finds the first occurrence of a byte, like memchr().
+ *
+ * @param p Start of the buffer.
+ * @param end End of the buffer (one past the last byte).
+ * @param c Byte to look for.
+ * @return Pointer to the byte, or NULL if it isn't in [p, end).
+ */
+const char* scan_byte(const char* p, const char* end, char c);
+
+/**
+ * @brief Finds the first occurrence of a needle, like memmem().
+ *
+ * The vectorized code compares the first and last byte of the needle at
+ * sixteen positions at once and only checks the rest where both match.
+ *
+ * @param p Start of the buffer.
+ * @param end End of the buffer (one past the last byte).
+ * @param needle Bytes to look for.
+ * @param needle_len Length of the needle, at least 1.
+ * @return Pointer to the first match, or NULL if there is none.
+ */
+const char* scan_find(const char* p, const char* end, const char* needle, size_t needle_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SCAN_H
@@ -0,0 +1,83 @@
+#define _DEFAULT_SOURCE
+#include "scheduler.h"
+#include <time.h>
+
+void scheduler_init(Scheduler* scheduler, uint32_t seed) {
+    scheduler->interval_ms = SCHEDULER_DEFAULT_INTERVAL_MS;
+    scheduler->attached_ms = SCHEDULER_DEFAULT_ATTACHED_MS;
+    scheduler->max_backoff_ms = SCHEDULER_DEFAULT_MAX_BACKOFF_MS;
+    scheduler->fast_retry_ms = SCHEDULER_DEFAULT_FAST_RETRY_MS;
+    scheduler->fast_retries = SCHEDULER_DEFAULT_FAST_RETRIES;
+    scheduler->jitter_percent = SCHEDULER_DEFAULT_JITTER_PERCENT;
+    scheduler->rng = seed ? seed : 0x9e3779b9u;
+}
+
+// Helper returning the next xorshift32 value
+static uint32_t next_random(Scheduler* scheduler) {
+    uint32_t x = scheduler->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    scheduler->rng = x;
+    return x;
+}
+
+// Helper to spread a delay by +/- jitter_percent
+static int apply_jitter(Scheduler* scheduler, int delay_ms) {
+    long long spread = (long long)delay_ms * scheduler->jitter_percent / 100;
+    long long offset;
+
+    if (spread <= 0) {
+        return delay_ms;
+    }
+    offset = (long long)(next_random(scheduler) % (uint32_t)(2 * spread + 1)) - spread;
+    return (int)(delay_ms + offset);
+}
+
+void scheduler_derive(Scheduler* base, Scheduler* derived) {
+    uint32_t seed = next_random(base);
+
+    *derived = *base;
+    derived->rng = seed ? seed : 0x9e3779b9u;
+}
+
+void scheduler_note_detach(const Scheduler* scheduler, TargetSchedule* target) {
+    target->failures = 0;
+    target->fast_retries_left = scheduler->fast_retries;
+}
+
+int scheduler_next_delay(Scheduler* scheduler, TargetSchedule* target, int outcome) {
+    long long delay;
+    int i;
+
+    if (outcome == SCHED_ATTACHED) {
+        target->failures = 0;
+        target->fast_retries_left = 0;
+        return scheduler->attached_ms;
+    }
+
+    if (target->fast_retries_left > 0) {
+        target->fast_retries_left--;
+        return scheduler->fast_retry_ms;
+    }
+
+    // interval, 2x, 4x ... capped; stop doubling once the cap is reached
+    delay = scheduler->interval_ms;
+    for (i = 0; i < target->failures && delay < scheduler->max_backoff_ms; i++) {
+        delay *= 2;
+    }
+    if (delay > scheduler->max_backoff_ms) {
+        delay = scheduler->max_backoff_ms;
+    }
+    if (delay < scheduler->interval_ms) {
+        delay = scheduler->interval_ms;
+    }
+    target->failures++;
+    return apply_jitter(scheduler, (int)delay);
+}
+
+long long scheduler_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
@@ -0,0 +1,92 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Defaults for the check schedule, all in milliseconds except counts */
+#define SCHEDULER_DEFAULT_INTERVAL_MS      5000
+#define SCHEDULER_DEFAULT_ATTACHED_MS      60000
+#define SCHEDULER_DEFAULT_MAX_BACKOFF_MS   300000
+#define SCHEDULER_DEFAULT_FAST_RETRY_MS    250
+#define SCHEDULER_DEFAULT_FAST_RETRIES     8
+#define SCHEDULER_DEFAULT_JITTER_PERCENT   20
+
+/* Outcome of one check of a device, as far as scheduling is concerned */
+#define SCHED_ATTACHED 0   /* Attached, or just attached successfully */
+#define SCHED_FAILED   1   /* Not available, attach failed or the host timed out */
+
+/* Tunables for one device or a group of devices, plus the jitter generator */
+typedef struct {
+    int interval_ms;       /* First retry delay after a failure */
+    int attached_ms;       /* Steady-state delay while attached */
+    int max_backoff_ms;    /* Cap for the exponential backoff */
+    int fast_retry_ms;     /* Delay between retries right after a detach */
+    int fast_retries;      /* Number of fast retries after a detach */
+    int jitter_percent;    /* Random spread applied to backoff delays, +/- percent */
+    uint32_t rng;          /* xorshift32 state, never 0 */
+} Scheduler;
+
+/* Per-device schedule state */
+typedef struct {
+    int failures;          /* Consecutive failed checks */
+    int fast_retries_left; /* Fast retries remaining since the last detach */
+} TargetSchedule;
+
+/**
+ * @brief Initializes a scheduler with the default tunables.
+ *
+ * @param scheduler Scheduler to initialize.
+ * @param seed Seed for the jitter; any value, e.g. the pid mixed with the time.
+ */
+void scheduler_init(Scheduler* scheduler, uint32_t seed);
+
+/**
+ * @brief Makes a scheduler for one device from a base scheduler.
+ *
+ * The tunables are copied, to be changed for that device, and the jitter
+ * gets its own seed drawn from the base so devices don't move in lockstep.
+ *
+ * @param base Scheduler holding the defaults; its jitter state advances.
+ * @param derived Scheduler to initialize.
+ */
+void scheduler_derive(Scheduler* base, Scheduler* derived);
+
+/**
+ * @brief Starts a fast-retry burst for a device that was just detached.
+ *
+ * @param scheduler Scheduler holding the tunables.
+ * @param target Schedule of the detached device.
+ */
+void scheduler_note_detach(const Scheduler* scheduler, TargetSchedule* target);
+
+/**
+ * @brief Records the outcome of a check and returns the delay until the next one.
+ *
+ * Attached devices are checked every attached_ms. Failures are retried every
+ * fast_retry_ms while a burst started by scheduler_note_detach() lasts, then
+ * after interval_ms, doubling on each further failure up to max_backoff_ms,
+ * with jitter so devices sharing a host don't retry in lockstep.
+ *
+ * @param scheduler Scheduler holding the tunables and jitter state.
+ * @param target Schedule of the checked device.
+ * @param outcome SCHED_ATTACHED or SCHED_FAILED.
+ * @return Delay in milliseconds until the device should be checked again.
+ */
+int scheduler_next_delay(Scheduler* scheduler, TargetSchedule* target, int outcome);
+
+/**
+ * @brief Returns CLOCK_MONOTONIC in milliseconds, the time base for check deadlines.
+ *
+ * @return Current monotonic time in milliseconds.
+ */
+long long scheduler_now_ms(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SCHEDULER_H
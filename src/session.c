@@ -0,0 +1,143 @@
+#define _DEFAULT_SOURCE
+#include "session.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+// Helper to read the monotonic clock in microseconds, for RTTs
+static long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void session_table_init(SessionTable* table) {
+    table->count = 0;
+}
+
+HostSession* session_get(SessionTable* table, const char* host) {
+    HostSession* session = NULL;
+    int i;
+
+    for (i = 0; i < table->count; i++) {
+        if (table->hosts[i].users == 0) {
+            // Released; the first one found is reused if the host is new
+            if (!session) {
+                session = &table->hosts[i];
+            }
+        } else if (strcmp(table->hosts[i].host, host) == 0) {
+            table->hosts[i].users++;
+            return &table->hosts[i];
+        }
+    }
+    if (!session) {
+        if (table->count == SESSION_MAX_HOSTS) {
+            return NULL;
+        }
+        session = &table->hosts[table->count++];
+    }
+
+    session->users = 1;
+    snprintf(session->host, sizeof(session->host), "%s", host);
+    session->alive = -1;
+    session->cached = 0;
+    session->listed_ms = 0;
+    session->device_count = 0;
+    session->rtt_us = 0;
+    session->rtt_samples = 0;
+    return session;
+}
+
+void session_put(HostSession* session) {
+    if (session->users > 0) {
+        session->users--;
+    }
+}
+
+int session_cache_valid(const HostSession* session, long long now_ms, int ttl_ms) {
+    return session->cached && now_ms - session->listed_ms < ttl_ms;
+}
+
+int session_probe(HostSession* session, const char* port) {
+    long long start_us = now_us();
+
+    if (usbip_net_probe(session->host, port) == 0) {
+        session->alive = 1;
+        session_observe_rtt(session, now_us() - start_us);
+        return 0;
+    }
+    // Whatever the host exports once it is back has to be listed afresh
+    session->alive = 0;
+    session->cached = 0;
+    return -1;
+}
+
+int session_refresh(HostSession* session, const char* port, long long now_ms, int ttl_ms) {
+    int count;
+
+    if (session_cache_valid(session, now_ms, ttl_ms)) {
+        return session_probe(session, port) == 0 ? SESSION_PROBED : SESSION_FAILED;
+    }
+
+    // Busids are decoded straight into the session, which only its own refresh writes
+    count = usbip_devlist_busids(session->host, port, session->busids, SESSION_MAX_DEVICES);
+    if (count < 0) {
+        // A reply cut short may have overwritten part of the old listing
+        session->alive = 0;
+        session->cached = 0;
+        session->device_count = 0;
+        return SESSION_FAILED;
+    }
+
+    session->alive = 1;
+    session->device_count = count < SESSION_MAX_DEVICES ? count : SESSION_MAX_DEVICES;
+    // A partial listing can answer this call but not stand in for later ones
+    session->cached = count <= SESSION_MAX_DEVICES;
+    session->listed_ms = now_ms;
+    return SESSION_LISTED;
+}
+
+void session_observe_rtt(HostSession* session, long long rtt_us) {
+    if (session->rtt_samples == 0) {
+        session->rtt_us = rtt_us;
+    } else {
+        session->rtt_us += (rtt_us - session->rtt_us) / 8;
+    }
+    session->rtt_samples++;
+}
+
+int session_pick(HostSession* const* sessions, const int* usable, int count, int by_rtt) {
+    int best = -1;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (!usable[i]) {
+            continue;
+        }
+        if (!by_rtt) {
+            return i;
+        }
+        // Earlier hosts win ties, and anything timed beats a host not timed yet
+        if (best < 0 || (sessions[i]->rtt_samples > 0 &&
+                         (sessions[best]->rtt_samples == 0 || sessions[i]->rtt_us < sessions[best]->rtt_us))) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+int session_has_device(const HostSession* session, const char* busid) {
+    int i;
+
+    for (i = 0; i < session->device_count; i++) {
+        if (strcmp(session->busids[i], busid) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void session_invalidate(HostSession* session) {
+    session->cached = 0;
+}
@@ -0,0 +1,157 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "usbip_net.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Remote hosts tracked at once */
+#define SESSION_MAX_HOSTS 256
+/* Longest host name or address kept, terminator included */
+#define SESSION_HOST_MAX 256
+/* Exported busids cached per host; bigger listings are not cached */
+#define SESSION_MAX_DEVICES 256
+/* Default age after which a cached listing is fetched again */
+#define SESSION_DEFAULT_TTL_MS 30000
+
+/* Outcomes of session_refresh() */
+#define SESSION_FAILED -1  /* Host unreachable, listing dropped */
+#define SESSION_PROBED  0  /* Host answered a probe, cached listing still current */
+#define SESSION_LISTED  1  /* Listing fetched with OP_REQ_DEVLIST */
+
+/* What is known about one remote usbipd */
+typedef struct {
+    char host[SESSION_HOST_MAX];
+    int users;            /* Holders from session_get(); a session without any is free for reuse */
+    int alive;            /* 1 if the last contact succeeded, 0 if it failed, -1 before any */
+    int cached;           /* 1 if busids holds a usable listing */
+    long long listed_ms;  /* Monotonic time the listing was fetched */
+    int device_count;     /* Entries in busids */
+    char busids[SESSION_MAX_DEVICES][USBIP_SYSFS_BUS_ID_SIZE];
+    long long rtt_us;     /* Smoothed time of successful connect probes, 0 before any */
+    unsigned long rtt_samples; /* Probes averaged into rtt_us */
+} HostSession;
+
+/* One session per distinct host */
+typedef struct {
+    HostSession hosts[SESSION_MAX_HOSTS];
+    int count;            /* Slots ever used, released ones included */
+} SessionTable;
+
+/**
+ * @brief Empties a session table.
+ *
+ * @param table Table to initialize.
+ */
+void session_table_init(SessionTable* table);
+
+/**
+ * @brief Finds the session of a host, creating it on first use.
+ *
+ * Each call takes a hold on the session, to be given back with
+ * session_put() once the caller no longer uses it. A session nobody holds
+ * is forgotten, and its slot goes to the next new host.
+ *
+ * @param table Table holding the sessions.
+ * @param host Host name or IP address, compared as a string.
+ * @return The host's session, or NULL if every slot is held.
+ */
+HostSession* session_get(SessionTable* table, const char* host);
+
+/**
+ * @brief Gives back a hold taken by session_get().
+ *
+ * @param session Session no longer used by the caller.
+ */
+void session_put(HostSession* session);
+
+/**
+ * @brief Checks whether the cached listing of a session can still be used.
+ *
+ * @param session Session to check.
+ * @param now_ms Current monotonic time in milliseconds.
+ * @param ttl_ms Maximum age of a listing, 0 to never use the cache.
+ * @return 1 if a refresh would only probe the host, 0 if it would list it.
+ */
+int session_cache_valid(const HostSession* session, long long now_ms, int ttl_ms);
+
+/**
+ * @brief Checks that a host still answers, timing the check.
+ *
+ * Makes the same connect-and-close probe as usbip_net_probe(). The time a
+ * successful probe took is averaged into the host's RTT; listings and
+ * `usbip` runs are never timed, as they cost far more than the network.
+ * A failed probe marks the host down and drops its listing.
+ *
+ * @param session Session of the host.
+ * @param port TCP port as a string, usually USBIP_DEFAULT_PORT.
+ * @return 0 if the host answered, -1 otherwise (errno as for usbip_net_probe()).
+ */
+int session_probe(HostSession* session, const char* port);
+
+/**
+ * @brief Brings a session's listing up to date at the lowest cost.
+ *
+ * While the cached listing is younger than ttl_ms, only a session_probe()
+ * is made. The listing is fetched again once it expires, or once the host
+ * comes back after failing a probe or a listing. Sessions of different
+ * hosts may be refreshed from different threads at once.
+ *
+ * @param session Session to refresh.
+ * @param port TCP port as a string, usually USBIP_DEFAULT_PORT.
+ * @param now_ms Current monotonic time in milliseconds.
+ * @param ttl_ms Maximum age of a listing, 0 to list on every call.
+ * @return SESSION_LISTED, SESSION_PROBED, or SESSION_FAILED with errno set
+ *         as by usbip_devlist().
+ */
+int session_refresh(HostSession* session, const char* port, long long now_ms, int ttl_ms);
+
+/**
+ * @brief Averages one round-trip time into a session's RTT.
+ *
+ * Smoothed like TCP's SRTT, with a weight of 1/8 for the new sample, so one
+ * slow reply doesn't reorder hosts. session_probe() calls this itself; only
+ * samples of the same kind should be averaged in, so hosts compare fairly.
+ *
+ * @param session Session of the host.
+ * @param rtt_us Time the contact took, in microseconds.
+ */
+void session_observe_rtt(HostSession* session, long long rtt_us);
+
+/**
+ * @brief Picks the host to use among several exporting the same device.
+ *
+ * @param sessions Sessions of the hosts, in the order the user gave them.
+ * @param usable 1 for each host that may be used, e.g. because it lists the device.
+ * @param count Number of hosts.
+ * @param by_rtt 1 to prefer the lowest RTT, with hosts not timed yet after
+ *               the others; 0 to take the first usable host in order.
+ * @return Index of the host to use, or -1 if none is usable.
+ */
+int session_pick(HostSession* const* sessions, const int* usable, int count, int by_rtt);
+
+/**
+ * @brief Looks up a busid in the listing of a session.
+ *
+ * @param session Session refreshed by a successful session_refresh().
+ * @param busid The busid (e.g., "1-2") to look for.
+ * @return 1 if the busid is exported, 0 otherwise.
+ */
+int session_has_device(const HostSession* session, const char* busid);
+
+/**
+ * @brief Drops the cached listing so the next refresh lists the host.
+ *
+ * For when the listing proved wrong, e.g. an import of a listed busid failed.
+ *
+ * @param session Session to invalidate.
+ */
+void session_invalidate(HostSession* session);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SESSION_H
@@ -0,0 +1,42 @@
+#define _DEFAULT_SOURCE
+#include "settle.h"
+#include "scheduler.h"
+#include <time.h>
+
+// Helper to pause for a number of milliseconds; a signal ends the pause early
+static void pause_ms(long long ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000;
+    nanosleep(&ts, NULL);
+}
+
+int settle_wait(settle_check_fn check, void* ctx, int timeout_ms, int first_step_ms, SettleResult* result) {
+    long long start_ms = scheduler_now_ms();
+    long long deadline_ms = start_ms + (timeout_ms > 0 ? timeout_ms : 0);
+    long long step_ms = first_step_ms > 0 ? first_step_ms : 1;
+    long long now_ms = start_ms;
+    int checks = 0;
+    int state;
+
+    for (;;) {
+        state = check(ctx);
+        checks++;
+        if (state != SETTLE_PENDING || now_ms >= deadline_ms) {
+            break;
+        }
+
+        // Sleep until the next step, or just up to the deadline for a last check
+        pause_ms(deadline_ms - now_ms < step_ms ? deadline_ms - now_ms : step_ms);
+        now_ms = scheduler_now_ms();
+        if (step_ms < SETTLE_MAX_STEP_MS) {
+            step_ms = step_ms * 2 < SETTLE_MAX_STEP_MS ? step_ms * 2 : SETTLE_MAX_STEP_MS;
+        }
+    }
+
+    if (result) {
+        result->checks = checks;
+        result->waited_ms = now_ms - start_ms;
+    }
+    return state;
+}
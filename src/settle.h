@@ -0,0 +1,48 @@
+#ifndef SETTLE_H
+#define SETTLE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Defaults for waiting on an attach to show up, in milliseconds */
+#define SETTLE_DEFAULT_TIMEOUT_MS 10000
+#define SETTLE_FIRST_STEP_MS      10   /* Pause after the first check, doubled after each further one */
+#define SETTLE_MAX_STEP_MS        500  /* Cap for the pause between checks */
+
+/* Results of a check, and of settle_wait() */
+#define SETTLE_GAVE_UP -1  /* The check asked to stop, e.g. on shutdown */
+#define SETTLE_PENDING  0  /* Not there yet; for settle_wait(), the deadline passed */
+#define SETTLE_READY    1  /* The awaited state was reached */
+
+/* Checks whether the awaited state was reached; returns a SETTLE_* value */
+typedef int (*settle_check_fn)(void* ctx);
+
+/* What a wait came to */
+typedef struct {
+    int checks;            /* Times the check was called */
+    long long waited_ms;   /* Time from the start of the wait to its last check */
+} SettleResult;
+
+/**
+ * @brief Waits for a state to be reached, checking in short exponential steps.
+ *
+ * The first check is made at once, so a state reached before the call costs
+ * no wait at all. Further checks follow after first_step_ms, doubling up to
+ * SETTLE_MAX_STEP_MS, and a last one is made at the deadline. Signals only
+ * cut a pause short.
+ *
+ * @param check Called for each check.
+ * @param ctx Passed through to check.
+ * @param timeout_ms Time allowed for the state to be reached; 0 for a single check.
+ * @param first_step_ms Pause after the first check, e.g. SETTLE_FIRST_STEP_MS.
+ * @param result Receives the number of checks and the time waited; may be NULL.
+ * @return SETTLE_READY, SETTLE_PENDING if the deadline passed, or SETTLE_GAVE_UP.
+ */
+int settle_wait(settle_check_fn check, void* ctx, int timeout_ms, int first_step_ms, SettleResult* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SETTLE_H
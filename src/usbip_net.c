@@ -0,0 +1,444 @@
+#define _DEFAULT_SOURCE
+#include "usbip_net.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+// Size of struct op_common (version, code, status)
+#define OP_COMMON_SIZE 8
+// Size of struct usbip_usb_device and struct usbip_usb_interface on the wire
+#define USB_DEVICE_WIRE_SIZE 312
+#define USB_INTERFACE_WIRE_SIZE 4
+
+// Deadline for one connect or request/reply exchange
+static int timeout_ms = USBIP_NET_DEFAULT_TIMEOUT_MS;
+// Idle seconds before keepalive probes on imported connections, 0 for system defaults
+static int keepalive_s = USBIP_NET_DEFAULT_KEEPALIVE_S;
+// Cleared by the caller's signal handler to abandon the exchange
+static const volatile sig_atomic_t* keep_running_flag;
+
+void usbip_net_set_timeout(int new_timeout_ms) {
+    timeout_ms = new_timeout_ms;
+}
+
+void usbip_net_set_keepalive(int idle_s) {
+    keepalive_s = idle_s;
+}
+
+void usbip_net_set_keep_running(const volatile sig_atomic_t* flag) {
+    keep_running_flag = flag;
+}
+
+// Helper returning CLOCK_MONOTONIC in milliseconds
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Helper returning the deadline for an exchange starting now
+static long long start_deadline(void) {
+    return timeout_ms >= 0 ? now_ms() + timeout_ms : -1;
+}
+
+// Helper to wait until fd is ready or the deadline passes.
+// Returns 0 when ready, -1 with errno ETIMEDOUT or ECANCELED otherwise.
+static int wait_fd(int fd, short events, long long deadline) {
+    for (;;) {
+        struct pollfd pfd = {fd, events, 0};
+        int remaining = -1;
+        int ret;
+
+        if (deadline >= 0) {
+            long long left = deadline - now_ms();
+            if (left <= 0) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+            remaining = (int)left;
+        }
+        ret = poll(&pfd, 1, remaining);
+        if (keep_running_flag && !*keep_running_flag) {
+            errno = ECANCELED;
+            return -1;
+        }
+        if (ret > 0) {
+            return 0;
+        }
+        if (ret < 0 && errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+// Helpers to decode big-endian fields from a wire buffer
+static uint32_t get_be32(const unsigned char* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint16_t get_be16(const unsigned char* p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static void put_be16(unsigned char* p, uint16_t v) {
+    p[0] = (unsigned char)(v >> 8);
+    p[1] = (unsigned char)v;
+}
+
+// Helper to read exactly len bytes before the deadline, returns 0 on success, -1 on error/EOF
+static int recv_all(int fd, void* buf, size_t len, long long deadline) {
+    unsigned char* p = buf;
+    while (len > 0) {
+        ssize_t n;
+        if (wait_fd(fd, POLLIN, deadline) < 0) {
+            return -1;
+        }
+        n = recv(fd, p, len, MSG_DONTWAIT);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Helper to write exactly len bytes before the deadline, returns 0 on success, -1 on error
+static int send_all(int fd, const void* buf, size_t len, long long deadline) {
+    const unsigned char* p = buf;
+    while (len > 0) {
+        ssize_t n;
+        if (wait_fd(fd, POLLOUT, deadline) < 0) {
+            return -1;
+        }
+        n = send(fd, p, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Helper to send an op_common header with the given code
+static int send_op_common(int fd, uint16_t code, long long deadline) {
+    unsigned char header[OP_COMMON_SIZE] = {0};
+    put_be16(header, USBIP_VERSION);
+    put_be16(header + 2, code);
+    return send_all(fd, header, sizeof(header), deadline);
+}
+
+// Helper to receive an op_common header and check code and status
+static int recv_op_common(int fd, uint16_t expected_code, long long deadline) {
+    unsigned char header[OP_COMMON_SIZE];
+    if (recv_all(fd, header, sizeof(header), deadline) < 0) {
+        return -1;
+    }
+    if (get_be16(header + 2) != expected_code || get_be32(header + 4) != 0) {
+        errno = EPROTO;
+        return -1;
+    }
+    return 0;
+}
+
+// Helper to decode one struct usbip_usb_device
+static void decode_device(const unsigned char* p, UsbipDevice* dev) {
+    memcpy(dev->path, p, USBIP_SYSFS_PATH_MAX);
+    dev->path[USBIP_SYSFS_PATH_MAX - 1] = '\0';
+    p += USBIP_SYSFS_PATH_MAX;
+    memcpy(dev->busid, p, USBIP_SYSFS_BUS_ID_SIZE);
+    dev->busid[USBIP_SYSFS_BUS_ID_SIZE - 1] = '\0';
+    p += USBIP_SYSFS_BUS_ID_SIZE;
+    dev->busnum = get_be32(p);
+    dev->devnum = get_be32(p + 4);
+    dev->speed = get_be32(p + 8);
+    dev->id_vendor = get_be16(p + 12);
+    dev->id_product = get_be16(p + 14);
+    dev->bcd_device = get_be16(p + 16);
+    dev->device_class = p[18];
+    dev->device_subclass = p[19];
+    dev->device_protocol = p[20];
+    dev->configuration_value = p[21];
+    dev->num_configurations = p[22];
+    dev->num_interfaces = p[23];
+}
+
+// Helper to connect a non-blocking socket before the deadline, returns 0 on success
+static int connect_before(int fd, const struct sockaddr* addr, socklen_t addr_len, long long deadline) {
+    int flags = fcntl(fd, F_GETFL);
+    int err = 0;
+    socklen_t err_len = sizeof(err);
+
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return -1;
+    }
+    if (connect(fd, addr, addr_len) < 0) {
+        if (errno != EINPROGRESS) {
+            return -1;
+        }
+        if (wait_fd(fd, POLLOUT, deadline) < 0) {
+            return -1;
+        }
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_len) < 0 || err != 0) {
+            errno = err ? err : errno;
+            return -1;
+        }
+    }
+    // Back to blocking mode, the kernel may take the socket over
+    return fcntl(fd, F_SETFL, flags);
+}
+
+// Helper to connect to one address, returns the socket or -1 with errno set
+static int connect_address(const struct sockaddr* addr, socklen_t addr_len, long long deadline) {
+    int fd = socket(addr->sa_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int one = 1;
+    int err;
+
+    if (fd < 0) {
+        return -1;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect_before(fd, addr, addr_len, deadline) < 0) {
+        err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+// Helper to build the address of an IP literal and a port number without
+// getaddrinfo(), which allocates on every call. Returns 0 on success, -1 if
+// the resolver is needed (host names, scoped IPv6 addresses).
+static int numeric_address(const char* host, const char* port, struct sockaddr_storage* addr, socklen_t* addr_len) {
+    struct sockaddr_in* in4 = (struct sockaddr_in*)addr;
+    struct sockaddr_in6* in6 = (struct sockaddr_in6*)addr;
+    char* end;
+    long number = strtol(port, &end, 10);
+
+    if (end == port || *end || number <= 0 || number > 65535) {
+        return -1;
+    }
+    memset(addr, 0, sizeof(*addr));
+    if (inet_pton(AF_INET, host, &in4->sin_addr) == 1) {
+        in4->sin_family = AF_INET;
+        in4->sin_port = htons((uint16_t)number);
+        *addr_len = sizeof(*in4);
+        return 0;
+    }
+    if (inet_pton(AF_INET6, host, &in6->sin6_addr) == 1) {
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons((uint16_t)number);
+        *addr_len = sizeof(*in6);
+        return 0;
+    }
+    return -1;
+}
+
+// Helper behind usbip_net_connect() sharing the caller's deadline
+static int connect_host(const char* host, const char* port, long long deadline) {
+    struct addrinfo hints, *res, *ai;
+    struct sockaddr_storage numeric;
+    socklen_t numeric_len;
+    int fd = -1;
+    int err = EHOSTUNREACH;
+
+    // The usual case, an address on the command line, is checked without the resolver
+    if (numeric_address(host, port, &numeric, &numeric_len) == 0) {
+        return connect_address((struct sockaddr*)&numeric, numeric_len, deadline);
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(host, port, &hints, &res) != 0) {
+        errno = EHOSTUNREACH;
+        return -1;
+    }
+
+    for (ai = res; ai; ai = ai->ai_next) {
+        fd = connect_address(ai->ai_addr, ai->ai_addrlen, deadline);
+        if (fd >= 0) {
+            break;
+        }
+        err = errno;
+        // Out of time or told to stop, don't try the other addresses
+        if (err == ETIMEDOUT || err == ECANCELED) {
+            break;
+        }
+    }
+
+    freeaddrinfo(res);
+    if (fd < 0) {
+        errno = err;
+    }
+    return fd;
+}
+
+int usbip_net_connect(const char* host, const char* port) {
+    return connect_host(host, port, start_deadline());
+}
+
+int usbip_net_probe(const char* host, const char* port) {
+    int fd = connect_host(host, port, start_deadline());
+
+    if (fd < 0) {
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+// Helper to enable keepalive with the configured timing
+static void enable_keepalive(int fd) {
+    int one = 1;
+
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+    if (keepalive_s > 0) {
+        int interval = keepalive_s / 3 > 0 ? keepalive_s / 3 : 1;
+        int probes = USBIP_NET_KEEPALIVE_PROBES;
+
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &keepalive_s, sizeof(keepalive_s));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes));
+    }
+}
+
+// Helper behind usbip_recv_devlist() sharing the caller's deadline; fills either
+// devices or, for callers that only need them, busids
+static int recv_devlist(int fd, UsbipDevice* devices, char (*busids)[USBIP_SYSFS_BUS_ID_SIZE], int max_devices,
+                        long long deadline) {
+    unsigned char ndev_buf[4];
+    unsigned char dev_buf[USB_DEVICE_WIRE_SIZE];
+    unsigned char intf_buf[USB_INTERFACE_WIRE_SIZE];
+    uint32_t ndev, i, j;
+
+    if (recv_op_common(fd, OP_REP_DEVLIST, deadline) < 0 ||
+        recv_all(fd, ndev_buf, sizeof(ndev_buf), deadline) < 0) {
+        return -1;
+    }
+    ndev = get_be32(ndev_buf);
+
+    for (i = 0; i < ndev; i++) {
+        UsbipDevice dev;
+
+        if (recv_all(fd, dev_buf, sizeof(dev_buf), deadline) < 0) {
+            return -1;
+        }
+        decode_device(dev_buf, &dev);
+
+        // Interface descriptors are not needed, just consume them
+        for (j = 0; j < dev.num_interfaces; j++) {
+            if (recv_all(fd, intf_buf, sizeof(intf_buf), deadline) < 0) {
+                return -1;
+            }
+        }
+
+        if ((int)i < max_devices) {
+            if (devices) {
+                devices[i] = dev;
+            } else {
+                memcpy(busids[i], dev.busid, USBIP_SYSFS_BUS_ID_SIZE);
+            }
+        }
+    }
+
+    return (int)ndev;
+}
+
+int usbip_recv_devlist(int fd, UsbipDevice* devices, int max_devices) {
+    return recv_devlist(fd, devices, NULL, max_devices, start_deadline());
+}
+
+// Helper behind usbip_devlist() and usbip_devlist_busids()
+static int devlist(const char* host, const char* port, UsbipDevice* devices, char (*busids)[USBIP_SYSFS_BUS_ID_SIZE],
+                   int max_devices) {
+    long long deadline = start_deadline();
+    int count, saved;
+    int fd = connect_host(host, port, deadline);
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    count = -1;
+    if (send_op_common(fd, OP_REQ_DEVLIST, deadline) == 0) {
+        count = recv_devlist(fd, devices, busids, max_devices, deadline);
+    }
+    saved = errno;
+    close(fd);
+    errno = saved;
+    return count;
+}
+
+int usbip_devlist(const char* host, const char* port, UsbipDevice* devices, int max_devices) {
+    return devlist(host, port, devices, NULL, max_devices);
+}
+
+int usbip_devlist_busids(const char* host, const char* port, char (*busids)[USBIP_SYSFS_BUS_ID_SIZE], int max_busids) {
+    return devlist(host, port, NULL, busids, max_busids);
+}
+
+int usbip_import(const char* host, const char* port, const char* busid, UsbipDevice* device) {
+    unsigned char request[USBIP_SYSFS_BUS_ID_SIZE] = {0};
+    unsigned char reply[USB_DEVICE_WIRE_SIZE];
+    long long deadline = start_deadline();
+    int saved;
+    int fd = connect_host(host, port, deadline);
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    strncpy((char*)request, busid, sizeof(request) - 1);
+    if (send_op_common(fd, OP_REQ_IMPORT, deadline) < 0 ||
+        send_all(fd, request, sizeof(request), deadline) < 0 ||
+        recv_op_common(fd, OP_REP_IMPORT, deadline) < 0 ||
+        recv_all(fd, reply, sizeof(reply), deadline) < 0) {
+        saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+
+    decode_device(reply, device);
+    if (strncmp(device->busid, busid, USBIP_SYSFS_BUS_ID_SIZE) != 0) {
+        close(fd);
+        errno = EPROTO;
+        return -1;
+    }
+
+    // Deadlines were enforced with poll(), so the socket carries no timeouts
+    // that the kernel would inherit
+    enable_keepalive(fd);
+    return fd;
+}
+
+int usbip_devlist_contains(const UsbipDevice* devices, int count, const char* busid) {
+    int i;
+    for (i = 0; i < count; i++) {
+        if (strcmp(devices[i].busid, busid) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
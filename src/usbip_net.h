@@ -0,0 +1,174 @@
+#ifndef USBIP_NET_H
+#define USBIP_NET_H
+
+#include <stdint.h>
+#include <signal.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Default TCP port of usbipd */
+#define USBIP_DEFAULT_PORT "3240"
+/* Default deadline for a connect or a request/reply exchange */
+#define USBIP_NET_DEFAULT_TIMEOUT_MS 10000
+/* Default idle seconds before keepalive probes start on imported connections */
+#define USBIP_NET_DEFAULT_KEEPALIVE_S 30
+/* Unanswered keepalive probes after which the connection is dropped */
+#define USBIP_NET_KEEPALIVE_PROBES 3
+/* Protocol version spoken by the Linux usbip tools */
+#define USBIP_VERSION 0x0111
+
+/* Operation codes of the USB/IP control protocol */
+#define OP_REQ_DEVLIST 0x8005
+#define OP_REP_DEVLIST 0x0005
+#define OP_REQ_IMPORT  0x8003
+#define OP_REP_IMPORT  0x0003
+
+/* Field sizes of struct usbip_usb_device on the wire */
+#define USBIP_SYSFS_PATH_MAX 256
+#define USBIP_SYSFS_BUS_ID_SIZE 32
+
+/* Decoded struct usbip_usb_device from an OP_REP_DEVLIST reply */
+typedef struct {
+    char path[USBIP_SYSFS_PATH_MAX];
+    char busid[USBIP_SYSFS_BUS_ID_SIZE];
+    uint32_t busnum;
+    uint32_t devnum;
+    uint32_t speed;
+    uint16_t id_vendor;
+    uint16_t id_product;
+    uint16_t bcd_device;
+    uint8_t device_class;
+    uint8_t device_subclass;
+    uint8_t device_protocol;
+    uint8_t configuration_value;
+    uint8_t num_configurations;
+    uint8_t num_interfaces;
+} UsbipDevice;
+
+/**
+ * @brief Sets the deadline applied to each connect and request/reply exchange.
+ *
+ * A whole usbip_devlist() or usbip_import() call, connect included, finishes
+ * within this time. Name resolution is not covered.
+ *
+ * @param timeout_ms Deadline in milliseconds, or -1 for none.
+ */
+void usbip_net_set_timeout(int timeout_ms);
+
+/**
+ * @brief Registers the flag that signal handlers clear to request shutdown.
+ *
+ * Waits on the network are interrupted by signals; once the flag reads zero
+ * the call in progress fails with errno ECANCELED.
+ *
+ * @param flag Flag to watch, or NULL to never cancel.
+ */
+void usbip_net_set_keep_running(const volatile sig_atomic_t* flag);
+
+/**
+ * @brief Sets the TCP keepalive timing of imported connections.
+ *
+ * An attached device whose host stops answering is dropped by the kernel
+ * after idle_s seconds of silence plus USBIP_NET_KEEPALIVE_PROBES probes
+ * spaced idle_s / 3 seconds apart, instead of the system default of hours.
+ * The closed connection then wakes the monitor to reattach.
+ *
+ * @param idle_s Idle seconds before the first probe, or 0 for the system defaults.
+ */
+void usbip_net_set_keepalive(int idle_s);
+
+/**
+ * @brief Opens a TCP connection to a usbipd instance.
+ *
+ * @param host Host name or IP address of the remote USBIP host.
+ * @param port TCP port as a string, usually USBIP_DEFAULT_PORT.
+ * @return Connected socket descriptor, or -1 on failure (errno ETIMEDOUT if the deadline passed).
+ */
+int usbip_net_connect(const char* host, const char* port);
+
+/**
+ * @brief Checks that usbipd accepts connections, without sending a request.
+ *
+ * Costs one TCP handshake: usbipd serves one request per connection and
+ * drops connections that close before sending one.
+ *
+ * @param host Host name or IP address of the remote USBIP host.
+ * @param port TCP port as a string, usually USBIP_DEFAULT_PORT.
+ * @return 0 if the host accepted the connection, -1 otherwise (errno as for usbip_net_connect()).
+ */
+int usbip_net_probe(const char* host, const char* port);
+
+/**
+ * @brief Lists the devices exported by a remote host with OP_REQ_DEVLIST.
+ *
+ * Speaks the USB/IP wire protocol directly, equivalent to `usbip list -r <host>`.
+ * The binary reply is decoded straight into the caller's array. Devices beyond
+ * max_devices are read off the wire and dropped, but still counted.
+ *
+ * @param host Host name or IP address of the remote USBIP host.
+ * @param port TCP port as a string, usually USBIP_DEFAULT_PORT.
+ * @param devices Array receiving the decoded devices.
+ * @param max_devices Capacity of the devices array.
+ * @return Number of devices exported by the host, or -1 on a connection or protocol error
+ *         (errno ETIMEDOUT if the deadline passed, ECANCELED if shutdown was requested).
+ */
+int usbip_devlist(const char* host, const char* port, UsbipDevice* devices, int max_devices);
+
+/**
+ * @brief Lists a remote host like usbip_devlist(), keeping only the busids.
+ *
+ * For callers that only look devices up by busid, so no UsbipDevice array is
+ * needed to decode into.
+ *
+ * @param host Host name or IP address of the remote USBIP host.
+ * @param port TCP port as a string, usually USBIP_DEFAULT_PORT.
+ * @param busids Array receiving the busids, each NUL-terminated.
+ * @param max_busids Capacity of the busids array.
+ * @return Number of devices exported by the host, or -1 as for usbip_devlist().
+ */
+int usbip_devlist_busids(const char* host, const char* port, char (*busids)[USBIP_SYSFS_BUS_ID_SIZE], int max_busids);
+
+/**
+ * @brief Reads and decodes an OP_REP_DEVLIST reply from a connected socket.
+ *
+ * @param fd Socket on which OP_REQ_DEVLIST has been sent.
+ * @param devices Array receiving the decoded devices.
+ * @param max_devices Capacity of the devices array.
+ * @return Number of devices in the reply, or -1 on error.
+ */
+int usbip_recv_devlist(int fd, UsbipDevice* devices, int max_devices);
+
+/**
+ * @brief Imports a remote device with OP_REQ_IMPORT.
+ *
+ * On success the returned socket is ready to be handed to the kernel with
+ * vhci_attach(): it is in blocking mode without socket timeouts, and TCP
+ * keepalive is enabled, as `usbip attach` does, with the timing set by
+ * usbip_net_set_keepalive().
+ *
+ * @param host Host name or IP address of the remote USBIP host.
+ * @param port TCP port as a string, usually USBIP_DEFAULT_PORT.
+ * @param busid The busid to import.
+ * @param device Receives the device description from the reply.
+ * @return Connected socket descriptor, or -1 if the connection or the import failed
+ *         (errno ETIMEDOUT if the deadline passed).
+ */
+int usbip_import(const char* host, const char* port, const char* busid, UsbipDevice* device);
+
+/**
+ * @brief Looks up a busid in a decoded device list.
+ *
+ * @param devices Decoded devices.
+ * @param count Number of entries in devices.
+ * @param busid The busid (e.g., "1-2") to look for.
+ * @return 1 if the busid is exported, 0 otherwise.
+ */
+int usbip_devlist_contains(const UsbipDevice* devices, int count, const char* busid);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // USBIP_NET_H
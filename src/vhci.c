@@ -0,0 +1,439 @@
+#define _DEFAULT_SOURCE
+#include "vhci.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+// Upper bound on status files we track (one per virtual host controller)
+#define VHCI_MAX_STATUS_FILES 64
+// Large enough for the status file of a fully populated controller
+#define VHCI_STATUS_BUF_SIZE 8192
+#define VHCI_PATH_LEN 512
+// Attempts at claiming a free port when racing with other attachers
+#define VHCI_ATTACH_RETRIES 8
+// USB_SPEED_SUPER from <linux/usb/ch9.h>; such devices need a SuperSpeed port
+#define VHCI_SPEED_SUPER 5
+
+static char platform_dir[VHCI_PATH_LEN] = VHCI_PLATFORM_DIR;
+static char record_dir[VHCI_PATH_LEN] = VHCI_RECORD_DIR;
+
+// Status file paths are discovered once and reused until a read fails
+static char status_files[VHCI_MAX_STATUS_FILES][VHCI_PATH_LEN];
+static int status_file_count = -1; // -1 means not discovered yet
+static char attach_path[VHCI_PATH_LEN];
+// Guards the discovered paths and makes port claims by attach workers take turns
+static pthread_mutex_t vhci_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void vhci_set_paths(const char* new_platform_dir, const char* new_record_dir) {
+    pthread_mutex_lock(&vhci_lock);
+    snprintf(platform_dir, sizeof(platform_dir), "%s",
+             new_platform_dir ? new_platform_dir : VHCI_PLATFORM_DIR);
+    snprintf(record_dir, sizeof(record_dir), "%s",
+             new_record_dir ? new_record_dir : VHCI_RECORD_DIR);
+    status_file_count = -1;
+    pthread_mutex_unlock(&vhci_lock);
+}
+
+const char* vhci_record_dir(void) {
+    return record_dir;
+}
+
+// Helper to collect /sys/devices/platform/vhci_hcd.*/status* into status_files
+static void discover_status_files(void) {
+    DIR* platform;
+    struct dirent* hcd;
+
+    status_file_count = 0;
+    attach_path[0] = '\0';
+    platform = opendir(platform_dir);
+    if (!platform) {
+        return;
+    }
+
+    while ((hcd = readdir(platform)) != NULL && status_file_count < VHCI_MAX_STATUS_FILES) {
+        char hcd_path[VHCI_PATH_LEN];
+        DIR* hcd_dir;
+        struct dirent* entry;
+
+        if (strncmp(hcd->d_name, "vhci_hcd.", 9) != 0) {
+            continue;
+        }
+        if (snprintf(hcd_path, sizeof(hcd_path), "%s/%s", platform_dir, hcd->d_name) >= (int)sizeof(hcd_path)) {
+            continue;
+        }
+        hcd_dir = opendir(hcd_path);
+        if (!hcd_dir) {
+            continue;
+        }
+        while ((entry = readdir(hcd_dir)) != NULL && status_file_count < VHCI_MAX_STATUS_FILES) {
+            // The attach file lives on the first controller only
+            if (strcmp(entry->d_name, "attach") == 0 && attach_path[0] == '\0') {
+                if (snprintf(attach_path, sizeof(attach_path), "%s/%s", hcd_path, entry->d_name) >= (int)sizeof(attach_path)) {
+                    attach_path[0] = '\0';
+                }
+                continue;
+            }
+            // Accept "status" and "status.N", nothing else
+            if (strcmp(entry->d_name, "status") != 0 && strncmp(entry->d_name, "status.", 7) != 0) {
+                continue;
+            }
+            if (snprintf(status_files[status_file_count], VHCI_PATH_LEN, "%s/%s",
+                         hcd_path, entry->d_name) < VHCI_PATH_LEN) {
+                status_file_count++;
+            }
+        }
+        closedir(hcd_dir);
+    }
+    closedir(platform);
+}
+
+// Helper to read a whole (small) file into buf, returns bytes read or -1
+static ssize_t read_file(const char* path, char* buf, size_t buf_size) {
+    size_t total = 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        return -1;
+    }
+    while (total < buf_size - 1) {
+        ssize_t n = read(fd, buf + total, buf_size - 1 - total);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            close(fd);
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        total += (size_t)n;
+    }
+    close(fd);
+    buf[total] = '\0';
+    return (ssize_t)total;
+}
+
+// Connection record of an in-use port, as written by `usbip attach`
+typedef struct {
+    int port;
+    int speed;
+    char local_busid[32];
+    char host[128];
+    char service[16];
+    char busid[64];
+} PortEntry;
+
+// Callback for each in-use port, returns nonzero to stop scanning
+typedef int (*port_entry_fn)(const PortEntry* entry, void* ctx);
+
+// Helper to read the connection record of a port, returns 1 on success
+static int read_record(PortEntry* entry) {
+    char path[VHCI_PATH_LEN];
+    char record[512];
+
+    if (snprintf(path, sizeof(path), "%s/port%d", record_dir, entry->port) >= (int)sizeof(path) ||
+        read_file(path, record, sizeof(record)) <= 0) {
+        return 0;
+    }
+    return sscanf(record, "%127s %15s %63s", entry->host, entry->service, entry->busid) == 3;
+}
+
+// Helper to parse one status line into hub type, port, state, speed and local busid.
+// local_busid may be NULL. Returns 1 if the line describes a port, 0 otherwise.
+static int parse_status_line(const char* line, char* hub, int* port, int* status, int* speed,
+                             char* local_busid) {
+    char sockfd[32];
+    unsigned int devid;
+    char busid[32];
+    int fields;
+
+    busid[0] = '\0';
+    if (isalpha((unsigned char)*line)) {
+        // Kernel 4.13+: "hs  0000 004 000 00000000 000000 0-0"
+        fields = sscanf(line, "%3s %d %d %d %x %31s %31s", hub, port, status, speed, &devid, sockfd, busid);
+        if (fields < 5) {
+            return 0;
+        }
+    } else {
+        // Older kernels: "000 004 000 00000000 0000000000000000 0-0"
+        hub[0] = '\0';
+        fields = sscanf(line, "%d %d %d %x %31s %31s", port, status, speed, &devid, sockfd, busid);
+        if (fields < 4) {
+            return 0;
+        }
+    }
+    if (local_busid) {
+        memcpy(local_busid, busid, sizeof(busid));
+    }
+    return 1;
+}
+
+// Helper to visit the in-use ports of one status file that have a record.
+// Returns 1 if the callback stopped the scan, 0 when done, -1 on read error.
+static int scan_status_file(const char* path, port_entry_fn fn, void* ctx) {
+    char buf[VHCI_STATUS_BUF_SIZE];
+    char* line;
+
+    if (read_file(path, buf, sizeof(buf)) < 0) {
+        return -1;
+    }
+
+    // Skip the header line ("hub port sta spd dev sockfd local_busid")
+    line = strchr(buf, '\n');
+    while (line && *line) {
+        PortEntry entry;
+        int status;
+        char hub[4];
+
+        line++;
+        if (parse_status_line(line, hub, &entry.port, &status, &entry.speed, entry.local_busid) &&
+            status != VDEV_ST_NULL && status != VDEV_ST_NOTASSIGNED &&
+            read_record(&entry) && fn(&entry, ctx)) {
+            return 1;
+        }
+        line = strchr(line, '\n');
+    }
+    return 0;
+}
+
+// Helper to visit every in-use port across controllers.
+// Returns 1 if the callback stopped the scan, 0 when done, -1 if sysfs is unavailable.
+static int scan_ports(port_entry_fn fn, void* ctx, void (*restart)(void* ctx)) {
+    int i;
+    int rediscovered = 0;
+
+    if (status_file_count <= 0) {
+        discover_status_files();
+        rediscovered = 1;
+    }
+
+    for (i = 0; i < status_file_count; i++) {
+        int ret = scan_status_file(status_files[i], fn, ctx);
+        if (ret > 0) {
+            return 1;
+        }
+        if (ret < 0) {
+            // Controllers can come and go with the module; rescan once
+            if (rediscovered) {
+                return -1;
+            }
+            discover_status_files();
+            rediscovered = 1;
+            if (restart) {
+                restart(ctx);
+            }
+            i = -1;
+        }
+    }
+    return status_file_count > 0 ? 0 : -1;
+}
+
+// Helper to find a free port of the right hub type, skipping ports already tried.
+// Returns the port number or -1 if none is free.
+static int find_free_port(uint32_t speed, const int* tried, int tried_count) {
+    const char* wanted_hub = speed >= VHCI_SPEED_SUPER ? "ss" : "hs";
+    int i, j;
+
+    for (i = 0; i < status_file_count; i++) {
+        char buf[VHCI_STATUS_BUF_SIZE];
+        char* line;
+
+        if (read_file(status_files[i], buf, sizeof(buf)) < 0) {
+            continue;
+        }
+        line = strchr(buf, '\n');
+        while (line && *line) {
+            int port, status, port_speed;
+            char hub[4];
+            int skip = 0;
+
+            line++;
+            if (parse_status_line(line, hub, &port, &status, &port_speed, NULL) && status == VDEV_ST_NULL &&
+                (hub[0] == '\0' || strcmp(hub, wanted_hub) == 0)) {
+                for (j = 0; j < tried_count; j++) {
+                    if (tried[j] == port) {
+                        skip = 1;
+                    }
+                }
+                if (!skip) {
+                    return port;
+                }
+            }
+            line = strchr(line, '\n');
+        }
+    }
+    return -1;
+}
+
+// Helper to write the connection record read back by `usbip port` and this probe
+static void write_record(int port, const char* host, const char* service, const char* busid) {
+    char path[VHCI_PATH_LEN];
+    char record[512];
+    int fd, len;
+
+    mkdir(record_dir, 0700);
+    if (snprintf(path, sizeof(path), "%s/port%d", record_dir, port) >= (int)sizeof(path)) {
+        return;
+    }
+    len = snprintf(record, sizeof(record), "%s %s %s\n", host, service, busid);
+    if (len <= 0 || len >= (int)sizeof(record)) {
+        return;
+    }
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return;
+    }
+    if (write(fd, record, (size_t)len) != len) {
+        unlink(path);
+    }
+    close(fd);
+}
+
+// Helper behind vhci_available(), called with vhci_lock held
+static int available_locked(void) {
+    if (status_file_count <= 0) {
+        discover_status_files();
+    }
+    return status_file_count > 0;
+}
+
+int vhci_available(void) {
+    int available;
+
+    pthread_mutex_lock(&vhci_lock);
+    available = available_locked();
+    pthread_mutex_unlock(&vhci_lock);
+    return available;
+}
+
+static int table_add_entry(const PortEntry* entry, void* ctx) {
+    PortRecord record;
+    record.port = entry->port;
+    record.speed = entry->speed;
+    record.vendor_id = 0;
+    record.product_id = 0;
+    record.local_busid = entry->local_busid;
+    record.host = entry->host;
+    record.service = entry->service;
+    record.busid = entry->busid;
+    port_table_add((PortTable*)ctx, &record);
+    return 0;
+}
+
+static void table_restart(void* ctx) {
+    port_table_reset((PortTable*)ctx);
+}
+
+int vhci_read_ports(PortTable* table) {
+    int ret;
+
+    port_table_reset(table);
+    pthread_mutex_lock(&vhci_lock);
+    ret = scan_ports(table_add_entry, table, table_restart);
+    pthread_mutex_unlock(&vhci_lock);
+    return ret < 0 ? -1 : table->count;
+}
+
+// State for the early-exit scan behind vhci_port_attached()
+typedef struct {
+    const char* host;
+    const char* identifier;
+    int is_busid;
+} PortMatch;
+
+static int match_entry(const PortEntry* entry, void* ctx) {
+    const PortMatch* match = ctx;
+    return port_busid_matches(entry->busid, match->identifier, match->is_busid) &&
+           port_host_matches(entry->host, match->host);
+}
+
+int vhci_port_attached(const char* host, const char* identifier, int is_busid) {
+    PortMatch match;
+    int ret;
+
+    match.host = host;
+    match.identifier = identifier;
+    match.is_busid = is_busid;
+    pthread_mutex_lock(&vhci_lock);
+    ret = scan_ports(match_entry, &match, NULL);
+    pthread_mutex_unlock(&vhci_lock);
+    return ret < 0 ? -1 : ret;
+}
+
+int vhci_can_attach(void) {
+    int can_attach;
+
+    pthread_mutex_lock(&vhci_lock);
+    can_attach = available_locked() && attach_path[0] != '\0';
+    pthread_mutex_unlock(&vhci_lock);
+    return can_attach;
+}
+
+// Helper behind vhci_attach(), called with vhci_lock held
+static int attach_locked(int sockfd, uint32_t busnum, uint32_t devnum, uint32_t speed,
+                         const char* host, const char* service, const char* busid) {
+    int tried[VHCI_ATTACH_RETRIES];
+    int attempt;
+
+    if (!available_locked() || attach_path[0] == '\0') {
+        errno = ENODEV;
+        return -1;
+    }
+
+    for (attempt = 0; attempt < VHCI_ATTACH_RETRIES; attempt++) {
+        char request[64];
+        int port = find_free_port(speed, tried, attempt);
+        int fd, len;
+        ssize_t written;
+
+        if (port < 0) {
+            errno = EBUSY;
+            return -1;
+        }
+        tried[attempt] = port;
+
+        // Same format as libusbip: "<port> <sockfd> <devid> <speed>"
+        len = snprintf(request, sizeof(request), "%d %d %u %u",
+                       port, sockfd, (busnum << 16) | devnum, speed);
+        fd = open(attach_path, O_WRONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return -1;
+        }
+        written = write(fd, request, (size_t)len);
+        close(fd);
+
+        if (written == len) {
+            write_record(port, host, service, busid);
+            return port;
+        }
+        // Another process claimed the port between reading status and writing
+        if (errno != EBUSY) {
+            return -1;
+        }
+    }
+
+    errno = EBUSY;
+    return -1;
+}
+
+int vhci_attach(int sockfd, uint32_t busnum, uint32_t devnum, uint32_t speed,
+                const char* host, const char* service, const char* busid) {
+    int port;
+    int saved;
+
+    // Our own workers never race for a port; other attachers are still retried
+    pthread_mutex_lock(&vhci_lock);
+    port = attach_locked(sockfd, busnum, devnum, speed, host, service, busid);
+    saved = errno;
+    pthread_mutex_unlock(&vhci_lock);
+    errno = saved;
+    return port;
+}
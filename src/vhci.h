@@ -0,0 +1,107 @@
+#ifndef VHCI_H
+#define VHCI_H
+
+#include <stdint.h>
+#include "parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Default locations used by the vhci_hcd driver and the usbip tools */
+#define VHCI_PLATFORM_DIR "/sys/devices/platform"
+#define VHCI_RECORD_DIR   "/var/run/vhci_hcd"
+
+/* Port states as reported in the vhci_hcd status files */
+#define VDEV_ST_NULL         1
+#define VDEV_ST_NOTASSIGNED  2
+#define VDEV_ST_USED         4
+#define VDEV_ST_ERROR        5
+
+/**
+ * @brief Overrides the sysfs platform directory and the port record directory.
+ *
+ * Mainly intended for tests, which point the probe at a fake tree. Passing
+ * NULL for either argument restores the corresponding default.
+ *
+ * @param platform_dir Directory containing the vhci_hcd.* platform devices.
+ * @param record_dir Directory holding the per-port connection records.
+ */
+void vhci_set_paths(const char* platform_dir, const char* record_dir);
+
+/**
+ * @brief Returns the directory holding the per-port connection records.
+ *
+ * @return Path of the record directory currently in use.
+ */
+const char* vhci_record_dir(void);
+
+/**
+ * @brief Checks whether the vhci_hcd status files can be read.
+ *
+ * @return 1 if at least one status file was found, 0 otherwise.
+ */
+int vhci_available(void);
+
+/**
+ * @brief Takes a snapshot of every in-use port and its connection record.
+ *
+ * Reads each status file once, so many devices can be checked against one
+ * snapshot with port_table_find(). Ports without a readable record are
+ * skipped, as `usbip port` can't name their device either. The speed and
+ * local busid come from the status file; vendor and product are left at 0.
+ *
+ * @param table Table receiving the records; reset first.
+ * @return Number of records, or -1 if the sysfs status files are unavailable.
+ */
+int vhci_read_ports(PortTable* table);
+
+/**
+ * @brief Checks if a device is attached by reading vhci_hcd sysfs state directly.
+ *
+ * Gives the same answer as running `usbip port` and passing the output to
+ * parse_usbip_port(), but without spawning any process: every port that is
+ * neither free nor unassigned is matched against its connection record, and
+ * the scan stops at the first match. Only a port imported from host counts,
+ * so the same busid from another host does not.
+ *
+ * @param host Remote host the device is imported from.
+ * @param identifier The busid (e.g., "1-2") or devid to look for.
+ * @param is_busid True if the identifier is a busid, false if it's a devid.
+ * @return 1 if attached, 0 if not attached, -1 if the sysfs status files are unavailable.
+ */
+int vhci_port_attached(const char* host, const char* identifier, int is_busid);
+
+/**
+ * @brief Checks whether the vhci_hcd `attach` file is present.
+ *
+ * @return 1 if devices can be attached through sysfs, 0 otherwise.
+ */
+int vhci_can_attach(void);
+
+/**
+ * @brief Hands an imported USB/IP connection to the kernel through the vhci_hcd `attach` file.
+ *
+ * Picks a free port of the right speed class from the status files, writes
+ * "<port> <sockfd> <devid> <speed>" to `attach`, and stores the connection
+ * record that `usbip port` and vhci_port_attached() read back. Calls from
+ * several threads take turns, and another port is tried if a different
+ * process claims the chosen one first.
+ *
+ * @param sockfd Socket on which OP_REQ_IMPORT completed successfully.
+ * @param busnum Remote bus number from the import reply.
+ * @param devnum Remote device number from the import reply.
+ * @param speed USB speed from the import reply.
+ * @param host Remote host, for the connection record.
+ * @param service Remote TCP port, for the connection record.
+ * @param busid Remote busid, for the connection record.
+ * @return The vhci port used, or -1 on failure with errno set.
+ */
+int vhci_attach(int sockfd, uint32_t busnum, uint32_t devnum, uint32_t speed,
+                const char* host, const char* service, const char* busid);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VHCI_H
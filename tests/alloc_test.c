@@ -0,0 +1,192 @@
+#define _DEFAULT_SOURCE
+#include "../src/runner.h"
+#include "../src/parser.h"
+#include "../src/vhci.h"
+#include "../src/session.h"
+#include "../src/port_cache.h"
+#include "../src/scheduler.h"
+#include "../src/metrics.h"
+#include "../src/log.h"
+#include "fake_usbipd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Helper macro for assertions with messages */
+#define ASSERT_MSG(condition, message) \
+    if (!(condition)) { \
+        fprintf(stderr, "Assertion failed: (" #condition "), %s\n", message); \
+        exit(1); /* Exit with failure */ \
+    }
+
+/* Cycles run after warm-up; every one of them must stay off the heap */
+#define CYCLES 20
+
+#ifdef __GLIBC__
+/* Count heap allocations by standing in for the allocator, forwarding to glibc's own */
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+static int counting;
+static int allocations;
+
+void* malloc(size_t size) {
+    allocations += counting;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    allocations += counting;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    allocations += counting;
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+static const char* const test_status_names[] = {"unknown", "attached", "not_attached"};
+
+static char root[] = "/tmp/alloc_test_XXXXXX";
+static PortTable table;
+static PortCache cache;
+static Metrics metrics;
+static char text[131072];
+static RunnerBuffer output;
+
+static void write_file(const char* rel_path, const char* content) {
+    char path[512];
+    FILE* f;
+    snprintf(path, sizeof(path), "%s/%s", root, rel_path);
+    f = fopen(path, "w");
+    ASSERT_MSG(f != NULL, "failed to create fake sysfs file");
+    fputs(content, f);
+    fclose(f);
+}
+
+static void make_dir(const char* rel_path) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", root, rel_path);
+    mkdir(path, 0755);
+}
+
+static void cleanup(void) {
+    char cmd[600];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", root);
+    if (system(cmd) != 0) {
+        fprintf(stderr, "Warning: failed to remove %s\n", root);
+    }
+}
+
+static int fill_from_sysfs(PortTable* ports, void* ctx) {
+    (void)ctx;
+    return vhci_read_ports(ports) >= 0;
+}
+
+/* One monitor cycle's worth of work: everything the loop does while devices
+ * stay attached or keep being retried */
+static void run_cycle(HostSession* session, const char* port, long long now_ms, Scheduler* scheduler,
+                      TargetSchedule* schedule) {
+    static const char* const argv[] = {"/bin/echo", "usbip", NULL};
+    RunnerResult run;
+
+    ASSERT_MSG(port_cache_find(&cache, "10.0.0.1", "7-4", 1, now_ms) == 1, "Device should be attached");
+    port_cache_invalidate(&cache);
+    ASSERT_MSG(vhci_port_attached("10.0.0.1", "7-4", 1) == 1, "Port record should be found");
+    ASSERT_MSG(session_refresh(session, port, now_ms, 0) == SESSION_LISTED, "Host should be listed");
+    ASSERT_MSG(session_refresh(session, port, now_ms, 30000) == SESSION_PROBED, "Host should be probed");
+    ASSERT_MSG(runner_run(argv, 5000, &output, NULL, NULL, &run) == 0 && run.success, "Command should run");
+    port_table_parse(&table, "Port 00: <Port in Use> at High Speed(480Mbps)\n"
+                             "       unknown vendor : unknown product (1234:5678)\n"
+                             "       3-1 -> usbip://10.0.0.1:3240/7-4\n"
+                             "           -> remote bus/dev 007/004\n");
+    ASSERT_MSG(port_table_find(&table, "10.0.0.1", "7-4", 1) != NULL, "Parsed port should be found");
+    scheduler_next_delay(scheduler, schedule, SCHED_FAILED);
+    metrics_observe(&metrics, METRICS_OP_PORT, 1500);
+    metrics_set_status(&metrics, 0, 1, now_ms);
+    metrics_format(&metrics, now_ms, text, sizeof(text));
+    log_info("Cycle at %lld ms", now_ms);
+    log_flush();
+}
+
+void test_steady_state_allocations() {
+    char platform[512], records[512];
+    unsigned char reply[4096];
+    char port[16];
+    long reply_len;
+    pid_t server;
+    SessionTable sessions;
+    HostSession* session;
+    Scheduler scheduler;
+    TargetSchedule schedule;
+    int null_fd;
+    int i;
+
+    printf("Running test_steady_state_allocations...\n");
+
+    /* A fake vhci tree with one imported device */
+    ASSERT_MSG(mkdtemp(root) != NULL, "mkdtemp failed");
+    snprintf(platform, sizeof(platform), "%s/platform", root);
+    snprintf(records, sizeof(records), "%s/records", root);
+    make_dir("platform");
+    make_dir("records");
+    make_dir("platform/vhci_hcd.0");
+    write_file("platform/vhci_hcd.0/status",
+               "hub port sta spd dev      sockfd local_busid\n"
+               "hs  0000 004 002 00070004 000003 1-1\n");
+    write_file("records/port0", "10.0.0.1 3240 7-4\n");
+    vhci_set_paths(platform, records);
+
+    /* A usbipd answering a listing and a probe per cycle */
+    reply_len = fake_usbipd_load("op_rep_devlist.bin", reply, sizeof(reply));
+    ASSERT_MSG(reply_len > 0, "Recorded devlist reply should load");
+    server = fake_usbipd_start(reply, (size_t)reply_len, 8, 2 * (CYCLES + 1), port, sizeof(port));
+    ASSERT_MSG(server > 0, "Fake usbipd should start");
+    session_table_init(&sessions);
+    session = session_get(&sessions, "127.0.0.1");
+
+    port_cache_init(&cache, 1000, fill_from_sysfs, NULL);
+    scheduler_init(&scheduler, 42);
+    memset(&schedule, 0, sizeof(schedule));
+    metrics_init(&metrics, test_status_names, 3, 0);
+    metrics_add_target(&metrics, "10.0.0.1", "7-4");
+    null_fd = open("/dev/null", O_WRONLY);
+    log_init(LOG_LEVEL_INFO, LOG_FORMAT_JSON, null_fd);
+
+    /* Warm-up: first uses may size buffers and load locale or time zone data */
+    run_cycle(session, port, 1000, &scheduler, &schedule);
+
+#ifdef __GLIBC__
+    counting = 1;
+#endif
+    for (i = 0; i < CYCLES; i++) {
+        run_cycle(session, port, 2000 + i * 1000, &scheduler, &schedule);
+    }
+#ifdef __GLIBC__
+    counting = 0;
+    printf("Heap allocations in %d cycles: %d\n", CYCLES, allocations);
+    ASSERT_MSG(allocations == 0, "Steady-state cycles should not allocate");
+#else
+    printf("Allocations are only counted with glibc, skipped\n");
+#endif
+
+    fake_usbipd_stop(server);
+    log_init(LOG_LEVEL_INFO, LOG_FORMAT_TEXT, STDERR_FILENO);
+    close(null_fd);
+    runner_buffer_free(&output);
+    vhci_set_paths(NULL, NULL);
+    cleanup();
+
+    printf("test_steady_state_allocations PASSED\n");
+}
+
+int main() {
+    test_steady_state_allocations();
+    printf("All tests PASSED\n");
+    return 0;
+}
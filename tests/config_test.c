@@ -0,0 +1,146 @@
+#define _DEFAULT_SOURCE
+#include "../src/config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Helper macro for assertions with messages */
+#define ASSERT_MSG(condition, message) \
+    if (!(condition)) { \
+        fprintf(stderr, "Assertion failed: (" #condition "), %s\n", message); \
+        exit(1); /* Exit with failure */ \
+    }
+
+static Config config;
+static char error[256];
+
+void test_config_parse_spec() {
+    ConfigTarget target;
+    char long_id[CONFIG_ID_MAX + 16];
+
+    printf("Running test_config_parse_spec...\n");
+
+    ASSERT_MSG(config_parse_spec("10.0.0.1:1-2", &target), "Plain spec should parse");
+    ASSERT_MSG(strcmp(target.host, "10.0.0.1") == 0 && strcmp(target.identifier, "1-2") == 0, "Host and busid");
+    ASSERT_MSG(target.is_busid == 1, "A bare identifier is a busid");
+    ASSERT_MSG(target.interval_ms == CONFIG_UNSET && target.command_timeout_ms == CONFIG_UNSET, "Settings start unset");
+
+    ASSERT_MSG(config_parse_spec("[fe80::1]:devid=foo_udc.0", &target), "Bracketed IPv6 spec should parse");
+    ASSERT_MSG(strcmp(target.host, "fe80::1") == 0, "Brackets are stripped");
+    ASSERT_MSG(strcmp(target.identifier, "foo_udc.0") == 0 && target.is_busid == 0, "Device ID");
+
+    ASSERT_MSG(!config_parse_spec("10.0.0.1", &target), "Missing identifier");
+    ASSERT_MSG(!config_parse_spec(":1-2", &target), "Missing host");
+    ASSERT_MSG(!config_parse_spec("10.0.0.1:devid=", &target), "Empty device ID");
+
+    /* Too long to store is rejected rather than cut */
+    memset(long_id, 'a', sizeof(long_id));
+    memcpy(long_id, "h:", 2);
+    long_id[sizeof(long_id) - 1] = '\0';
+    ASSERT_MSG(!config_parse_spec(long_id, &target), "Overlong identifier");
+
+    printf("test_config_parse_spec PASSED\n");
+}
+
+void test_config_host_list() {
+    ConfigTarget target;
+    char hosts[CONFIG_MAX_HOSTS][CONFIG_HOST_MAX];
+
+    printf("Running test_config_host_list...\n");
+
+    /* Several hosts exporting the same device are kept as written, in order */
+    ASSERT_MSG(config_parse_spec("10.0.0.1,10.0.0.2,host3:1-2", &target), "Host list should parse");
+    ASSERT_MSG(strcmp(target.host, "10.0.0.1,10.0.0.2,host3") == 0, "List is kept whole");
+    ASSERT_MSG(config_split_hosts(target.host, hosts) == 3, "Three hosts");
+    ASSERT_MSG(strcmp(hosts[0], "10.0.0.1") == 0 && strcmp(hosts[2], "host3") == 0, "Hosts in list order");
+
+    /* IPv6 literals in a list keep their brackets until split */
+    ASSERT_MSG(config_parse_spec("[fe80::1],[fe80::2]:devid=foo", &target), "IPv6 list should parse");
+    ASSERT_MSG(strcmp(target.host, "[fe80::1],[fe80::2]") == 0, "Brackets are kept in the list");
+    ASSERT_MSG(config_split_hosts(target.host, hosts) == 2 && strcmp(hosts[1], "fe80::2") == 0, "Split drops them");
+    ASSERT_MSG(config_split_hosts("10.0.0.1", NULL) == 1, "A single host is a list of one");
+
+    ASSERT_MSG(!config_parse_spec("10.0.0.1,:1-2", &target), "Empty host in a list");
+    ASSERT_MSG(!config_parse_spec(",10.0.0.1:1-2", &target), "Leading comma");
+    ASSERT_MSG(!config_parse_spec("a,b,c,d,e,f,g,h,i:1-2", &target), "Too many hosts");
+    ASSERT_MSG(config_parse_spec("a,b,c,d,e,f,g,h:1-2", &target), "As many hosts as allowed");
+
+    printf("test_config_host_list PASSED\n");
+}
+
+void test_config_parse() {
+    ConfigTarget wanted;
+
+    printf("Running test_config_parse...\n");
+
+    ASSERT_MSG(config_parse("# Rack A\n"
+                            "\n"
+                            "10.0.0.1:1-2\n"
+                            "  10.0.0.1:1-3 interval=30 max-backoff=600 # slow host\r\n"
+                            "[fe80::1]:2-1\tcommand-timeout=20 fast-retry-delay=50 fast-retries=3 jitter=0 attached-interval=120",
+                            &config, error, sizeof(error)) == 0, error);
+    ASSERT_MSG(config.count == 3, "Three devices, comments and blank lines skipped");
+
+    ASSERT_MSG(config.targets[0].interval_ms == CONFIG_UNSET, "No settings given");
+    ASSERT_MSG(config.targets[1].interval_ms == 30000, "interval is in seconds");
+    ASSERT_MSG(config.targets[1].max_backoff_ms == 600000, "max-backoff is in seconds");
+    ASSERT_MSG(config.targets[1].jitter_percent == CONFIG_UNSET, "Trailing comment ignored");
+    ASSERT_MSG(config.targets[2].command_timeout_ms == 20000, "command-timeout is in seconds");
+    ASSERT_MSG(config.targets[2].fast_retry_ms == 50, "fast-retry-delay is in milliseconds");
+    ASSERT_MSG(config.targets[2].fast_retries == 3, "fast-retries is a count");
+    ASSERT_MSG(config.targets[2].jitter_percent == 0, "jitter may be zero");
+    ASSERT_MSG(config.targets[2].attached_ms == 120000, "attached-interval is in seconds");
+
+    /* Lookup compares host, identifier and kind only */
+    config_parse_spec("10.0.0.1:1-3", &wanted);
+    ASSERT_MSG(config_find(&config, &wanted) == 1, "Listed device should be found");
+    config_parse_spec("10.0.0.1:devid=1-3", &wanted);
+    ASSERT_MSG(config_find(&config, &wanted) == -1, "A device ID is not a busid");
+    config_parse_spec("10.0.0.2:1-3", &wanted);
+    ASSERT_MSG(config_find(&config, &wanted) == -1, "Other host");
+
+    ASSERT_MSG(config_parse("", &config, error, sizeof(error)) == 0 && config.count == 0, "Empty file lists nothing");
+
+    printf("test_config_parse PASSED\n");
+}
+
+void test_config_errors() {
+    char path[64];
+    FILE* f;
+
+    printf("Running test_config_errors...\n");
+
+    ASSERT_MSG(config_parse("10.0.0.1:1-2\nbogus\n", &config, error, sizeof(error)) < 0, "Bad spec");
+    ASSERT_MSG(strncmp(error, "line 2:", 7) == 0, "Error names the line");
+    ASSERT_MSG(config_parse("10.0.0.1:1-2\n10.0.0.1:1-2\n", &config, error, sizeof(error)) < 0, "Duplicate device");
+    ASSERT_MSG(strstr(error, "twice"), "Duplicate is reported");
+    ASSERT_MSG(config_parse("10.0.0.1:1-2 interval=0\n", &config, error, sizeof(error)) < 0, "Below the minimum");
+    ASSERT_MSG(config_parse("10.0.0.1:1-2 interval=5s\n", &config, error, sizeof(error)) < 0, "Trailing garbage");
+    ASSERT_MSG(config_parse("10.0.0.1:1-2 jitter=101\n", &config, error, sizeof(error)) < 0, "Above the maximum");
+    ASSERT_MSG(config_parse("10.0.0.1:1-2 speed=3\n", &config, error, sizeof(error)) < 0, "Unknown setting");
+    ASSERT_MSG(config_parse("10.0.0.1:1-2 interval\n", &config, error, sizeof(error)) < 0, "Setting without a value");
+    ASSERT_MSG(strstr(error, "\"interval\""), "Error quotes the setting");
+
+    /* Reading from a file */
+    snprintf(path, sizeof(path), "/tmp/config_test_%d.conf", (int)getpid());
+    ASSERT_MSG(config_load(path, &config, error, sizeof(error)) < 0, "Missing file");
+    f = fopen(path, "w");
+    ASSERT_MSG(f != NULL, "Should create the file");
+    fputs("10.0.0.1:1-2 interval=7\n10.0.0.2:3-4\n", f);
+    fclose(f);
+    ASSERT_MSG(config_load(path, &config, error, sizeof(error)) == 0, error);
+    ASSERT_MSG(config.count == 2 && config.targets[0].interval_ms == 7000, "File contents should be parsed");
+    unlink(path);
+
+    printf("test_config_errors PASSED\n");
+}
+
+int main() {
+    test_config_parse_spec();
+    test_config_host_list();
+    test_config_parse();
+    test_config_errors();
+    printf("All tests PASSED\n");
+    return 0;
+}
@@ -0,0 +1,135 @@
+#define _DEFAULT_SOURCE
+#include "../src/control.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/* Helper macro for assertions with messages */
+#define ASSERT_MSG(condition, message) \
+    if (!(condition)) { \
+        fprintf(stderr, "Assertion failed: (" #condition "), %s\n", message); \
+        exit(1); /* Exit with failure */ \
+    }
+
+static ControlSocket control;
+static char path[64];
+static char text[4096];
+static int handled;
+
+/* Echoes what it was given so the test can check the request split */
+static void echo_handler(const char* command, const char* argument, ControlReply* reply, void* ctx) {
+    handled++;
+    control_printf(reply, "%s[%s|%s]\n", (const char*)ctx, command, argument);
+}
+
+/* Connects to the control socket and sends data, optionally closing the write side */
+static int connect_client(const char* data, size_t len, int close_write) {
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    ASSERT_MSG(fd >= 0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0, "Client should connect");
+    ASSERT_MSG(write(fd, data, len) == (ssize_t)len, "Request should be sent");
+    if (close_write) {
+        shutdown(fd, SHUT_WR);
+    }
+    return fd;
+}
+
+static size_t read_all(int fd) {
+    size_t len = 0;
+    ssize_t n;
+
+    while (len + 1 < sizeof(text) && (n = read(fd, text + len, sizeof(text) - 1 - len)) > 0) {
+        len += (size_t)n;
+    }
+    text[len] = '\0';
+    close(fd);
+    return len;
+}
+
+void test_control_requests() {
+    struct stat st;
+    char long_request[CONTROL_REQUEST_MAX + 16];
+    int clients[CONTROL_MAX_CLIENTS_PER_SERVE + 1];
+    int i;
+    int fd;
+
+    printf("Running test_control_requests...\n");
+    snprintf(path, sizeof(path), "/tmp/control_test_%d.sock", (int)getpid());
+    control_init(&control);
+    ASSERT_MSG(control_serve(&control, echo_handler, "") == 0, "Nothing to serve before listening");
+    ASSERT_MSG(control_listen(&control, path) == 0, "Should listen on the socket");
+    ASSERT_MSG(stat(path, &st) == 0 && (st.st_mode & 0777) == 0600, "Only the owner may send requests");
+    ASSERT_MSG(control_serve(&control, echo_handler, "") == 0, "Nobody is waiting yet");
+
+    /* Command and argument are split and trimmed, only the first line counts */
+    fd = connect_client("  add   10.0.0.1:1-2 \r\nstatus\n", 31, 0);
+    ASSERT_MSG(control_serve(&control, echo_handler, "ctx") == 1, "One client should be answered");
+    read_all(fd);
+    ASSERT_MSG(strcmp(text, "ctx[add|10.0.0.1:1-2]\n") == 0, "Request should be split into command and argument");
+
+    /* A last line without newline still counts once the client stops sending */
+    fd = connect_client("status", 6, 1);
+    ASSERT_MSG(control_serve(&control, echo_handler, "") == 1, "Client without newline should be answered");
+    read_all(fd);
+    ASSERT_MSG(strcmp(text, "[status|]\n") == 0, "Missing argument should be empty");
+
+    /* Overlong requests never reach the handler */
+    handled = 0;
+    memset(long_request, 'x', sizeof(long_request));
+    fd = connect_client(long_request, sizeof(long_request), 1);
+    control_serve(&control, echo_handler, "");
+    read_all(fd);
+    ASSERT_MSG(handled == 0 && strncmp(text, "error:", 6) == 0, "Overlong request should be refused");
+
+    /* A client that sends nothing is dropped */
+    fd = connect_client("", 0, 1);
+    ASSERT_MSG(control_serve(&control, echo_handler, "") == 1, "Silent client should be dropped");
+    ASSERT_MSG(read_all(fd) == 0 && handled == 0, "Silent client gets no reply");
+
+    /* A crowd of clients is answered over several calls */
+    for (i = 0; i <= CONTROL_MAX_CLIENTS_PER_SERVE; i++) {
+        clients[i] = connect_client("status\n", 7, 1);
+    }
+    ASSERT_MSG(control_serve(&control, echo_handler, "") == CONTROL_MAX_CLIENTS_PER_SERVE, "One call answers a capped number");
+    ASSERT_MSG(control_serve(&control, echo_handler, "") == 1, "The rest wait for the next call");
+    for (i = 0; i <= CONTROL_MAX_CLIENTS_PER_SERVE; i++) {
+        read_all(clients[i]);
+    }
+    ASSERT_MSG(handled == CONTROL_MAX_CLIENTS_PER_SERVE + 1, "Every queued client is handled");
+
+    control_close(&control);
+    ASSERT_MSG(access(path, F_OK) != 0, "Socket file should be removed");
+
+    printf("test_control_requests PASSED\n");
+}
+
+void test_control_reply() {
+    char buf[8];
+    ControlReply reply = {buf, sizeof(buf), 0};
+
+    printf("Running test_control_reply...\n");
+    control_printf(&reply, "%s", "ok ");
+    control_printf(&reply, "%d", 123456);
+    ASSERT_MSG(reply.len == 7 && strcmp(buf, "ok 1234") == 0, "Reply should be cut at its room");
+    control_printf(&reply, "more");
+    ASSERT_MSG(reply.len == 7 && strcmp(buf, "ok 1234") == 0, "Full reply should be left alone");
+
+    printf("test_control_reply PASSED\n");
+}
+
+int main() {
+    signal(SIGPIPE, SIG_IGN);
+    test_control_requests();
+    test_control_reply();
+    printf("All tests PASSED\n");
+    return 0;
+}
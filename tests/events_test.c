@@ -0,0 +1,181 @@
+#define _DEFAULT_SOURCE
+#include "../src/events.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+/* Helper macro for assertions with messages */
+#define ASSERT_MSG(condition, message) \
+    if (!(condition)) { \
+        fprintf(stderr, "Assertion failed: (" #condition "), %s\n", message); \
+        exit(1); /* Exit with failure */ \
+    }
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void test_events_wait() {
+    char dir[] = "/tmp/events_test_XXXXXX";
+    char path[64];
+    EventWatcher watcher;
+    int pair[2];
+    long long start;
+    FILE* f;
+
+    printf("Running test_events_wait...\n");
+    ASSERT_MSG(mkdtemp(dir) != NULL, "mkdtemp failed");
+
+    /* Disabled watcher is a plain timed wait */
+    events_init_disabled(&watcher);
+    ASSERT_MSG(events_can_detect(&watcher) == 0, "Disabled watcher can't detect anything");
+    start = now_ms();
+    ASSERT_MSG(events_wait(&watcher, 50) == 0, "Disabled watcher should time out");
+    ASSERT_MSG(now_ms() - start >= 45, "Timed wait should last about the timeout");
+
+    /* Record directory changes wake the waiter */
+    events_open(&watcher, dir);
+    ASSERT_MSG(watcher.inotify_fd >= 0 && watcher.record_wd >= 0, "Record directory should be watched");
+    ASSERT_MSG(events_can_detect(&watcher) == 1, "Watcher should detect changes");
+    snprintf(path, sizeof(path), "%s/port3", dir);
+    f = fopen(path, "w");
+    ASSERT_MSG(f != NULL, "Record file should be created");
+    fputs("10.0.0.1 3240 1-1\n", f);
+    fclose(f);
+    ASSERT_MSG(events_wait(&watcher, 1000) & EVENT_RECORD_CHANGED, "Record creation should wake the waiter");
+    unlink(path);
+    ASSERT_MSG(events_wait(&watcher, 1000) & EVENT_RECORD_CHANGED, "Record removal should wake the waiter");
+    ASSERT_MSG(events_wait(&watcher, 20) == 0, "No further changes should time out");
+
+    /* Shutdown of an imported connection wakes the waiter, data doesn't */
+    ASSERT_MSG(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0, "socketpair failed");
+    events_watch_socket(&watcher, 5, pair[0]);
+    ASSERT_MSG(write(pair[1], "x", 1) == 1, "write to socketpair failed");
+    ASSERT_MSG(events_wait(&watcher, 20) == 0, "Incoming data is not a detach");
+    close(pair[1]);
+    ASSERT_MSG(events_wait(&watcher, 1000) & EVENT_SOCKET_CLOSED, "Peer close should wake the waiter");
+    ASSERT_MSG(watcher.socket_fds[5] == -1, "Closed socket should no longer be watched");
+
+    /* A connecting client wakes the waiter; the listener stays the caller's */
+    ASSERT_MSG(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == 0, "socketpair failed");
+    events_watch_listener(&watcher, 1, pair[0]);
+    ASSERT_MSG(events_wait(&watcher, 20) == 0, "Idle listener should time out");
+    ASSERT_MSG(write(pair[1], "x", 1) == 1, "write to socketpair failed");
+    ASSERT_MSG(events_wait(&watcher, 1000) == EVENT_LISTENER, "Readable listener should wake the waiter");
+    events_watch_listener(&watcher, 1, -1);
+    ASSERT_MSG(events_wait(&watcher, 20) == 0, "Unwatched listener should not wake the waiter");
+    close(pair[0]);
+    close(pair[1]);
+
+    events_close(&watcher);
+    rmdir(dir);
+    printf("test_events_wait PASSED\n");
+}
+
+/* Builds a kernel uevent: header, then NUL-separated pairs. Returns its length. */
+static size_t make_uevent(char* buf, size_t size, const char* action, const char* devpath,
+                          const char* subsystem, const char* devtype) {
+    int len = snprintf(buf, size, "%s@%s", action, devpath) + 1;
+
+    len += snprintf(buf + len, size - (size_t)len, "ACTION=%s", action) + 1;
+    len += snprintf(buf + len, size - (size_t)len, "DEVPATH=%s", devpath) + 1;
+    len += snprintf(buf + len, size - (size_t)len, "SUBSYSTEM=%s", subsystem) + 1;
+    if (devtype) {
+        len += snprintf(buf + len, size - (size_t)len, "DEVTYPE=%s", devtype) + 1;
+    }
+    len += snprintf(buf + len, size - (size_t)len, "SEQNUM=4242") + 1;
+    return (size_t)len - 1; /* The last terminator stays past the end, as after recv() */
+}
+
+void test_uevent_parse() {
+    char msg[512];
+    UeventInfo info;
+    size_t len;
+
+    printf("Running test_uevent_parse...\n");
+
+    len = make_uevent(msg, sizeof(msg), "remove", "/devices/platform/vhci_hcd.0/usb3/3-1", "usb", "usb_device");
+    ASSERT_MSG(events_parse_uevent(msg, len, &info) == 1, "vhci device removal should be kept");
+    ASSERT_MSG(info.action == EVENTS_UEVENT_REMOVE && strcmp(info.busid, "3-1") == 0, "Action and local busid");
+
+    len = make_uevent(msg, sizeof(msg), "add", "/devices/platform/vhci_hcd.1/usb6/6-2", "usb", "usb_device");
+    ASSERT_MSG(events_parse_uevent(msg, len, &info) == 1 && info.action == EVENTS_UEVENT_ADD, "Addition should be kept");
+    ASSERT_MSG(strcmp(info.busid, "6-2") == 0, "Busid of a second controller");
+
+    len = make_uevent(msg, sizeof(msg), "remove", "/devices/platform/vhci_hcd.0/usb3/3-1/3-1:1.0", "usb", "usb_interface");
+    ASSERT_MSG(events_parse_uevent(msg, len, &info) == 0, "Interfaces are not devices");
+    len = make_uevent(msg, sizeof(msg), "remove", "/devices/pci0000:00/0000:00:14.0/usb1/1-4", "usb", "usb_device");
+    ASSERT_MSG(events_parse_uevent(msg, len, &info) == 0, "Real controllers are not watched");
+    len = make_uevent(msg, sizeof(msg), "change", "/devices/platform/vhci_hcd.0/usb3/3-1", "usb", "usb_device");
+    ASSERT_MSG(events_parse_uevent(msg, len, &info) == 0, "Only add and remove matter");
+    len = make_uevent(msg, sizeof(msg), "remove", "/devices/platform/vhci_hcd.0/usb3/3-1/tty/ttyUSB0", "tty", NULL);
+    ASSERT_MSG(events_parse_uevent(msg, len, &info) == 0, "Other subsystems are not watched");
+    memcpy(msg, "libudev\0\xfe\xed\xca\xfe", 12);
+    msg[12] = '\0';
+    ASSERT_MSG(events_parse_uevent(msg, 12, &info) == 0, "udev rebroadcasts are skipped");
+
+    printf("test_uevent_parse PASSED\n");
+}
+
+void test_uevent_stream() {
+    EventWatcher watcher;
+    char msg[512];
+    size_t len;
+    int pair[2];
+    int i;
+
+    printf("Running test_uevent_stream...\n");
+
+    /* A datagram socketpair keeps message boundaries, like netlink */
+    ASSERT_MSG(socketpair(AF_UNIX, SOCK_DGRAM, 0, pair) == 0, "socketpair failed");
+    events_init_disabled(&watcher);
+    events_use_uevent_fd(&watcher, pair[0]);
+    ASSERT_MSG(events_can_detect(&watcher) == 1, "Fake uevent source counts as a detector");
+
+    /* Unrelated events are drained without waking the waiter */
+    len = make_uevent(msg, sizeof(msg), "add", "/devices/pci0000:00/0000:00:14.0/usb1/1-4", "usb", "usb_device");
+    ASSERT_MSG(send(pair[1], msg, len, 0) == (ssize_t)len, "send failed");
+    ASSERT_MSG(events_wait(&watcher, 50) == 0, "Unrelated uevent should not wake the waiter");
+
+    /* A removal wakes it and names the device */
+    len = make_uevent(msg, sizeof(msg), "remove", "/devices/platform/vhci_hcd.0/usb3/3-1/3-1:1.0", "usb", "usb_interface");
+    ASSERT_MSG(send(pair[1], msg, len, 0) == (ssize_t)len, "send failed");
+    len = make_uevent(msg, sizeof(msg), "remove", "/devices/platform/vhci_hcd.0/usb3/3-1", "usb", "usb_device");
+    ASSERT_MSG(send(pair[1], msg, len, 0) == (ssize_t)len, "send failed");
+    ASSERT_MSG(events_wait(&watcher, 1000) == EVENT_UEVENT, "Removal should wake the waiter");
+    ASSERT_MSG(watcher.removed_count == 1 && strcmp(watcher.removed[0], "3-1") == 0, "Removed busid is reported");
+
+    /* An addition wakes it without naming a removal; the list starts afresh */
+    len = make_uevent(msg, sizeof(msg), "add", "/devices/platform/vhci_hcd.0/usb3/3-2", "usb", "usb_device");
+    ASSERT_MSG(send(pair[1], msg, len, 0) == (ssize_t)len, "send failed");
+    ASSERT_MSG(events_wait(&watcher, 1000) == EVENT_UEVENT, "Addition should wake the waiter");
+    ASSERT_MSG(watcher.removed_count == 0 && !watcher.removed_overflow, "Nothing was removed");
+
+    /* More removals than fit are flagged rather than lost */
+    for (i = 0; i < EVENTS_MAX_REMOVED + 2; i++) {
+        char devpath[64];
+        snprintf(devpath, sizeof(devpath), "/devices/platform/vhci_hcd.0/usb3/3-%d", i + 1);
+        len = make_uevent(msg, sizeof(msg), "remove", devpath, "usb", "usb_device");
+        ASSERT_MSG(send(pair[1], msg, len, 0) == (ssize_t)len, "send failed");
+    }
+    ASSERT_MSG(events_wait(&watcher, 1000) == EVENT_UEVENT, "Burst should wake the waiter");
+    ASSERT_MSG(watcher.removed_count == EVENTS_MAX_REMOVED && watcher.removed_overflow, "Overflow is flagged");
+
+    events_close(&watcher);
+    close(pair[1]);
+    printf("test_uevent_stream PASSED\n");
+}
+
+int main() {
+    test_events_wait();
+    test_uevent_parse();
+    test_uevent_stream();
+    printf("All tests PASSED\n");
+    return 0;
+}
@@ -0,0 +1,94 @@
+/* Minimal usbipd stand-in for tests: serves recorded replies over loopback TCP */
+#ifndef FAKE_USBIPD_H
+#define FAKE_USBIPD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/* Loads a recorded reply from tests/data, returns its length or -1 */
+static long fake_usbipd_load(const char* name, unsigned char* buf, size_t buf_size) {
+    char path[256];
+    FILE* f;
+    size_t len;
+
+    snprintf(path, sizeof(path), "tests/data/%s", name);
+    f = fopen(path, "rb");
+    if (!f) {
+        return -1;
+    }
+    len = fread(buf, 1, buf_size, f);
+    fclose(f);
+    return (long)len;
+}
+
+/*
+ * Forks a server on 127.0.0.1 that answers `connections` connections. Each
+ * connection reads a request of request_len bytes, then writes the reply.
+ * The chosen port is written to port_out. Returns the child pid or -1.
+ */
+static pid_t fake_usbipd_start(const unsigned char* reply, size_t reply_len, size_t request_len,
+                               int connections, char* port_out, size_t port_out_size) {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    pid_t pid;
+
+    if (listen_fd < 0) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+        listen(listen_fd, 8) < 0 ||
+        getsockname(listen_fd, (struct sockaddr*)&addr, &addr_len) < 0) {
+        close(listen_fd);
+        return -1;
+    }
+    snprintf(port_out, port_out_size, "%d", ntohs(addr.sin_port));
+
+    pid = fork();
+    if (pid == 0) {
+        int i;
+        for (i = 0; i < connections; i++) {
+            unsigned char request[512];
+            size_t got = 0;
+            int conn = accept(listen_fd, NULL, NULL);
+            if (conn < 0) {
+                _exit(1);
+            }
+            while (got < request_len && got < sizeof(request)) {
+                ssize_t n = read(conn, request + got, request_len - got);
+                if (n <= 0) {
+                    break;
+                }
+                got += (size_t)n;
+            }
+            if (write(conn, reply, reply_len) < 0) {
+                _exit(1);
+            }
+            close(conn);
+        }
+        _exit(0);
+    }
+    close(listen_fd);
+    return pid;
+}
+
+/* Stops the fake server and reaps it */
+static void fake_usbipd_stop(pid_t pid) {
+    if (pid > 0) {
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+}
+
+#endif // FAKE_USBIPD_H
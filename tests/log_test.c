@@ -0,0 +1,110 @@
+#define _GNU_SOURCE
+#include "../src/log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Helper macro for assertions with messages */
+#define ASSERT_MSG(condition, message) \
+    if (!(condition)) { \
+        fprintf(stderr, "Assertion failed: (" #condition "), %s\n", message); \
+        exit(1); /* Exit with failure */ \
+    }
+
+static int pipe_fds[2];
+static char text[LOG_BUFFER_SIZE * 2];
+
+/* Reads whatever has been written to the pipe so far */
+static size_t drain(void) {
+    size_t len = 0;
+    ssize_t n;
+
+    while (len + 1 < sizeof(text) && (n = read(pipe_fds[0], text + len, sizeof(text) - 1 - len)) > 0) {
+        len += (size_t)n;
+    }
+    text[len] = '\0';
+    return len;
+}
+
+void test_log_levels() {
+    printf("Running test_log_levels...\n");
+    ASSERT_MSG(log_level_from_name("warn") == LOG_LEVEL_WARN, "warn should parse");
+    ASSERT_MSG(log_level_from_name("debug") == LOG_LEVEL_DEBUG, "debug should parse");
+    ASSERT_MSG(log_level_from_name("verbose") == -1, "Unknown names should be rejected");
+
+    log_init(LOG_LEVEL_INFO, LOG_FORMAT_TEXT, pipe_fds[1]);
+    ASSERT_MSG(log_enabled(LOG_LEVEL_INFO) && !log_enabled(LOG_LEVEL_DEBUG), "Info is the configured level");
+    log_debug("hidden %d", 1);
+    log_info("shown %d\n", 2);
+    ASSERT_MSG(drain() == 0, "Info lines wait for a flush");
+    log_flush();
+    drain();
+    ASSERT_MSG(!strstr(text, "hidden"), "Debug lines should be dropped");
+    /* "YYYY-MM-DD HH:MM:SS " then the message without its trailing newline */
+    ASSERT_MSG(strlen(text) == 28 && text[4] == '-' && text[13] == ':' && strcmp(text + 20, "shown 2\n") == 0,
+               "Text lines are timestamped");
+
+    /* Warnings and errors are written at once */
+    log_warn("careful");
+    ASSERT_MSG(drain() > 0 && strstr(text, " careful\n"), "Warnings should not wait");
+
+    printf("test_log_levels PASSED\n");
+}
+
+void test_log_json() {
+    printf("Running test_log_json...\n");
+    log_init(LOG_LEVEL_DEBUG, LOG_FORMAT_JSON, pipe_fds[1]);
+    log_debug("say \"hi\"\\\tnow\x01");
+    log_flush();
+    drain();
+    ASSERT_MSG(strncmp(text, "{\"time\":\"", 9) == 0 && text[19] == 'T', "Time comes first in RFC 3339 form");
+    ASSERT_MSG(text[28] == '.' && (text[32] == '+' || text[32] == '-') && text[35] == ':', "Milliseconds and offset");
+    ASSERT_MSG(strstr(text, "\",\"level\":\"debug\",\"msg\":\"say \\\"hi\\\"\\\\\\tnow\\u0001\"}\n"),
+               "Message should be escaped");
+    printf("test_log_json PASSED\n");
+}
+
+void test_log_batching() {
+    char long_message[LOG_MESSAGE_MAX * 2];
+    size_t len;
+    int i;
+
+    printf("Running test_log_batching...\n");
+    log_init(LOG_LEVEL_INFO, LOG_FORMAT_TEXT, pipe_fds[1]);
+
+    /* Overlong messages are cut */
+    memset(long_message, 'x', sizeof(long_message) - 1);
+    long_message[sizeof(long_message) - 1] = '\0';
+    log_info("%s", long_message);
+    log_flush();
+    len = drain();
+    ASSERT_MSG(len == 20 + LOG_MESSAGE_MAX - 1 + 1, "Message should be capped");
+    ASSERT_MSG(strcmp(text + len - 5, "x...\n") == 0, "Cut messages end with ...");
+
+    /* A full buffer is written out without losing lines */
+    for (i = 0; i < 40; i++) {
+        log_info("%04d %s", i, long_message + sizeof(long_message) - 2000);
+    }
+    len = drain();
+    ASSERT_MSG(len > 0 && len < LOG_BUFFER_SIZE, "A full buffer should have been written out");
+    log_flush();
+    len += drain();
+    ASSERT_MSG(len == 40 * (20 + 5 + 1999 + 1), "Every line should arrive once");
+
+    printf("test_log_batching PASSED\n");
+}
+
+int main() {
+    ASSERT_MSG(pipe(pipe_fds) == 0, "Pipe should be created");
+    /* Large enough for everything the tests write before draining */
+    fcntl(pipe_fds[1], F_SETPIPE_SZ, LOG_BUFFER_SIZE * 2);
+    fcntl(pipe_fds[0], F_SETFL, O_NONBLOCK);
+
+    test_log_levels();
+    test_log_json();
+    test_log_batching();
+    printf("All tests PASSED\n");
+    return 0;
+}
@@ -0,0 +1,188 @@
+#define _DEFAULT_SOURCE
+#include "../src/metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/* Helper macro for assertions with messages */
+#define ASSERT_MSG(condition, message) \
+    if (!(condition)) { \
+        fprintf(stderr, "Assertion failed: (" #condition "), %s\n", message); \
+        exit(1); /* Exit with failure */ \
+    }
+
+static const char* const test_status_names[] = {"unknown", "attached", "not_attached"};
+
+static Metrics metrics;
+static char text[131072];
+
+void test_metrics_format() {
+    size_t len;
+    int target;
+
+    printf("Running test_metrics_format...\n");
+    metrics_init(&metrics, test_status_names, 3, 1000);
+
+    /* Histogram buckets are cumulative, sum in seconds */
+    metrics_observe(&metrics, METRICS_OP_PORT, 800);      /* <= 1 ms */
+    metrics_observe(&metrics, METRICS_OP_PORT, 3000);     /* <= 5 ms */
+    metrics_observe(&metrics, METRICS_OP_PORT, 60000000); /* +Inf */
+    len = metrics_format(&metrics, 1000, text, sizeof(text));
+    ASSERT_MSG(len > 0 && len < sizeof(text), "Text should fit");
+    ASSERT_MSG(strstr(text, "usbip_auto_attach_operation_duration_seconds_bucket{operation=\"port\",le=\"0.001\"} 1\n"),
+               "1 ms bucket should hold one sample");
+    ASSERT_MSG(strstr(text, "usbip_auto_attach_operation_duration_seconds_bucket{operation=\"port\",le=\"0.0025\"} 1\n"),
+               "2.5 ms bucket should still hold one sample");
+    ASSERT_MSG(strstr(text, "usbip_auto_attach_operation_duration_seconds_bucket{operation=\"port\",le=\"0.005\"} 2\n"),
+               "5 ms bucket should hold two samples");
+    ASSERT_MSG(strstr(text, "usbip_auto_attach_operation_duration_seconds_bucket{operation=\"port\",le=\"+Inf\"} 3\n"),
+               "+Inf bucket should hold every sample");
+    ASSERT_MSG(strstr(text, "usbip_auto_attach_operation_duration_seconds_count{operation=\"port\"} 3\n"), "Count should be 3");
+    ASSERT_MSG(strstr(text, "usbip_auto_attach_operation_duration_seconds_sum{operation=\"port\"} 60.003800\n"), "Sum is in seconds");
+    ASSERT_MSG(strstr(text, "usbip_auto_attach_operation_duration_seconds_count{operation=\"native_list\"} 0\n"),
+               "Unused operations should still be exported");
+
+    /* Spawns and attach outcomes */
+    metrics_count_spawn(&metrics, METRICS_OP_LIST, 1);
+    metrics_count_spawn(&metrics, METRICS_OP_LIST, 1);
+    metrics_count_spawn(&metrics, METRICS_OP_ATTACH, 0);
+    metrics_count_attach(&metrics, METRICS_OP_ATTACH, 0, 1);
+    metrics_count_attach(&metrics, METRICS_OP_ATTACH, 0, 1);
+    metrics_count_attach(&metrics, METRICS_OP_ATTACH, 1, 0);
+    metrics_count_attach(&metrics, METRICS_OP_NATIVE_ATTACH, 1, -1);
+    metrics_format(&metrics, 1000, text, sizeof(text));
+    ASSERT_MSG(strstr(text, "usbip_auto_attach_process_spawns_total{command=\"list\"} 2\n"), "Two list spawns");
+    ASSERT_MSG(strstr(text, "usbip_auto_attach_process_spawn_failures_total{command=\"attach\"} 1\n"), "One failed spawn");
+    ASSERT_MSG(strstr(text, "usbip_auto_attach_attaches_total{method=\"exec\",result=\"failure\",exit_code=\"1\"} 2\n"),
+               "Failures are counted by exit code");
+    ASSERT_MSG(strstr(text, "usbip_auto_attach_attaches_total{method=\"exec\",result=\"success\",exit_code=\"0\"} 1\n"),
+               "Successes are counted");
+    ASSERT_MSG(strstr(text, "usbip_auto_attach_attaches_total{method=\"native\",result=\"success\"} 1\n"),
+               "Native attaches have no exit code");
+
+    /* Time in status: 2 s not attached, then attached from t=3000 */
+    target = metrics_add_target(&metrics, "10.0.0.1", "1-\"1\"");
+    ASSERT_MSG(target == 0, "First target should get index 0");
+    metrics_set_status(&metrics, target, 2, 1000);
+    metrics_set_status(&metrics, target, 2, 2000);
+    metrics_set_status(&metrics, target, 1, 3000);
+    metrics_format(&metrics, 3500, text, sizeof(text));
+    ASSERT_MSG(strstr(text, "usbip_auto_attach_status_seconds_total{target=\"10.0.0.1:1-\\\"1\\\"\",status=\"not_attached\"} 2.000\n"),
+               "Two seconds not attached, label escaped");
+    ASSERT_MSG(strstr(text, "usbip_auto_attach_status_seconds_total{target=\"10.0.0.1:1-\\\"1\\\"\",status=\"attached\"} 0.500\n"),
+               "Current status accrues up to now");
+    ASSERT_MSG(!strstr(text, "status=\"unknown\"}"), "Statuses never entered are left out");
+    ASSERT_MSG(strstr(text, "usbip_auto_attach_status{target=\"10.0.0.1:1-\\\"1\\\"\",status=\"attached\"} 1\n"),
+               "Current status gauge");
+    ASSERT_MSG(strstr(text, "usbip_auto_attach_uptime_seconds 2.500\n"), "Uptime from metrics_init()");
+
+    /* A removed device drops out of the text; its slot can be reused */
+    metrics_remove_target(&metrics, target);
+    metrics_format(&metrics, 3500, text, sizeof(text));
+    ASSERT_MSG(!strstr(text, "10.0.0.1:1-"), "Removed device should not be reported");
+    ASSERT_MSG(metrics_set_target(&metrics, target, "10.0.0.2", "2-2") == target, "Slot should be reused");
+    ASSERT_MSG(metrics_set_target(&metrics, 5, "10.0.0.2", "2-3") == -1, "Slots must be used in order");
+    metrics_set_status(&metrics, target, 1, 4000);
+    metrics_format(&metrics, 4500, text, sizeof(text));
+    ASSERT_MSG(strstr(text, "usbip_auto_attach_status_seconds_total{target=\"10.0.0.2:2-2\",status=\"attached\"} 0.500\n"),
+               "Reused slot should start with no history");
+    ASSERT_MSG(!strstr(text, "10.0.0.2:2-2\",status=\"not_attached\""), "History of the old device is gone");
+
+    /* Truncation reports the full length like snprintf() */
+    len = metrics_format(&metrics, 3500, text, 16);
+    ASSERT_MSG(len > 16, "Full length should be returned");
+    ASSERT_MSG(strlen(text) == 15, "Truncated text should be NUL-terminated");
+
+    printf("test_metrics_format PASSED\n");
+}
+
+/* Connects to the metrics socket, optionally sends a request, returns the socket */
+static int connect_client(const char* path, const char* request) {
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    ASSERT_MSG(fd >= 0 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0, "Client should connect");
+    if (request) {
+        ASSERT_MSG(write(fd, request, strlen(request)) == (ssize_t)strlen(request), "Request should be sent");
+    }
+    return fd;
+}
+
+static size_t read_all(int fd, char* buf, size_t size) {
+    size_t len = 0;
+    ssize_t n;
+
+    while (len + 1 < size && (n = read(fd, buf + len, size - 1 - len)) > 0) {
+        len += (size_t)n;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+void test_metrics_serve() {
+    int clients[METRICS_MAX_CLIENTS_PER_SERVE + 1];
+    struct stat st;
+    char path[64];
+    int fd;
+    int i;
+
+    printf("Running test_metrics_serve...\n");
+    snprintf(path, sizeof(path), "/tmp/metrics_test_%d.sock", (int)getpid());
+    metrics_init(&metrics, test_status_names, 3, 0);
+    metrics_count_spawn(&metrics, METRICS_OP_PORT, 1);
+
+    ASSERT_MSG(metrics_listen(&metrics, path) == 0, "Should listen on the socket");
+    ASSERT_MSG(stat(path, &st) == 0 && (st.st_mode & 0777) == 0600, "Socket should be owner-only");
+    ASSERT_MSG(metrics_serve(&metrics, 0) == 0, "Nobody is waiting yet");
+
+    /* HTTP client, as with curl --unix-socket */
+    fd = connect_client(path, "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    ASSERT_MSG(metrics_serve(&metrics, 0) == 1, "One client should be answered");
+    read_all(fd, text, sizeof(text));
+    close(fd);
+    ASSERT_MSG(strncmp(text, "HTTP/1.0 200 OK\r\n", 17) == 0, "HTTP clients get a status line");
+    ASSERT_MSG(strstr(text, "\r\n\r\n# HELP usbip_auto_attach_uptime_seconds"), "Body follows the headers");
+    ASSERT_MSG(strstr(text, "usbip_auto_attach_process_spawns_total{command=\"port\"} 1\n"), "Body holds the metrics");
+
+    /* Bare client, as with socat: the text alone */
+    fd = connect_client(path, NULL);
+    ASSERT_MSG(metrics_serve(&metrics, 0) == 1, "Bare client should be answered");
+    read_all(fd, text, sizeof(text));
+    close(fd);
+    ASSERT_MSG(strncmp(text, "# HELP usbip_auto_attach_uptime_seconds", 39) == 0, "Bare clients get no headers");
+
+    /* A crowd of clients is answered over several calls */
+    for (i = 0; i <= METRICS_MAX_CLIENTS_PER_SERVE; i++) {
+        clients[i] = connect_client(path, "GET / HTTP/1.0\r\n\r\n");
+    }
+    ASSERT_MSG(metrics_serve(&metrics, 0) == METRICS_MAX_CLIENTS_PER_SERVE, "One call answers a capped number");
+    ASSERT_MSG(metrics_serve(&metrics, 0) == 1, "The rest wait for the next call");
+    for (i = 0; i <= METRICS_MAX_CLIENTS_PER_SERVE; i++) {
+        close(clients[i]);
+    }
+
+    /* A stale socket file is replaced on the next start */
+    metrics_close(&metrics);
+    ASSERT_MSG(access(path, F_OK) != 0, "Socket file should be removed");
+    ASSERT_MSG(metrics_listen(&metrics, path) == 0, "Should listen again");
+    close(metrics.listen_fd);
+    metrics.listen_fd = -1;
+    ASSERT_MSG(metrics_listen(&metrics, path) == 0, "Stale socket file should be replaced");
+    metrics_close(&metrics);
+
+    printf("test_metrics_serve PASSED\n");
+}
+
+int main() {
+    test_metrics_format();
+    test_metrics_serve();
+    printf("All tests PASSED\n");
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include "../src/parser.h"
+#include "../src/scan.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -107,9 +108,210 @@ void test_parse_usbip_list() {
     printf("test_parse_usbip_list PASSED\n");
 }
 
+void test_port_table() {
+    static PortTable table;
+    const PortRecord* record;
+    PortRecord extra;
+    printf("Running test_port_table...\n");
+    const char* output =
+        "Imported USB devices\r\n"
+        "====================\r\n"
+        "Port 00: <Port in Use> at Full Speed(12Mbps)\r\n"
+        "       unknown vendor : unknown product (1234:5678)\r\n"
+        "       1-1 -> usbip://192.168.1.1:3240/7-4\r\n"
+        "           -> remote bus/dev 007/004\r\n"
+        "Port 08: <Port in Use> at Super Speed Plus(10000Mbps)\n"
+        "       Example Corp : Example Device (abcd:ef01)\n"
+        "       5-1 -> usbip://[fe80::1]:3241/devid=0123456789abcdef?x=1\n"
+        "Port 09: <Port in Use> at High Speed(480Mbps)\n"
+        "        2-2 -> usbip://host.example:3240/8-1 bus/dev 008/002";
+
+    ASSERT_MSG(port_table_parse(&table, output) == 3, "Three imported devices should be parsed");
+    ASSERT_MSG(table.truncated == 0, "Table should not be truncated");
+
+    record = port_table_find(&table, "192.168.1.1", "7-4", 1);
+    ASSERT_MSG(record != NULL, "BusID 7-4 should be found");
+    ASSERT_MSG(record->port == 0 && record->speed == 2, "7-4 should be on port 0 at full speed");
+    ASSERT_MSG(record->vendor_id == 0x1234 && record->product_id == 0x5678, "7-4 should be 1234:5678 despite CRLF");
+    ASSERT_MSG(strcmp(record->local_busid, "1-1") == 0, "7-4 local busid should be 1-1");
+    ASSERT_MSG(strcmp(record->host, "192.168.1.1") == 0 && strcmp(record->service, "3240") == 0, "7-4 host and service");
+
+    record = port_table_find(&table, "fe80::1", "0123456789abcdef", 0);
+    ASSERT_MSG(record != NULL, "DevID ...abcdef should be found");
+    ASSERT_MSG(record->port == 8 && record->speed == 6, "DevID should be on port 8 at SuperSpeed Plus");
+    ASSERT_MSG(strcmp(record->host, "[fe80::1]") == 0 && strcmp(record->service, "3241") == 0, "IPv6 host should keep its brackets");
+    ASSERT_MSG(strcmp(record->busid, "devid=0123456789abcdef") == 0, "Query string should not be part of the busid");
+
+    record = port_table_find(&table, "host.example", "8-1", 1);
+    ASSERT_MSG(record != NULL && record->port == 9 && record->speed == 3, "8-1 should be found without a trailing newline");
+    ASSERT_MSG(record->vendor_id == 0 && record->product_id == 0, "8-1 has no vendor line");
+
+    ASSERT_MSG(port_table_find(&table, "192.168.1.1", "7-", 1) == NULL, "Partial busid 7- should NOT be found");
+    ASSERT_MSG(port_table_find(&table, "192.168.1.1", "1-1", 1) == NULL, "Local busid 1-1 should NOT be found");
+    ASSERT_MSG(port_table_find(&table, "[fe80::1]", "0123456789abcdef", 1) == NULL, "DevID should NOT match as a busid");
+    ASSERT_MSG(port_table_find(&table, "host.example", "8-1", 0) == NULL, "BusID should NOT match as a devid");
+
+    /* Records added one by one, beyond the capacity of the table */
+    port_table_reset(&table);
+    ASSERT_MSG(port_table_find(&table, "192.168.1.1", "7-4", 1) == NULL, "Reset table should be empty");
+    memset(&extra, 0, sizeof(extra));
+    extra.host = "10.0.0.1";
+    extra.service = "3240";
+    extra.local_busid = "1-1";
+    for (int i = 0; i <= PORT_TABLE_MAX_RECORDS; i++) {
+        char busid[16];
+        snprintf(busid, sizeof(busid), "%d-%d", i / 100 + 1, i % 100 + 1);
+        extra.port = i;
+        extra.busid = busid;
+        ASSERT_MSG(port_table_add(&table, &extra) == (i < PORT_TABLE_MAX_RECORDS ? 0 : -1), "Adds should fail only when full");
+    }
+    ASSERT_MSG(table.count == PORT_TABLE_MAX_RECORDS && table.truncated == 1, "Full table should be marked truncated");
+    record = port_table_find(&table, "10.0.0.1", "6-12", 1);
+    ASSERT_MSG(record != NULL && record->port == 511, "Last record should be indexed");
+    ASSERT_MSG(port_table_find(&table, "10.0.0.1", "6-13", 1) == NULL, "Dropped record should NOT be found");
+
+    /* One busid imported from two hosts is two devices */
+    port_table_parse(&table, "Port 00: <Port in Use> at High Speed(480Mbps)\n"
+                             "       3-1 -> usbip://10.0.0.1:3240/1-1\n"
+                             "Port 01: <Port in Use> at High Speed(480Mbps)\n"
+                             "       3-2 -> usbip://[fe80::2]:3240/1-1\n");
+    record = port_table_find(&table, "10.0.0.1", "1-1", 1);
+    ASSERT_MSG(record != NULL && record->port == 0, "1-1 from 10.0.0.1 should be on port 0");
+    record = port_table_find(&table, "[fe80::2]", "1-1", 1);
+    ASSERT_MSG(record != NULL && record->port == 1, "1-1 from fe80::2 should be on port 1");
+    ASSERT_MSG(port_table_find(&table, "10.0.0.2", "1-1", 1) == NULL, "1-1 from another host should NOT be found");
+    ASSERT_MSG(port_host_matches("[fe80::2]", "fe80::2") == 1, "Brackets should not matter");
+    ASSERT_MSG(port_host_matches("10.0.0.1", "10.0.0.10") == 0, "Host prefixes should NOT match");
+
+    ASSERT_MSG(port_busid_matches("devid=abc", "abc", 0) == 1, "devid=abc should match devid abc");
+    ASSERT_MSG(port_busid_matches("7-4", "7-4", 1) == 1, "7-4 should match busid 7-4");
+    ASSERT_MSG(port_busid_matches("7-40", "7-4", 1) == 0, "7-40 should NOT match busid 7-4");
+
+    printf("test_port_table PASSED\n");
+}
+
+void test_list_scanner() {
+    static char long_output[65536];
+    ListScanner scanner;
+    size_t len, split, i;
+    printf("Running test_list_scanner...\n");
+    const char* output =
+        "Exportable USB devices\r\n"
+        "======================\r\n"
+        " - 127.0.0.1\r\n"
+        "        1-2: Some other device (1111:2222)\r\n"
+        "        7-4: unknown vendor : unknown product (2e8a:000f)\r\n"
+        "           : 7-4: not at the start of a line\r\n";
+
+    /* Every split point of the output must give the same answer */
+    len = strlen(output);
+    for (split = 0; split <= len; split++) {
+        list_scanner_init(&scanner, "7-4");
+        list_scanner_feed(&scanner, output, split);
+        ASSERT_MSG(list_scanner_feed(&scanner, output + split, len - split) == 1, "7-4 should be found across any split");
+        list_scanner_init(&scanner, "7-");
+        list_scanner_feed(&scanner, output, split);
+        ASSERT_MSG(list_scanner_feed(&scanner, output + split, len - split) == 0, "Partial busid 7- should NOT be found");
+    }
+
+    /* One byte at a time */
+    list_scanner_init(&scanner, "1-2");
+    for (i = 0; i < len && !scanner.found; i++) {
+        list_scanner_feed(&scanner, output + i, 1);
+    }
+    ASSERT_MSG(scanner.found == 1, "1-2 should be found byte by byte");
+    ASSERT_MSG(i == (size_t)(strstr(output, "1-2:") - output) + 4, "Scanner should report 1-2 as soon as its colon arrives");
+
+    /* Lines far longer than any fixed buffer, and output beyond the old 16 KiB cap */
+    memset(long_output, 'x', sizeof(long_output) - 1);
+    long_output[0] = ' ';
+    long_output[1000] = '\n';
+    memcpy(long_output + 1001, "     9-9: before a long line", 28);
+    memcpy(long_output + 60000, "\n  3-1: far down the listing\n", 30);
+    long_output[sizeof(long_output) - 1] = '\0';
+    ASSERT_MSG(parse_usbip_list(long_output, "9-9") == 1, "9-9 should be found after a 1000 byte line");
+    ASSERT_MSG(parse_usbip_list(long_output, "3-1") == 1, "3-1 should be found past 16 KiB and a 59 KB line");
+    ASSERT_MSG(parse_usbip_list(long_output, "x") == 0, "Text inside a long line should NOT match");
+
+    printf("test_list_scanner PASSED\n");
+}
+
+void test_device_matcher() {
+    static PortTable table;
+    static char long_id[DEVICE_MATCHER_ID_MAX + 2];
+    DeviceMatcher matcher;
+    size_t i;
+    int simd;
+    printf("Running test_device_matcher...\n");
+    const char* output =
+        "Imported USB devices\r\n"
+        "====================\r\n"
+        "Port 00: <Port in Use> at High Speed(480Mbps) -> usbip://10.0.0.1:3240/9-9\r\n"
+        "       unknown vendor : unknown product (1234:5678)\r\n"
+        "       1-1 -> usbip://10.0.0.1:3240/7-4\r\n"
+        "       a/6-6 -> usbip://10.0.0.1:3240/5-5\r\n"
+        "       1-2 -> usbip://10.0.0.1:3240/4-4?dev=1\r\n"
+        "       1-3 -> usbip://10.0.0.1:3240/3-3/2-2\r\n"
+        "       1-4 -> usbip://10.0.0.1:3240/8-12\r\n"
+        "       1-5 -> usbip://10.0.0.1:3240/1-9 -> usbip://10.0.0.1:3240/2-9\r\n"
+        "       1-6 -> usbip://[fe80::1]:3240/devid=00ff\r\n"
+        "           -> remote bus/dev 007/004\r\n";
+    const char* ids[] = {"7-4", "9-9", "6-6", "5-5", "4-4", "3-3", "2-2", "3-3/2-2", "8-1", "8-12",
+                         "1-9", "2-9", "1-1", "devid=00ff", "7-"};
+    const char* listing =
+        "Exportable USB devices\n"
+        "======================\n"
+        " - 127.0.0.1\n"
+        "        1-2: Some other device (1111:2222)\n"
+        "\t7-4: unknown vendor : unknown product (2e8a:000f)\n"
+        "           : 6-1: not at the start of a line\n"
+        "3-3:\n";
+
+    /* Same answers as the table lookup, with and without SIMD */
+    port_table_parse(&table, output);
+    for (simd = 0; simd <= 1; simd++) {
+        scan_set_simd(simd);
+        for (i = 0; i < sizeof(ids) / sizeof(ids[0]); i++) {
+            ASSERT_MSG(device_matcher_init(&matcher, ids[i], 1) == 0, "Short busid should fit");
+            ASSERT_MSG(device_matcher_port(&matcher, output, strlen(output)) == (port_table_find(&table, "10.0.0.1", ids[i], 1) != NULL ||
+                                                                                port_table_find(&table, "fe80::1", ids[i], 1) != NULL),
+                       "Matcher should agree with the tokenizer on busids");
+        }
+        ASSERT_MSG(device_matcher_init(&matcher, "00ff", 0) == 0, "Short devid should fit");
+        ASSERT_MSG(device_matcher_port(&matcher, output, strlen(output)) == 1, "DevID 00ff should be attached");
+        ASSERT_MSG(device_matcher_init(&matcher, "00f", 0) == 0, "Short devid should fit");
+        ASSERT_MSG(device_matcher_port(&matcher, output, strlen(output)) == 0, "DevID prefix should NOT match");
+
+        /* Matches at the very end of the buffer, without a newline */
+        device_matcher_init(&matcher, "7-4", 1);
+        ASSERT_MSG(device_matcher_port(&matcher, "1-1 -> usbip://h/7-4", 20) == 1, "Match at the end of the buffer");
+        ASSERT_MSG(device_matcher_port(&matcher, "1-1 -> usbip://h/7-4", 19) == 0, "Bytes past len are not looked at");
+
+        ASSERT_MSG(device_matcher_list(&matcher, listing, strlen(listing)) == 1, "7-4 should be listed after a tab");
+        device_matcher_init(&matcher, "3-3", 1);
+        ASSERT_MSG(device_matcher_list(&matcher, listing, strlen(listing)) == 1, "3-3 should be listed on the last line");
+        device_matcher_init(&matcher, "6-1", 1);
+        ASSERT_MSG(device_matcher_list(&matcher, listing, strlen(listing)) == 0, "6-1 is not at the start of a line");
+        device_matcher_init(&matcher, "1-", 1);
+        ASSERT_MSG(device_matcher_list(&matcher, listing, strlen(listing)) == 0, "Partial busid should NOT be listed");
+    }
+    scan_set_simd(1);
+
+    /* Identifiers too long for a matcher still work through the tokenizer */
+    memset(long_id, '1', sizeof(long_id) - 1);
+    ASSERT_MSG(device_matcher_init(&matcher, long_id, 1) == -1, "Long busid should be refused");
+    ASSERT_MSG(parse_usbip_port(output, long_id, 1) == 0, "Long busid should fall back");
+    ASSERT_MSG(parse_usbip_list(listing, long_id) == 0, "Long busid should fall back");
+
+    printf("test_device_matcher PASSED\n");
+}
+
 int main() {
     test_parse_usbip_port();
+    test_port_table();
     test_parse_usbip_list();
+    test_list_scanner();
+    test_device_matcher();
     printf("All tests PASSED\n");
     return 0;
 }
@@ -0,0 +1,150 @@
+#define _DEFAULT_SOURCE
+#include "../src/pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <time.h>
+
+/* Helper macro for assertions with messages */
+#define ASSERT_MSG(condition, message) \
+    if (!(condition)) { \
+        fprintf(stderr, "Assertion failed: (" #condition "), %s\n", message); \
+        exit(1); /* Exit with failure */ \
+    }
+
+/* Concurrency seen by the jobs, overall and for key "a" */
+static pthread_mutex_t seen_lock = PTHREAD_MUTEX_INITIALIZER;
+static int running, running_a, peak, peak_a;
+
+typedef struct {
+    int is_a;
+    int sleep_ms;
+    int done;
+} SleepJob;
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void sleep_job(void* arg) {
+    SleepJob* job = arg;
+
+    pthread_mutex_lock(&seen_lock);
+    running++;
+    running_a += job->is_a;
+    peak = running > peak ? running : peak;
+    peak_a = running_a > peak_a ? running_a : peak_a;
+    pthread_mutex_unlock(&seen_lock);
+
+    poll(NULL, 0, job->sleep_ms);
+
+    pthread_mutex_lock(&seen_lock);
+    running--;
+    running_a -= job->is_a;
+    pthread_mutex_unlock(&seen_lock);
+    job->done = 1;
+}
+
+/* Runs four 100 ms jobs, keys a, a, b, b, returns the elapsed time */
+static long long run_batch(WorkPool* pool, SleepJob* jobs) {
+    long long start = now_ms();
+    int i;
+
+    peak = peak_a = 0;
+    for (i = 0; i < 4; i++) {
+        jobs[i].is_a = i < 2;
+        jobs[i].sleep_ms = 100;
+        jobs[i].done = 0;
+        ASSERT_MSG(pool_submit(pool, jobs[i].is_a ? "a" : "b", sleep_job, &jobs[i]) == 0, "Job should be queued");
+    }
+    pool_wait(pool);
+    for (i = 0; i < 4; i++) {
+        ASSERT_MSG(jobs[i].done, "Every job should be done after pool_wait()");
+    }
+    return now_ms() - start;
+}
+
+void test_pool_parallel() {
+    WorkPool pool;
+    SleepJob jobs[4];
+    long long elapsed;
+
+    printf("Running test_pool_parallel...\n");
+    ASSERT_MSG(pool_start(&pool, 4, 0) == 0, "Pool should start");
+    elapsed = run_batch(&pool, jobs);
+    ASSERT_MSG(peak == 4, "All four jobs should run at once");
+    ASSERT_MSG(elapsed < 300, "Four parallel jobs should take about one job's time");
+
+    /* The pool is reusable batch after batch */
+    run_batch(&pool, jobs);
+    ASSERT_MSG(peak == 4, "Second batch runs in parallel too");
+    pool_stop(&pool);
+    printf("test_pool_parallel PASSED\n");
+}
+
+void test_pool_key_limit() {
+    WorkPool pool;
+    SleepJob jobs[4];
+    long long elapsed;
+
+    printf("Running test_pool_key_limit...\n");
+    ASSERT_MSG(pool_start(&pool, 4, 1) == 0, "Pool should start");
+    elapsed = run_batch(&pool, jobs);
+    ASSERT_MSG(peak_a == 1, "Jobs with one key should take turns");
+    ASSERT_MSG(peak == 2, "Jobs with different keys still overlap");
+    ASSERT_MSG(elapsed >= 200 && elapsed < 400, "Two rounds of two jobs");
+    pool_stop(&pool);
+
+    /* A single thread runs everything in order */
+    ASSERT_MSG(pool_start(&pool, 1, 0) == 0, "Pool should start");
+    elapsed = run_batch(&pool, jobs);
+    ASSERT_MSG(peak == 1 && elapsed >= 400, "One thread runs one job at a time");
+    pool_stop(&pool);
+    printf("test_pool_key_limit PASSED\n");
+}
+
+static volatile sig_atomic_t keep_running = 1;
+
+static void on_signal(int signo) {
+    (void)signo;
+    keep_running = 0;
+}
+
+static void stop_job(void* arg) {
+    (void)arg;
+    keep_running = 0;
+}
+
+void test_pool_cancel() {
+    struct sigaction sa;
+    WorkPool pool;
+    SleepJob blocked = {0, 5000, 0};
+    long long start;
+
+    printf("Running test_pool_cancel...\n");
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGUSR2, &sa, NULL);
+
+    /* One job blocks for 5 s, the other requests shutdown the way a signal handler would */
+    ASSERT_MSG(pool_start(&pool, 2, 0) == 0, "Pool should start");
+    pool_set_keep_running(&pool, &keep_running, SIGUSR2);
+    start = now_ms();
+    pool_submit(&pool, "a", sleep_job, &blocked);
+    pool_submit(&pool, "b", stop_job, NULL);
+    pool_wait(&pool);
+    ASSERT_MSG(blocked.done && now_ms() - start < 1000, "Blocked job should be interrupted");
+    pool_stop(&pool);
+    printf("test_pool_cancel PASSED\n");
+}
+
+int main() {
+    test_pool_parallel();
+    test_pool_key_limit();
+    test_pool_cancel();
+    printf("All tests PASSED\n");
+    return 0;
+}
@@ -0,0 +1,140 @@
+#define _DEFAULT_SOURCE
+#include "../src/port_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Helper macro for assertions with messages */
+#define ASSERT_MSG(condition, message) \
+    if (!(condition)) { \
+        fprintf(stderr, "Assertion failed: (" #condition "), %s\n", message); \
+        exit(1); /* Exit with failure */ \
+    }
+
+static PortCache cache;
+
+/* What the fake port state holds; "" for no device */
+static const char* attached_busid = "1-1";
+static int fill_fails;
+static int fill_sleep_ms;
+
+/* Stands in for vhci sysfs or `usbip port` */
+static int fake_fill(PortTable* table, void* ctx) {
+    int* calls = ctx;
+    PortRecord record;
+
+    (*calls)++;
+    if (fill_sleep_ms) {
+        usleep(fill_sleep_ms * 1000);
+    }
+    port_table_reset(table);
+    if (fill_fails) {
+        return 0;
+    }
+    if (attached_busid[0]) {
+        memset(&record, 0, sizeof(record));
+        record.port = 0;
+        record.local_busid = "3-1";
+        record.host = "10.0.0.1";
+        record.service = "3240";
+        record.busid = attached_busid;
+        port_table_add(table, &record);
+    }
+    return 1;
+}
+
+void test_port_cache_reuse() {
+    int calls = 0;
+
+    printf("Running test_port_cache_reuse...\n");
+    port_cache_init(&cache, 1000, fake_fill, &calls);
+
+    /* Every lookup within the window shares one read */
+    ASSERT_MSG(port_cache_refresh(&cache, 5000) == 1, "First read should succeed");
+    ASSERT_MSG(port_cache_find(&cache, "10.0.0.1", "1-1", 1, 5000) == 1, "Device should be attached");
+    ASSERT_MSG(port_cache_find(&cache, "10.0.0.1", "1-2", 1, 5100) == 0, "Other device is not");
+    ASSERT_MSG(port_cache_find(&cache, "10.0.0.1", "1-1", 1, 5999) == 1, "Still within the window");
+    ASSERT_MSG(calls == 1 && cache.fills == 1, "One read for every lookup");
+
+    /* The local busid tells which vhci port to watch for removal */
+    {
+        char local[16];
+        ASSERT_MSG(port_cache_find_local(&cache, "10.0.0.1", "1-1", 1, 5999, local, sizeof(local)) == 1 &&
+                   strcmp(local, "3-1") == 0, "Local busid of an attached device");
+        ASSERT_MSG(port_cache_find_local(&cache, "10.0.0.1", "1-2", 1, 5999, local, sizeof(local)) == 0 && local[0] == '\0',
+                   "No local busid for a device that isn't attached");
+    }
+
+    /* Expired: read again */
+    attached_busid = "";
+    ASSERT_MSG(port_cache_find(&cache, "10.0.0.1", "1-1", 1, 6000) == 0, "Expired view should be refreshed");
+    ASSERT_MSG(calls == 2, "Second read after the window");
+
+    /* Invalidated: read again at once */
+    attached_busid = "1-1";
+    ASSERT_MSG(port_cache_find(&cache, "10.0.0.1", "1-1", 1, 6001) == 0, "Stale but still within the window");
+    port_cache_invalidate(&cache);
+    ASSERT_MSG(port_cache_find(&cache, "10.0.0.1", "1-1", 1, 6002) == 1, "Invalidated view should be refreshed");
+    ASSERT_MSG(calls == 3 && cache.generation == 1, "Third read after the invalidation");
+
+    /* A failed read is remembered for the window too */
+    fill_fails = 1;
+    port_cache_invalidate(&cache);
+    ASSERT_MSG(port_cache_find(&cache, "10.0.0.1", "1-1", 1, 6003) == -1, "Failed read");
+    ASSERT_MSG(port_cache_refresh(&cache, 6004) == 0, "Failure is reused");
+    ASSERT_MSG(calls == 4, "No retry within the window");
+    fill_fails = 0;
+    ASSERT_MSG(port_cache_refresh(&cache, 7003) == 1, "Retried once the window is over");
+
+    printf("test_port_cache_reuse PASSED\n");
+}
+
+/* Lookup made by one of several threads, as by the attach workers */
+static void* lookup_thread(void* arg) {
+    int* found = arg;
+    *found = port_cache_find(&cache, "10.0.0.1", "1-1", 1, 10000);
+    return NULL;
+}
+
+void test_port_cache_concurrent() {
+    pthread_t threads[8];
+    int found[8];
+    int calls = 0;
+    int i;
+
+    printf("Running test_port_cache_concurrent...\n");
+    port_cache_init(&cache, 1000, fake_fill, &calls);
+    attached_busid = "1-1";
+
+    /* Callers arriving while a slow read runs wait for it instead of reading again */
+    fill_sleep_ms = 50;
+    for (i = 0; i < 8; i++) {
+        ASSERT_MSG(pthread_create(&threads[i], NULL, lookup_thread, &found[i]) == 0, "Thread should start");
+    }
+    for (i = 0; i < 8; i++) {
+        pthread_join(threads[i], NULL);
+        ASSERT_MSG(found[i] == 1, "Every thread should see the device");
+    }
+    ASSERT_MSG(calls == 1, "Concurrent lookups should share one read");
+
+    /* A change made while a read runs isn't in it: the next lookup reads again */
+    port_cache_invalidate(&cache);
+    ASSERT_MSG(pthread_create(&threads[0], NULL, lookup_thread, &found[0]) == 0, "Thread should start");
+    usleep(10000);
+    port_cache_invalidate(&cache);
+    pthread_join(threads[0], NULL);
+    fill_sleep_ms = 0;
+    ASSERT_MSG(calls == 2, "Invalidated lookup should read once");
+    ASSERT_MSG(port_cache_find(&cache, "10.0.0.1", "1-1", 1, 10000) == 1 && calls == 3,
+               "Invalidation during a read should force another");
+
+    printf("test_port_cache_concurrent PASSED\n");
+}
+
+int main() {
+    test_port_cache_reuse();
+    test_port_cache_concurrent();
+    printf("All tests PASSED\n");
+    return 0;
+}
@@ -0,0 +1,127 @@
+#define _DEFAULT_SOURCE
+#include "../src/resolver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Helper macro for assertions with messages */
+#define ASSERT_MSG(condition, message) \
+    if (!(condition)) { \
+        fprintf(stderr, "Assertion failed: (" #condition "), %s\n", message); \
+        exit(1); /* Exit with failure */ \
+    }
+
+static char root[] = "/tmp/resolver_test_XXXXXX";
+static Resolver resolver;
+
+/* Writes a small executable script at root/rel_path */
+static void write_program(const char* rel_path, const char* body) {
+    char path[512];
+    FILE* f;
+    snprintf(path, sizeof(path), "%s/%s", root, rel_path);
+    f = fopen(path, "w");
+    ASSERT_MSG(f != NULL, "failed to create program");
+    fprintf(f, "#!/bin/sh\n%s\n", body);
+    fclose(f);
+    chmod(path, 0755);
+}
+
+static void make_dir(const char* rel_path) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", root, rel_path);
+    mkdir(path, 0755);
+}
+
+/* Removes everything the test may have created; leftovers fail the test.
+ * Done without the shell, as PATH no longer leads to rm by the end. */
+static void cleanup(void) {
+    static const char* const files[] = {"b/usbip", "b/usbip.new", "a/usbip", "mine"};
+    static const char* const dirs[] = {"a", "b", ""};
+    char path[512];
+    size_t i;
+
+    for (i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", root, files[i]);
+        ASSERT_MSG(unlink(path) == 0 || errno == ENOENT, "failed to remove a test file");
+    }
+    for (i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", root, dirs[i]);
+        ASSERT_MSG(rmdir(path) == 0, "failed to remove a test directory");
+    }
+}
+
+void test_resolver() {
+    char path_env[1200];
+    char expected[512];
+    char found[RESOLVER_PATH_MAX];
+    char rel[512];
+
+    printf("Running test_resolver...\n");
+    ASSERT_MSG(mkdtemp(root) != NULL, "mkdtemp failed");
+    make_dir("a");
+    make_dir("b");
+    write_program("b/usbip", "echo b");
+    snprintf(path_env, sizeof(path_env), "::%s/a:%s/b", root, root);
+    setenv("PATH", path_env, 1);
+
+    /* Found in PATH, skipping empty entries and directories without it */
+    ASSERT_MSG(resolver_init(&resolver, "usbip", NULL) == 0, "usbip should be found in PATH");
+    ASSERT_MSG(resolver_copy(&resolver, found, sizeof(found)) == 1, "Path should be known");
+    snprintf(expected, sizeof(expected), "%s/b/usbip", root);
+    ASSERT_MSG(strcmp(found, expected) == 0, "Second PATH directory holds it");
+    ASSERT_MSG(resolver.resolutions == 1, "Looked up once");
+
+    /* Nothing changed: one stat, no search */
+    ASSERT_MSG(resolver_revalidate(&resolver) == RESOLVER_UNCHANGED, "Same file is unchanged");
+    ASSERT_MSG(resolver.resolutions == 1, "No search for an unchanged file");
+
+    /* Upgraded in place: same path, another file */
+    snprintf(rel, sizeof(rel), "%s/b/usbip.new", root);
+    write_program("b/usbip.new", "echo b2");
+    ASSERT_MSG(rename(rel, expected) == 0, "Replacing the program should work");
+    ASSERT_MSG(resolver_revalidate(&resolver) == RESOLVER_CHANGED, "Replaced file is a change");
+    resolver_copy(&resolver, found, sizeof(found));
+    ASSERT_MSG(strcmp(found, expected) == 0, "Path stays the same");
+    ASSERT_MSG(resolver_revalidate(&resolver) == RESOLVER_UNCHANGED, "New file is remembered");
+
+    /* Moved to an earlier PATH directory */
+    snprintf(rel, sizeof(rel), "%s/a/usbip", root);
+    ASSERT_MSG(rename(expected, rel) == 0, "Moving the program should work");
+    ASSERT_MSG(resolver_revalidate(&resolver) == RESOLVER_CHANGED, "Moved file is a change");
+    resolver_copy(&resolver, found, sizeof(found));
+    ASSERT_MSG(strcmp(found, rel) == 0, "New directory is used");
+
+    /* Gone altogether, then back */
+    unlink(rel);
+    ASSERT_MSG(resolver_revalidate(&resolver) == RESOLVER_MISSING, "Missing program");
+    ASSERT_MSG(resolver_copy(&resolver, found, sizeof(found)) == 0, "No path while missing");
+    write_program("b/usbip", "echo b3");
+    ASSERT_MSG(resolver_revalidate(&resolver) == RESOLVER_CHANGED, "Program is back");
+
+    /* The user's path wins over PATH; a non-executable one is skipped */
+    write_program("mine", "echo mine");
+    snprintf(rel, sizeof(rel), "%s/mine", root);
+    ASSERT_MSG(resolver_init(&resolver, "usbip", rel) == 0, "User path should be used");
+    resolver_copy(&resolver, found, sizeof(found));
+    ASSERT_MSG(strcmp(found, rel) == 0, "User path wins");
+    chmod(rel, 0644);
+    ASSERT_MSG(resolver_revalidate(&resolver) == RESOLVER_CHANGED, "Unusable user path falls back to PATH");
+    resolver_copy(&resolver, found, sizeof(found));
+    ASSERT_MSG(strcmp(found, expected) == 0, "PATH is used instead");
+
+    /* Directories named like the program don't count */
+    setenv("PATH", root, 1);
+    ASSERT_MSG(resolver_init(&resolver, "a", NULL) < 0, "A directory is not a program");
+
+    cleanup();
+    printf("test_resolver PASSED\n");
+}
+
+int main() {
+    test_resolver();
+    printf("All tests PASSED\n");
+    return 0;
+}
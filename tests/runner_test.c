@@ -0,0 +1,125 @@
+#define _GNU_SOURCE
+#include "../src/runner.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+
+/* Helper macro for assertions with messages */
+#define ASSERT_MSG(condition, message) \
+    if (!(condition)) { \
+        fprintf(stderr, "Assertion failed: (" #condition "), %s\n", message); \
+        exit(1); /* Exit with failure */ \
+    }
+
+static long long elapsed_ms(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)(now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+static volatile sig_atomic_t keep_running = 1;
+
+static void on_alarm(int sig) {
+    (void)sig;
+    keep_running = 0;
+}
+
+/* Stops once "needle" has been seen */
+static int find_needle(const char* chunk, size_t len, void* ctx) {
+    size_t* total = ctx;
+    *total += len;
+    return memmem(chunk, len, "needle", 6) != NULL;
+}
+
+void test_runner_run() {
+    RunnerBuffer buf = {NULL, 0, 0};
+    RunnerResult result;
+    struct timespec start;
+    size_t total = 0;
+    char* data;
+    printf("Running test_runner_run...\n");
+
+    /* Arguments reach the program verbatim, stdout and stderr are combined */
+    {
+        const char* argv[] = {"/bin/sh", "-c", "echo \"$1\"; echo err >&2", "sh", "it's a 'quoted' $arg", NULL};
+        ASSERT_MSG(runner_run(argv, 5000, &buf, NULL, NULL, &result) == 0, "sh should start");
+        ASSERT_MSG(result.success == 1 && result.exit_code == 0, "sh should succeed");
+        ASSERT_MSG(strcmp(buf.data, "it's a 'quoted' $arg\nerr\n") == 0, "Output should be captured without shell quoting");
+        ASSERT_MSG(buf.len == strlen(buf.data), "Length should match the output");
+    }
+
+    /* Exit status, and the buffer is reused rather than reallocated */
+    {
+        const char* argv[] = {"/bin/sh", "-c", "exit 3", NULL};
+        data = buf.data;
+        ASSERT_MSG(runner_run(argv, 5000, &buf, NULL, NULL, &result) == 0, "sh should start");
+        ASSERT_MSG(result.success == 0 && result.exit_code == 3, "Exit status 3 should be reported");
+        ASSERT_MSG(buf.data == data && buf.len == 0 && buf.data[0] == '\0', "Buffer should be reused and emptied");
+    }
+
+    /* Output larger than one read is collected whole */
+    {
+        const char* argv[] = {"/bin/sh", "-c", "i=0; while [ $i -lt 3000 ]; do echo 0123456789012345678901234567890123456789; i=$((i+1)); done", NULL};
+        ASSERT_MSG(runner_run(argv, 10000, &buf, NULL, NULL, &result) == 0, "sh should start");
+        ASSERT_MSG(result.success == 1 && buf.len == 3000 * 41, "All 123000 bytes should be collected");
+    }
+
+    /* Streaming stops and kills the command once the callback is satisfied */
+    {
+        const char* argv[] = {"/bin/sh", "-c", "echo hay; echo needle; sleep 10; echo late", NULL};
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        ASSERT_MSG(runner_run(argv, 20000, &buf, find_needle, &total, &result) == 0, "sh should start");
+        ASSERT_MSG(result.stopped == 1 && result.success == 1, "Run should stop once the needle is seen");
+        ASSERT_MSG(elapsed_ms(&start) < 5000, "Stopped command should not be waited for");
+    }
+
+    /* Deadline kills a hung command */
+    {
+        const char* argv[] = {"/bin/sleep", "10", NULL};
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        ASSERT_MSG(runner_run(argv, 200, &buf, NULL, NULL, &result) == 0, "sleep should start");
+        ASSERT_MSG(result.timed_out == 1 && result.success == 0, "sleep should time out");
+        ASSERT_MSG(elapsed_ms(&start) < 5000, "Timed out command should be killed promptly");
+    }
+
+    /* Deadline also covers a command that closed its output but keeps running */
+    {
+        const char* argv[] = {"/bin/sh", "-c", "exec >/dev/null 2>&1; sleep 10", NULL};
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        ASSERT_MSG(runner_run(argv, 200, &buf, NULL, NULL, &result) == 0, "sh should start");
+        ASSERT_MSG(result.timed_out == 1 && elapsed_ms(&start) < 5000, "Silent command should time out");
+    }
+
+    /* A signal clearing the keep-running flag kills the command right away */
+    {
+        const char* argv[] = {"/bin/sleep", "10", NULL};
+        signal(SIGALRM, on_alarm);
+        runner_set_keep_running(&keep_running);
+        alarm(1);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        ASSERT_MSG(runner_run(argv, 20000, &buf, NULL, NULL, &result) == 0, "sleep should start");
+        ASSERT_MSG(result.cancelled == 1 && result.success == 0, "sleep should be cancelled");
+        ASSERT_MSG(elapsed_ms(&start) < 5000, "Cancelled command should be killed promptly");
+        runner_set_keep_running(NULL);
+    }
+
+    /* Missing program */
+    {
+        const char* argv[] = {"/nonexistent/usbip", "port", NULL};
+        int ret = runner_run(argv, 1000, &buf, NULL, NULL, &result);
+        ASSERT_MSG(ret == -1 || (result.success == 0 && result.exit_code == 127), "Missing program should fail");
+    }
+
+    runner_buffer_free(&buf);
+    ASSERT_MSG(buf.data == NULL && buf.capacity == 0, "Freed buffer should be empty");
+    printf("test_runner_run PASSED\n");
+}
+
+int main() {
+    test_runner_run();
+    printf("All tests PASSED\n");
+    return 0;
+}
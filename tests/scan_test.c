@@ -0,0 +1,101 @@
+#include "../src/scan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Helper macro for assertions with messages */
+#define ASSERT_MSG(condition, message) \
+    if (!(condition)) { \
+        fprintf(stderr, "Assertion failed: (" #condition "), %s\n", message); \
+        exit(1); /* Exit with failure */ \
+    }
+
+/* Straightforward reference for scan_find() */
+static const char* naive_find(const char* p, const char* end, const char* needle, size_t needle_len) {
+    for (; (size_t)(end - p) >= needle_len; p++) {
+        if (memcmp(p, needle, needle_len) == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/* Small alphabet so that partial matches are common */
+static void fill_random(char* buf, size_t len) {
+    size_t i;
+    for (i = 0; i < len; i++) {
+        buf[i] = "ab\n:/-"[rand() % 6];
+    }
+}
+
+void test_scan_byte() {
+    char buf[100];
+    size_t start, len, i;
+    int simd;
+
+    printf("Running test_scan_byte (%s)...\n", scan_implementation());
+    for (simd = 0; simd <= 1; simd++) {
+        scan_set_simd(simd);
+
+        /* Every position around the 16 byte blocks, and every alignment */
+        for (start = 0; start < 17; start++) {
+            for (len = 0; start + len <= sizeof(buf); len++) {
+                memset(buf, 'x', sizeof(buf));
+                ASSERT_MSG(scan_byte(buf + start, buf + start + len, '\n') == NULL, "No match in a buffer without the byte");
+                for (i = 0; i < len; i++) {
+                    buf[start + i] = '\n';
+                    ASSERT_MSG(scan_byte(buf + start, buf + start + len, '\n') == buf + start + i, "First match should be found");
+                    buf[start + i] = 'x';
+                }
+                /* A byte just past the end must not be reported */
+                if (start + len < sizeof(buf)) {
+                    buf[start + len] = '\n';
+                    ASSERT_MSG(scan_byte(buf + start, buf + start + len, '\n') == NULL, "Bytes past the end are ignored");
+                }
+            }
+        }
+    }
+    scan_set_simd(1);
+
+    printf("test_scan_byte PASSED\n");
+}
+
+void test_scan_find() {
+    static char buf[4096];
+    const char* needles[] = {"a", "ab", "-> ", "/a-b", "b:\n", "ab/ab-ab:ab\nab/ab-ab:a"};
+    size_t n, len, start;
+    int round, simd;
+
+    printf("Running test_scan_find...\n");
+    srand(17);
+    for (round = 0; round < 2000; round++) {
+        len = (size_t)(rand() % 300);
+        start = (size_t)(rand() % 16);
+        fill_random(buf + start, len);
+        for (n = 0; n < sizeof(needles) / sizeof(needles[0]); n++) {
+            size_t needle_len = strlen(needles[n]);
+            const char* expected = naive_find(buf + start, buf + start + len, needles[n], needle_len);
+            for (simd = 0; simd <= 1; simd++) {
+                scan_set_simd(simd);
+                ASSERT_MSG(scan_find(buf + start, buf + start + len, needles[n], needle_len) == expected,
+                           "scan_find() should agree with the reference");
+            }
+        }
+    }
+    scan_set_simd(1);
+
+    /* A needle straddling the end of the buffer is no match */
+    memcpy(buf, "xxxxxxxxxxxxxxxxxxxxxxxxxxxxx-> usbip://", 40);
+    ASSERT_MSG(scan_find(buf, buf + 40, "-> usbip://", 11) == buf + 29, "Needle ending at the end should be found");
+    ASSERT_MSG(scan_find(buf, buf + 39, "-> usbip://", 11) == NULL, "Needle cut by the end should NOT be found");
+    ASSERT_MSG(scan_find(buf, buf + 5, "-> usbip://", 11) == NULL, "Needle longer than the buffer should NOT be found");
+
+    printf("test_scan_find PASSED\n");
+}
+
+int main() {
+    test_scan_byte();
+    test_scan_find();
+    printf("All tests PASSED\n");
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "../src/scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Helper macro for assertions with messages */
+#define ASSERT_MSG(condition, message) \
+    if (!(condition)) { \
+        fprintf(stderr, "Assertion failed: (" #condition "), %s\n", message); \
+        exit(1); /* Exit with failure */ \
+    }
+
+void test_scheduler_next_delay() {
+    Scheduler scheduler;
+    TargetSchedule target = {0, 0};
+    int i, delay;
+    printf("Running test_scheduler_next_delay...\n");
+
+    scheduler_init(&scheduler, 12345);
+    scheduler.jitter_percent = 0;
+    scheduler.interval_ms = 1000;
+    scheduler.max_backoff_ms = 10000;
+    scheduler.fast_retry_ms = 100;
+    scheduler.fast_retries = 3;
+
+    /* Steady state while attached */
+    ASSERT_MSG(scheduler_next_delay(&scheduler, &target, SCHED_ATTACHED) == SCHEDULER_DEFAULT_ATTACHED_MS,
+               "Attached device should use the slow interval");
+
+    /* Exponential backoff, capped */
+    ASSERT_MSG(scheduler_next_delay(&scheduler, &target, SCHED_FAILED) == 1000, "First failure should wait interval");
+    ASSERT_MSG(scheduler_next_delay(&scheduler, &target, SCHED_FAILED) == 2000, "Second failure should double");
+    ASSERT_MSG(scheduler_next_delay(&scheduler, &target, SCHED_FAILED) == 4000, "Third failure should double again");
+    ASSERT_MSG(scheduler_next_delay(&scheduler, &target, SCHED_FAILED) == 8000, "Fourth failure should double again");
+    for (i = 0; i < 100; i++) {
+        delay = scheduler_next_delay(&scheduler, &target, SCHED_FAILED);
+    }
+    ASSERT_MSG(delay == 10000, "Backoff should stop at the cap, even after many failures");
+
+    /* Success resets the backoff */
+    scheduler_next_delay(&scheduler, &target, SCHED_ATTACHED);
+    ASSERT_MSG(scheduler_next_delay(&scheduler, &target, SCHED_FAILED) == 1000, "Backoff should restart after an attach");
+
+    /* A detach starts a burst of fast retries, then regular backoff */
+    scheduler_next_delay(&scheduler, &target, SCHED_ATTACHED);
+    scheduler_note_detach(&scheduler, &target);
+    for (i = 0; i < 3; i++) {
+        ASSERT_MSG(scheduler_next_delay(&scheduler, &target, SCHED_FAILED) == 100, "Burst should retry quickly");
+    }
+    ASSERT_MSG(scheduler_next_delay(&scheduler, &target, SCHED_FAILED) == 1000, "Backoff should follow the burst");
+
+    /* Jitter stays within bounds and actually varies */
+    {
+        int min_seen = 1 << 30, max_seen = 0;
+        scheduler.jitter_percent = 20;
+        for (i = 0; i < 1000; i++) {
+            TargetSchedule fresh = {0, 0};
+            delay = scheduler_next_delay(&scheduler, &fresh, SCHED_FAILED);
+            ASSERT_MSG(delay >= 800 && delay <= 1200, "Jittered delay should stay within +/-20%");
+            if (delay < min_seen) min_seen = delay;
+            if (delay > max_seen) max_seen = delay;
+        }
+        ASSERT_MSG(max_seen - min_seen > 200, "Jitter should spread retries");
+    }
+
+    printf("test_scheduler_next_delay PASSED\n");
+}
+
+void test_scheduler_derive() {
+    Scheduler base, first, second;
+    TargetSchedule a = {0, 0}, b = {0, 0};
+    int i, differ = 0;
+
+    printf("Running test_scheduler_derive...\n");
+    scheduler_init(&base, 7);
+    base.interval_ms = 1000;
+    scheduler_derive(&base, &first);
+    scheduler_derive(&base, &second);
+    second.interval_ms = 4000;
+    ASSERT_MSG(first.interval_ms == 1000, "Tunables should be copied");
+    ASSERT_MSG(base.interval_ms == 1000, "Changing a derived scheduler leaves the base alone");
+    ASSERT_MSG(scheduler_next_delay(&second, &b, SCHED_FAILED) >= 3200, "Derived tunables apply to their device");
+
+    /* Same tunables, independent jitter */
+    second.interval_ms = 1000;
+    for (i = 0; i < 20; i++) {
+        a.failures = b.failures = 0;
+        if (scheduler_next_delay(&first, &a, SCHED_FAILED) != scheduler_next_delay(&second, &b, SCHED_FAILED)) {
+            differ = 1;
+        }
+    }
+    ASSERT_MSG(differ, "Derived schedulers should not jitter in lockstep");
+
+    printf("test_scheduler_derive PASSED\n");
+}
+
+int main() {
+    test_scheduler_next_delay();
+    test_scheduler_derive();
+    printf("All tests PASSED\n");
+    return 0;
+}
@@ -0,0 +1,163 @@
+#define _DEFAULT_SOURCE
+#include "../src/session.h"
+#include "fake_usbipd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/* Helper macro for assertions with messages */
+#define ASSERT_MSG(condition, message) \
+    if (!(condition)) { \
+        fprintf(stderr, "Assertion failed: (" #condition "), %s\n", message); \
+        exit(1); /* Exit with failure */ \
+    }
+
+static SessionTable table;
+
+void test_session_get() {
+    HostSession* first;
+
+    printf("Running test_session_get...\n");
+    session_table_init(&table);
+    first = session_get(&table, "10.0.0.1");
+    ASSERT_MSG(first != NULL && first->alive == -1 && !first->cached, "New session knows nothing yet");
+    ASSERT_MSG(session_get(&table, "10.0.0.2") != first, "Each host gets its own session");
+    ASSERT_MSG(session_get(&table, "10.0.0.1") == first, "Devices on one host share a session");
+    ASSERT_MSG(table.count == 2, "Two hosts");
+    printf("test_session_get PASSED\n");
+}
+
+void test_session_put() {
+    HostSession* held[SESSION_MAX_HOSTS];
+    HostSession* shared;
+    char host[32];
+    int i;
+
+    printf("Running test_session_put...\n");
+    session_table_init(&table);
+
+    /* A session stays while anyone holds it */
+    shared = session_get(&table, "10.0.0.1");
+    ASSERT_MSG(session_get(&table, "10.0.0.1") == shared && shared->users == 2, "Two holders");
+    session_put(shared);
+    ASSERT_MSG(session_get(&table, "10.0.0.2") != shared, "A held session is not reused");
+    session_put(shared);
+    ASSERT_MSG(session_get(&table, "10.0.0.3") == shared, "A released session is reused");
+    ASSERT_MSG(strcmp(shared->host, "10.0.0.3") == 0 && shared->alive == -1 && shared->users == 1,
+               "Reused session starts afresh");
+    session_put(shared);
+    session_put(session_get(&table, "10.0.0.2"));
+    session_put(&table.hosts[1]);
+
+    /* Hosts come and go far beyond the table's size */
+    for (i = 0; i < SESSION_MAX_HOSTS; i++) {
+        snprintf(host, sizeof(host), "10.1.%d.%d", i / 256, i % 256);
+        held[i] = session_get(&table, host);
+        ASSERT_MSG(held[i] != NULL, "Table fills up");
+    }
+    ASSERT_MSG(session_get(&table, "10.2.0.0") == NULL, "A full table has no room for more");
+    for (i = 0; i < 10 * SESSION_MAX_HOSTS; i++) {
+        int slot = i % SESSION_MAX_HOSTS;
+
+        session_put(held[slot]);
+        snprintf(host, sizeof(host), "10.3.%d.%d", i / 256, i % 256);
+        held[slot] = session_get(&table, host);
+        ASSERT_MSG(held[slot] != NULL && strcmp(held[slot]->host, host) == 0, "Churn never runs out of sessions");
+    }
+    ASSERT_MSG(table.count == SESSION_MAX_HOSTS, "Slots are reused, not added");
+    printf("test_session_put PASSED\n");
+}
+
+void test_session_refresh() {
+    unsigned char reply[4096];
+    char port[16];
+    long reply_len;
+    pid_t server;
+    HostSession* session;
+
+    printf("Running test_session_refresh...\n");
+    reply_len = fake_usbipd_load("op_rep_devlist.bin", reply, sizeof(reply));
+    ASSERT_MSG(reply_len > 0, "Recorded reply op_rep_devlist.bin should load");
+    session_table_init(&table);
+    session = session_get(&table, "127.0.0.1");
+
+    /* List, then probe while the listing is fresh, then list once it expires */
+    server = fake_usbipd_start(reply, (size_t)reply_len, 8, 4, port, sizeof(port));
+    ASSERT_MSG(server > 0, "Fake usbipd should start");
+    ASSERT_MSG(session_refresh(session, port, 0, 30000) == SESSION_LISTED, "First refresh lists the host");
+    ASSERT_MSG(session->alive == 1 && session->device_count == 2, "Two devices listed");
+    ASSERT_MSG(session->rtt_samples == 0, "Listings are not timed");
+    ASSERT_MSG(session_has_device(session, "7-4") && session_has_device(session, "1-2"), "Both busids are known");
+    ASSERT_MSG(!session_has_device(session, "7-") && !session_has_device(session, "9-9"), "Only exact busids match");
+    ASSERT_MSG(session_cache_valid(session, 29999, 30000), "Listing is fresh until the TTL");
+    ASSERT_MSG(session_refresh(session, port, 1000, 30000) == SESSION_PROBED, "Fresh listing only needs a probe");
+    ASSERT_MSG(session_has_device(session, "7-4"), "Probe keeps the listing");
+    ASSERT_MSG(session->rtt_samples == 1 && session->rtt_us > 0, "Probe is timed");
+    ASSERT_MSG(session_probe(session, port) == 0 && session->rtt_samples == 2, "Direct probe is timed too");
+    ASSERT_MSG(session_refresh(session, port, 30000, 30000) == SESSION_LISTED, "Expired listing is fetched again");
+    fake_usbipd_stop(server);
+
+    /* A host that stops answering loses its listing */
+    errno = 0;
+    ASSERT_MSG(session_refresh(session, port, 31000, 30000) == SESSION_FAILED, "Probe of a stopped host fails");
+    ASSERT_MSG(errno == ECONNREFUSED, "errno tells why");
+    ASSERT_MSG(session->alive == 0 && !session->cached, "Host is down, listing dropped");
+    ASSERT_MSG(session->rtt_samples == 2, "Failed contacts are not timed");
+    ASSERT_MSG(session_probe(session, port) == -1 && session->alive == 0, "Direct probe of a stopped host fails");
+
+    /* Once it is back, it is listed rather than probed; invalidation and a zero TTL force listings too */
+    server = fake_usbipd_start(reply, (size_t)reply_len, 8, 3, port, sizeof(port));
+    ASSERT_MSG(session_refresh(session, port, 32000, 30000) == SESSION_LISTED, "Returning host is listed");
+    session_invalidate(session);
+    ASSERT_MSG(session_refresh(session, port, 33000, 30000) == SESSION_LISTED, "Invalidated listing is fetched again");
+    ASSERT_MSG(session_refresh(session, port, 33000, 0) == SESSION_LISTED, "Zero TTL lists every time");
+    fake_usbipd_stop(server);
+
+    printf("test_session_refresh PASSED\n");
+}
+
+void test_session_pick() {
+    HostSession* hosts[3];
+    int usable[3] = {1, 1, 1};
+
+    printf("Running test_session_pick...\n");
+    session_table_init(&table);
+    hosts[0] = session_get(&table, "10.0.0.1");
+    hosts[1] = session_get(&table, "10.0.0.2");
+    hosts[2] = session_get(&table, "10.0.0.3");
+
+    /* Nothing timed yet: the given order decides either way */
+    ASSERT_MSG(session_pick(hosts, usable, 3, 1) == 0 && session_pick(hosts, usable, 3, 0) == 0, "First host");
+
+    /* The smoothed RTT moves an eighth of the way to each new sample */
+    session_observe_rtt(hosts[0], 8000);
+    ASSERT_MSG(hosts[0]->rtt_us == 8000, "First sample is taken as is");
+    session_observe_rtt(hosts[0], 16000);
+    ASSERT_MSG(hosts[0]->rtt_us == 9000, "Later samples are smoothed");
+    session_observe_rtt(hosts[1], 2000);
+
+    /* Fastest usable host first, then anything not timed; or the given order */
+    ASSERT_MSG(session_pick(hosts, usable, 3, 1) == 1, "Lowest RTT wins");
+    ASSERT_MSG(session_pick(hosts, usable, 3, 0) == 0, "Order ignores RTT");
+    usable[1] = 0;
+    ASSERT_MSG(session_pick(hosts, usable, 3, 1) == 0, "Timed host beats one not timed");
+    usable[0] = 0;
+    ASSERT_MSG(session_pick(hosts, usable, 3, 1) == 2, "Untimed host when nothing else is usable");
+    usable[2] = 0;
+    ASSERT_MSG(session_pick(hosts, usable, 3, 1) == -1 && session_pick(hosts, usable, 3, 0) == -1, "None usable");
+
+    printf("test_session_pick PASSED\n");
+}
+
+int main() {
+    /* Probes hang up before the fake server writes its reply */
+    signal(SIGPIPE, SIG_IGN);
+
+    test_session_get();
+    test_session_put();
+    test_session_refresh();
+    test_session_pick();
+    printf("All tests PASSED\n");
+    return 0;
+}
@@ -0,0 +1,91 @@
+#define _DEFAULT_SOURCE
+#include "../src/settle.h"
+#include "../src/scheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Helper macro for assertions with messages */
+#define ASSERT_MSG(condition, message) \
+    if (!(condition)) { \
+        fprintf(stderr, "Assertion failed: (" #condition "), %s\n", message); \
+        exit(1); /* Exit with failure */ \
+    }
+
+/* A fake port that shows the device once ready_ms have passed since start_ms */
+typedef struct {
+    long long start_ms;
+    long long ready_ms;   /* -1 for never */
+    int give_up_after;    /* Checks before asking to stop, 0 for never */
+    int calls;
+} FakePort;
+
+static int fake_check(void* ctx) {
+    FakePort* port = ctx;
+
+    port->calls++;
+    if (port->give_up_after && port->calls >= port->give_up_after) {
+        return SETTLE_GAVE_UP;
+    }
+    if (port->ready_ms >= 0 && scheduler_now_ms() - port->start_ms >= port->ready_ms) {
+        return SETTLE_READY;
+    }
+    return SETTLE_PENDING;
+}
+
+static void start(FakePort* port, long long ready_ms, int give_up_after) {
+    memset(port, 0, sizeof(*port));
+    port->start_ms = scheduler_now_ms();
+    port->ready_ms = ready_ms;
+    port->give_up_after = give_up_after;
+}
+
+void test_settle_wait() {
+    FakePort port;
+    SettleResult result;
+    long long start_ms;
+
+    printf("Running test_settle_wait...\n");
+
+    /* Already there: one check, no wait */
+    start(&port, 0, 0);
+    ASSERT_MSG(settle_wait(fake_check, &port, 2000, SETTLE_FIRST_STEP_MS, &result) == SETTLE_READY, "Ready at once");
+    ASSERT_MSG(result.checks == 1 && result.waited_ms < 5, "A ready port costs a single check");
+
+    /* Ready after 50 ms: found within one step of it, not after a fixed wait */
+    start(&port, 50, 0);
+    ASSERT_MSG(settle_wait(fake_check, &port, 2000, SETTLE_FIRST_STEP_MS, &result) == SETTLE_READY, "Ready later");
+    ASSERT_MSG(result.waited_ms >= 50 && result.waited_ms < 150, "Returns soon after the port is ready");
+    ASSERT_MSG(result.checks <= 6, "Steps grow, so few checks are made");
+
+    /* Slower than the old fixed two seconds still succeeds with a longer deadline */
+    start(&port, 2300, 0);
+    ASSERT_MSG(settle_wait(fake_check, &port, 5000, SETTLE_FIRST_STEP_MS, &result) == SETTLE_READY, "Slow link");
+    ASSERT_MSG(result.waited_ms >= 2300 && result.waited_ms < 2300 + SETTLE_MAX_STEP_MS + 100, "Steps are capped");
+    ASSERT_MSG(result.checks <= 12, "Capped steps still keep checks few");
+
+    /* Never there: the deadline ends it, with a last check right at it */
+    start(&port, -1, 0);
+    start_ms = scheduler_now_ms();
+    ASSERT_MSG(settle_wait(fake_check, &port, 300, SETTLE_FIRST_STEP_MS, &result) == SETTLE_PENDING, "Deadline passed");
+    ASSERT_MSG(result.waited_ms >= 300 && scheduler_now_ms() - start_ms < 400, "Stops at the deadline");
+    ASSERT_MSG(port.calls == result.checks, "Every check is counted");
+
+    /* A timeout of 0 is a single look */
+    start(&port, -1, 0);
+    ASSERT_MSG(settle_wait(fake_check, &port, 0, SETTLE_FIRST_STEP_MS, &result) == SETTLE_PENDING, "Single look");
+    ASSERT_MSG(result.checks == 1 && port.calls == 1, "No retries without a timeout");
+
+    /* The check can end the wait early, e.g. on shutdown */
+    start(&port, -1, 3);
+    ASSERT_MSG(settle_wait(fake_check, &port, 5000, SETTLE_FIRST_STEP_MS, NULL) == SETTLE_GAVE_UP, "Gave up");
+    ASSERT_MSG(port.calls == 3 && scheduler_now_ms() - port.start_ms < 200, "Stops right away");
+
+    printf("test_settle_wait PASSED\n");
+}
+
+int main() {
+    test_settle_wait();
+    printf("All tests PASSED\n");
+    return 0;
+}
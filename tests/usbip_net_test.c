@@ -0,0 +1,157 @@
+#define _DEFAULT_SOURCE
+#include "../src/usbip_net.h"
+#include "fake_usbipd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+/* Helper macro for assertions with messages */
+#define ASSERT_MSG(condition, message) \
+    if (!(condition)) { \
+        fprintf(stderr, "Assertion failed: (" #condition "), %s\n", message); \
+        exit(1); /* Exit with failure */ \
+    }
+
+void test_usbip_devlist() {
+    unsigned char reply[4096];
+    UsbipDevice devices[8];
+    char busids[8][USBIP_SYSFS_BUS_ID_SIZE];
+    char port[16];
+    long reply_len;
+    pid_t server;
+    int count;
+
+    printf("Running test_usbip_devlist...\n");
+
+    reply_len = fake_usbipd_load("op_rep_devlist.bin", reply, sizeof(reply));
+    ASSERT_MSG(reply_len > 0, "Recorded reply op_rep_devlist.bin should load");
+
+    /* Full listing with two devices */
+    server = fake_usbipd_start(reply, (size_t)reply_len, 8, 3, port, sizeof(port));
+    ASSERT_MSG(server > 0, "Fake usbipd should start");
+
+    count = usbip_devlist("127.0.0.1", port, devices, 8);
+    ASSERT_MSG(count == 2, "Listing should contain two devices");
+    ASSERT_MSG(strcmp(devices[0].busid, "7-4") == 0, "First device should be 7-4");
+    ASSERT_MSG(devices[0].busnum == 7 && devices[0].devnum == 4, "First device bus/dev should be 7/4");
+    ASSERT_MSG(devices[0].id_vendor == 0x2e8a && devices[0].id_product == 0x000f, "First device should be 2e8a:000f");
+    ASSERT_MSG(devices[0].num_interfaces == 3, "First device should have three interfaces");
+    ASSERT_MSG(strcmp(devices[0].path, "/sys/devices/pci0000:00/0000:00:14.0/usb7/7-4") == 0, "First device path should decode");
+    ASSERT_MSG(strcmp(devices[1].busid, "1-2") == 0, "Second device should be 1-2 (after interface records)");
+    ASSERT_MSG(devices[1].speed == 3, "Second device should be high speed");
+    ASSERT_MSG(usbip_devlist_contains(devices, count, "7-4") == 1, "BusID 7-4 should be available");
+    ASSERT_MSG(usbip_devlist_contains(devices, count, "1-2") == 1, "BusID 1-2 should be available");
+    ASSERT_MSG(usbip_devlist_contains(devices, count, "7-") == 0, "Partial busid 7- should NOT match");
+    ASSERT_MSG(usbip_devlist_contains(devices, count, "9-9") == 0, "BusID 9-9 should NOT be available");
+
+    /* Capacity smaller than the listing still reports the total */
+    count = usbip_devlist("127.0.0.1", port, devices, 1);
+    ASSERT_MSG(count == 2, "Total count should be reported when the array is too small");
+    ASSERT_MSG(strcmp(devices[0].busid, "7-4") == 0, "First device should still be decoded");
+
+    /* Busids only */
+    count = usbip_devlist_busids("127.0.0.1", port, busids, 8);
+    ASSERT_MSG(count == 2, "Busid listing should contain two devices");
+    ASSERT_MSG(strcmp(busids[0], "7-4") == 0 && strcmp(busids[1], "1-2") == 0, "Busids should decode in order");
+    fake_usbipd_stop(server);
+
+    /* Truncated reply is a protocol error */
+    server = fake_usbipd_start(reply, 100, 8, 1, port, sizeof(port));
+    ASSERT_MSG(usbip_devlist("127.0.0.1", port, devices, 8) == -1, "Truncated reply should fail");
+    fake_usbipd_stop(server);
+
+    /* Empty listing */
+    reply_len = fake_usbipd_load("op_rep_devlist_empty.bin", reply, sizeof(reply));
+    ASSERT_MSG(reply_len > 0, "Recorded reply op_rep_devlist_empty.bin should load");
+    server = fake_usbipd_start(reply, (size_t)reply_len, 8, 1, port, sizeof(port));
+    ASSERT_MSG(usbip_devlist("127.0.0.1", port, devices, 8) == 0, "Empty listing should have no devices");
+    fake_usbipd_stop(server);
+
+    /* Nobody listening */
+    ASSERT_MSG(usbip_devlist("127.0.0.1", port, devices, 8) == -1, "Connection refused should fail");
+
+    printf("test_usbip_devlist PASSED\n");
+}
+
+void test_usbip_import() {
+    unsigned char reply[4096];
+    UsbipDevice device;
+    char port[16];
+    long reply_len;
+    pid_t server;
+    int fd;
+
+    printf("Running test_usbip_import...\n");
+
+    reply_len = fake_usbipd_load("op_rep_import.bin", reply, sizeof(reply));
+    ASSERT_MSG(reply_len > 0, "Recorded reply op_rep_import.bin should load");
+
+    /* Request is op_common plus a 32 byte busid */
+    server = fake_usbipd_start(reply, (size_t)reply_len, 40, 2, port, sizeof(port));
+    fd = usbip_import("127.0.0.1", port, "7-4", &device);
+    ASSERT_MSG(fd >= 0, "Import of 7-4 should succeed");
+    ASSERT_MSG(device.busnum == 7 && device.devnum == 4 && device.speed == 2, "Import reply should decode");
+    close(fd);
+
+    /* A reply for another busid is rejected */
+    ASSERT_MSG(usbip_import("127.0.0.1", port, "1-2", &device) == -1, "Mismatched busid should fail");
+    fake_usbipd_stop(server);
+
+    /* Non-zero status from the host */
+    reply_len = fake_usbipd_load("op_rep_import_error.bin", reply, sizeof(reply));
+    ASSERT_MSG(reply_len > 0, "Recorded reply op_rep_import_error.bin should load");
+    server = fake_usbipd_start(reply, (size_t)reply_len, 40, 1, port, sizeof(port));
+    ASSERT_MSG(usbip_import("127.0.0.1", port, "7-4", &device) == -1, "Error status should fail");
+    fake_usbipd_stop(server);
+
+    printf("test_usbip_import PASSED\n");
+}
+
+void test_usbip_timeout() {
+    static UsbipDevice devices[4];
+    unsigned char reply[1] = {0};
+    struct timespec start, end;
+    volatile sig_atomic_t keep_running = 1;
+    char port[16];
+    pid_t server;
+    long long elapsed;
+    printf("Running test_usbip_timeout...\n");
+
+    /* Server waits for a longer request than we send, so no reply ever comes */
+    server = fake_usbipd_start(reply, sizeof(reply), 512, 1, port, sizeof(port));
+    ASSERT_MSG(server > 0, "Fake usbipd should start");
+    usbip_net_set_timeout(300);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ASSERT_MSG(usbip_devlist("127.0.0.1", port, devices, 4) == -1, "Stalled host should fail");
+    ASSERT_MSG(errno == ETIMEDOUT, "Stalled host should report ETIMEDOUT");
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (long long)(end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+    ASSERT_MSG(elapsed >= 250 && elapsed < 3000, "Deadline should cover the whole exchange");
+    fake_usbipd_stop(server);
+
+    /* A cleared keep-running flag abandons the exchange at the next wakeup */
+    server = fake_usbipd_start(reply, sizeof(reply), 512, 1, port, sizeof(port));
+    keep_running = 0;
+    usbip_net_set_keep_running(&keep_running);
+    usbip_net_set_timeout(5000);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ASSERT_MSG(usbip_devlist("127.0.0.1", port, devices, 4) == -1, "Cancelled exchange should fail");
+    ASSERT_MSG(errno == ECANCELED, "Cancelled exchange should report ECANCELED");
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ASSERT_MSG(end.tv_sec - start.tv_sec < 3, "Cancelled exchange should not wait for the deadline");
+    fake_usbipd_stop(server);
+
+    usbip_net_set_keep_running(NULL);
+    usbip_net_set_timeout(USBIP_NET_DEFAULT_TIMEOUT_MS);
+    printf("test_usbip_timeout PASSED\n");
+}
+
+int main() {
+    test_usbip_devlist();
+    test_usbip_import();
+    test_usbip_timeout();
+    printf("All tests PASSED\n");
+    return 0;
+}
@@ -0,0 +1,144 @@
+#define _DEFAULT_SOURCE
+#include "../src/vhci.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Helper macro for assertions with messages */
+#define ASSERT_MSG(condition, message) \
+    if (!(condition)) { \
+        fprintf(stderr, "Assertion failed: (" #condition "), %s\n", message); \
+        exit(1); /* Exit with failure */ \
+    }
+
+static char root[] = "/tmp/vhci_test_XXXXXX";
+
+static void write_file(const char* rel_path, const char* content) {
+    char path[512];
+    FILE* f;
+    snprintf(path, sizeof(path), "%s/%s", root, rel_path);
+    f = fopen(path, "w");
+    ASSERT_MSG(f != NULL, "failed to create fake sysfs file");
+    fputs(content, f);
+    fclose(f);
+}
+
+static void make_dir(const char* rel_path) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", root, rel_path);
+    mkdir(path, 0755);
+}
+
+static void cleanup(void) {
+    char cmd[600];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s'", root);
+    if (system(cmd) != 0) {
+        fprintf(stderr, "Warning: failed to remove %s\n", root);
+    }
+}
+
+void test_vhci_port_attached() {
+    char platform[512], records[512];
+    printf("Running test_vhci_port_attached...\n");
+
+    ASSERT_MSG(mkdtemp(root) != NULL, "mkdtemp failed");
+    snprintf(platform, sizeof(platform), "%s/platform", root);
+    snprintf(records, sizeof(records), "%s/records", root);
+
+    /* No vhci_hcd devices at all */
+    make_dir("platform");
+    make_dir("records");
+    vhci_set_paths(platform, records);
+    ASSERT_MSG(vhci_available() == 0, "No status files should be found");
+    ASSERT_MSG(vhci_port_attached("192.168.1.1", "7-4", 1) == -1, "Probe should report unavailable without sysfs");
+
+    /* Two controllers, ports 0 and 9 in use, port 1 unassigned but with a stale record */
+    make_dir("platform/vhci_hcd.0");
+    make_dir("platform/vhci_hcd.1");
+    write_file("platform/vhci_hcd.0/status",
+               "hub port sta spd dev      sockfd local_busid\n"
+               "hs  0000 004 002 00070004 000003 1-1\n"
+               "hs  0001 001 000 00000000 000000 0-0\n"
+               "ss  0008 001 000 00000000 000000 0-0\n");
+    write_file("platform/vhci_hcd.0/status.1",
+               "hub port sta spd dev      sockfd local_busid\n"
+               "hs  0009 004 003 00010002 000005 3-2\n");
+    write_file("platform/vhci_hcd.0/nports", "16\n");
+    write_file("records/port0", "192.168.1.1 3240 7-4\n");
+    write_file("records/port1", "192.168.1.1 3240 5-5\n");
+    write_file("records/port9", "10.0.0.5 3240 devid=0123456789abcdef\n");
+
+    vhci_set_paths(platform, records);
+    ASSERT_MSG(vhci_available() == 1, "Status files should be found");
+    ASSERT_MSG(vhci_port_attached("192.168.1.1", "7-4", 1) == 1, "BusID 7-4 should be attached");
+    ASSERT_MSG(vhci_port_attached("192.168.1.1", "7-", 1) == 0, "Partial busid 7- should NOT match");
+    ASSERT_MSG(vhci_port_attached("192.168.1.1", "1-1", 1) == 0, "BusID 1-1 should NOT be attached (it's the local port)");
+    ASSERT_MSG(vhci_port_attached("192.168.1.1", "5-5", 1) == 0, "BusID 5-5 should NOT be attached (port not in use)");
+    ASSERT_MSG(vhci_port_attached("10.0.0.5", "0123456789abcdef", 0) == 1, "DevID ...abcdef should be attached");
+    ASSERT_MSG(vhci_port_attached("10.0.0.5", "deadbeefdeadbeef", 0) == 0, "DevID deadbeef... should NOT be attached");
+    ASSERT_MSG(vhci_port_attached("192.168.1.2", "7-4", 1) == 0, "BusID 7-4 from another host should NOT be attached");
+    ASSERT_MSG(vhci_port_attached("10.0.0.6", "0123456789abcdef", 0) == 0, "DevID from another host should NOT be attached");
+    {
+        static PortTable table;
+        const PortRecord* record;
+        ASSERT_MSG(vhci_read_ports(&table) == 2, "Two ports with records should be read");
+        record = port_table_find(&table, "192.168.1.1", "7-4", 1);
+        ASSERT_MSG(record != NULL && record->port == 0 && record->speed == 2, "7-4 should be on port 0 at full speed");
+        ASSERT_MSG(strcmp(record->local_busid, "1-1") == 0, "7-4 local busid should come from the status file");
+        record = port_table_find(&table, "10.0.0.5", "0123456789abcdef", 0);
+        ASSERT_MSG(record != NULL && record->port == 9 && strcmp(record->host, "10.0.0.5") == 0, "DevID should be on port 9");
+        ASSERT_MSG(port_table_find(&table, "192.168.1.1", "5-5", 1) == NULL, "Stale record of a free port should be skipped");
+    }
+
+    /* Pre-4.13 status layout without the hub column */
+    write_file("platform/vhci_hcd.0/status",
+               "prt sta spd dev socket           local_busid\n"
+               "000 004 002 00070004 ffff8a2b3c4d5e6f 1-1\n");
+    write_file("platform/vhci_hcd.0/status.1",
+               "prt sta spd dev socket           local_busid\n");
+    ASSERT_MSG(vhci_port_attached("192.168.1.1", "7-4", 1) == 1, "BusID 7-4 should be attached (legacy layout)");
+    ASSERT_MSG(vhci_port_attached("10.0.0.5", "0123456789abcdef", 0) == 0, "DevID should NOT be attached (legacy layout)");
+
+    /* Attach picks the first free port of the right speed class and records it */
+    write_file("platform/vhci_hcd.0/status",
+               "hub port sta spd dev      sockfd local_busid\n"
+               "hs  0000 004 002 00070004 000003 1-1\n"
+               "hs  0001 001 000 00000000 000000 0-0\n"
+               "ss  0008 001 000 00000000 000000 0-0\n");
+    ASSERT_MSG(vhci_can_attach() == 0, "Attach should be unsupported without the attach file");
+    write_file("platform/vhci_hcd.0/attach", "");
+    vhci_set_paths(platform, records);
+    ASSERT_MSG(vhci_can_attach() == 1, "Attach file should be found");
+    ASSERT_MSG(vhci_attach(7, 1, 3, 3, "10.0.0.9", "3240", "1-3") == 1, "High speed device should use port 1");
+    ASSERT_MSG(vhci_attach(7, 2, 2, 5, "10.0.0.9", "3240", "2-2") == 8, "SuperSpeed device should use port 8");
+    {
+        FILE* f;
+        char path[1024], line[128];
+        snprintf(path, sizeof(path), "%s/port8", records);
+        f = fopen(path, "r");
+        ASSERT_MSG(f != NULL, "Connection record for port 8 should exist");
+        ASSERT_MSG(fgets(line, sizeof(line), f) != NULL, "Connection record should be readable");
+        fclose(f);
+        ASSERT_MSG(strcmp(line, "10.0.0.9 3240 2-2\n") == 0, "Connection record should match usbip's format");
+        snprintf(path, sizeof(path), "%s/vhci_hcd.0/attach", platform);
+        f = fopen(path, "r");
+        ASSERT_MSG(f != NULL && fgets(line, sizeof(line), f) != NULL, "Attach request should be written");
+        fclose(f);
+        ASSERT_MSG(strcmp(line, "8 7 131074 5") == 0, "Attach request should be <port> <sockfd> <devid> <speed>");
+    }
+
+    /* Module unloaded after discovery */
+    cleanup();
+    ASSERT_MSG(vhci_port_attached("192.168.1.1", "7-4", 1) == -1, "Probe should report unavailable after removal");
+
+    vhci_set_paths(NULL, NULL);
+    printf("test_vhci_port_attached PASSED\n");
+}
+
+int main() {
+    test_vhci_port_attached();
+    printf("All tests PASSED\n");
+    return 0;
+}